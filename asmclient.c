@@ -0,0 +1,336 @@
+/* asmclient.c
+
+   usage: asmclient [-s] [-n count] [-f format] <socket> <infile>
+
+   This program sends an assembly file to an assembler started
+   with --serve <socket> and prints what comes back. By default
+   the server is given the path of the file and reads it itself,
+   with -s the source is sent inline. The obj file or the err
+   file is written to standard output and the exit status is 0
+   if the file assembled, 1 if it had errors and 2 if it failed.
+   -f asks for another obj file format, as --format takes.
+
+   With -n the request is sent count times over one connection
+   and only the round trip times are reported, as a quick load
+   benchmark of the server.
+*/
+
+/************* Includes **************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/************* Constants *************/
+#define HEADER_LEN 128   /* longest header line */
+
+/* exit status */
+#define EXIT_OK     0  /* file assembled */
+#define EXIT_ERRORS 1  /* file had errors */
+#define EXIT_FAILED 2  /* request failed */
+
+/***** argument constants *****/
+#define ARGS_NEEDED 3
+
+
+
+/***************** Functions  ***************/
+
+/* this function writes len bytes from buf to fd, retrying
+   short writes. returns 0 on success */
+static int writeall(int fd, const char *buf, size_t len)
+{
+    ssize_t n;  /* bytes written by one call */
+
+    while (len > 0)
+    {
+        n = write(fd, buf, len);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* this function reads exactly len bytes from fd into buf.
+   returns 0 on success, -1 if the server went away */
+static int readall(int fd, char *buf, size_t len)
+{
+    ssize_t n;  /* bytes read by one call */
+
+    while (len > 0)
+    {
+        n = read(fd, buf, len);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* this function reads a whole file into a malloc'd buffer and sets
+   len to its size. returns NULL if it cannot be read */
+static char *readfile(const char *name, size_t *len)
+{
+    int fd;          /* file descriptor */
+    struct stat st;  /* size of the file */
+    char *buf;       /* contents */
+
+    if ((fd = open(name, O_RDONLY)) < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    buf = malloc((size_t)st.st_size + 1);
+    if (buf == NULL || readall(fd, buf, (size_t)st.st_size) != 0)
+    {
+        free(buf);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+
+    *len = (size_t)st.st_size;
+    return buf;
+}
+
+/* this function sends one request and reads the reply. the payload
+   of the reply goes into *reply, grown as needed, and its length into
+   replylen. returns the exit status for the result, -1 if the
+   connection broke */
+static int request(int fd, const char *header, size_t headerlen,
+                   const char *payload, size_t len,
+                   char **reply, size_t *replycap, size_t *replylen)
+{
+    char line[HEADER_LEN];  /* reply header */
+    char result[16];        /* result word */
+    char *grown;            /* reply buffer after growing it */
+    unsigned long n;        /* reply length */
+    size_t got = 0;         /* bytes of the header line */
+
+    if (writeall(fd, header, headerlen) != 0 || writeall(fd, payload, len) != 0)
+    {
+        return -1;
+    }
+
+    /* the header is short, read it a byte at a time so nothing of
+       the payload is read past */
+    do
+    {
+        if (got + 1 >= sizeof(line) || read(fd, line + got, 1) != 1)
+        {
+            return -1;
+        }
+    } while (line[got++] != '\n');
+    line[got] = '\0';
+
+    if (sscanf(line, "%15s %lu", result, &n) != 2)
+    {
+        return -1;
+    }
+    if (n > *replycap)
+    {
+        /* the old buffer stays with the caller if this fails */
+        if ((grown = realloc(*reply, n)) == NULL)
+        {
+            return -1;
+        }
+        *reply = grown;
+        *replycap = n;
+    }
+    if (readall(fd, *reply, n) != 0)
+    {
+        return -1;
+    }
+    *replylen = n;
+
+    if (strcmp(result, "ok") == 0)
+    {
+        return EXIT_OK;
+    }
+    return strcmp(result, "errors") == 0 ? EXIT_ERRORS : EXIT_FAILED;
+}
+
+/* compares two round trip times for qsort */
+static int cmptimes(const void *a, const void *b)
+{
+    double x = *(const double *)a;  /* first time */
+    double y = *(const double *)b;  /* second time */
+
+    return (x > y) - (x < y);
+}
+
+/* this function sends the same request count times and reports
+   the spread of the round trips. returns the status of the last one */
+static int timerequests(int fd, const char *header, size_t headerlen,
+                        const char *payload, size_t len, long count)
+{
+    double *times;           /* round trip of every request */
+    double total = 0;        /* sum of the round trips */
+    struct timespec t0, t1;  /* start and end of a request */
+    char *reply = NULL;      /* reply payload */
+    size_t replycap = 0;     /* bytes allocated for reply */
+    size_t replylen = 0;     /* bytes in reply */
+    int status = EXIT_OK;    /* result of the last request */
+    long k;                  /* request iterator */
+
+    if ((times = malloc((size_t)count * sizeof(double))) == NULL)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        exit(EXIT_FAILED);
+    }
+
+    /* time the requests back to back */
+    for (k = 0; k < count; k++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        status = request(fd, header, headerlen, payload, len,
+                         &reply, &replycap, &replylen);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (status < 0)
+        {
+            fprintf(stderr, "Connection to server lost.\n");
+            exit(EXIT_FAILED);
+        }
+        times[k] = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+        total += times[k];
+    }
+
+    /* report the spread of the round trips in microseconds */
+    qsort(times, (size_t)count, sizeof(double), cmptimes);
+    printf("%ld requests, %lu reply bytes each\n", count, (unsigned long)replylen);
+    printf("round trip us: min %.1f  median %.1f  p99 %.1f  max %.1f  mean %.1f\n",
+           times[0], times[count / 2], times[(count * 99) / 100], times[count - 1],
+           total / count);
+    printf("%.0f requests/s\n", count / (total / 1e6));
+
+    free(times);
+    free(reply);
+    return status;
+}
+
+/* main method */
+int main(int argc, char **argv)
+{
+    /************* Variables **********************/
+    struct sockaddr_un addr;  /* server address */
+    int fd;                   /* connection to the server */
+    int inline_source = 0;    /* send the source instead of the path */
+    long count = 0;           /* requests to time, 0 sends one */
+    const char *format = "obj";  /* obj file format asked for */
+    char header[HEADER_LEN];  /* request header */
+    int headerlen;            /* its length */
+    char path[PATH_MAX];      /* absolute path of the file */
+    char *payload;            /* path or source sent */
+    size_t len;               /* bytes in payload */
+    char *reply = NULL;       /* reply payload */
+    size_t replycap = 0;      /* bytes allocated for reply */
+    size_t replylen = 0;      /* bytes in reply */
+    int status;               /* result of the request */
+    int i;                    /* argument iterator */
+
+
+    /************* BEGIN main executables *********/
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0)
+        {
+            inline_source = 1;
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            count = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            format = argv[++i];
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    /* check if we have correct arguments */
+    if (argc - i + 1 != ARGS_NEEDED || count < 0)
+    {
+        fprintf(stderr, "Invalid arguments provided.\n");
+        fprintf(stderr, "usage: %s [-s] [-n count] [-f format] <socket> <infile>\n", argv[0]);
+        exit(EXIT_FAILED);
+    }
+
+    /* the server reads the path itself, so it has to be absolute */
+    if (inline_source)
+    {
+        payload = readfile(argv[i+1], &len);
+    }
+    else
+    {
+        payload = realpath(argv[i+1], path);
+        len = payload ? strlen(path) : 0;
+    }
+    if (payload == NULL)
+    {
+        fprintf(stderr, "Error opening asm file: %s\n", argv[i+1]);
+        exit(EXIT_FAILED);
+    }
+    headerlen = snprintf(header, sizeof(header), "%s %.15s %lu\n",
+                         inline_source ? "source" : "path", format, (unsigned long)len);
+
+    /* connect to the server */
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, argv[i], sizeof(addr.sun_path) - 1);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        fprintf(stderr, "Error connecting to server: %s\n", argv[i]);
+        exit(EXIT_FAILED);
+    }
+
+    if (count > 0)
+    {
+        status = timerequests(fd, header, (size_t)headerlen, payload, len, count);
+    }
+    else
+    {
+        /* a single request prints what came back */
+        status = request(fd, header, (size_t)headerlen, payload, len,
+                         &reply, &replycap, &replylen);
+        if (status < 0)
+        {
+            fprintf(stderr, "Connection to server lost.\n");
+            exit(EXIT_FAILED);
+        }
+        fwrite(reply, 1, replylen, status == EXIT_FAILED ? stderr : stdout);
+    }
+
+    if (inline_source)
+    {
+        free(payload);
+    }
+    free(reply);
+    close(fd);
+
+    /**************** END main executables *********************/
+
+    /* exit program */
+    return status;
+}
@@ -1,2108 +1,1088 @@
 /* prog.c 
 
-   usage: prog <infile>
+   usage: prog [-v[v]] [-j threads] [--cache-dir dir] [--stream]
+               [--format=name] <infile|@listfile>...
+          prog [-v[v]] [-j threads] [--cache-dir dir] --serve <socket>
+
+   This program will read in TMIPS assembly files and hand
+   them to the assembler library, see libasm.h. For every
+   file it then either prints a detailed error file or
+   produces an object file in hexadecimal format. Many files
+   are assembled side by side, and with --serve the program
+   stays up and assembles what clients send over a socket.
+   With --cache-dir what was read of every part of a file is
+   kept in a directory, so after a small edit only the parts
+   that changed are read again. With --stream the obj file is
+   written while the file is read and the program is never held
+   in memory as a whole, for sources too large for that.
+   --format=bin-le and --format=bin-be write a .bin file of
+   packed words instead, in little or big endian byte order.
+   --format=elf writes a big endian MIPS ELF executable to a
+   .elf file, elf-le a little endian one. --format=ihex and
+   --format=srec write Intel HEX to a .hex file or Motorola
+   S-records to a .srec file, for flashing, with ihex-le and
+   srec-le for little endian boards. --format=rel writes a
+   relocatable object to a .o file, rel-le a little endian one,
+   for mipsld to link with others. A file that uses .extern
+   symbols can only be written as one. Only obj and bin files
+   can be streamed.
 
-   This program will read in a TMIPS assembly file and
-   process instructions from it. It makes a first pass
-   reading in all the instructions and symbols into a
-   linked list and puts all labels into a hash table.
-   On a second pass it evaluates all the symbols and
-   assembles the intructions, throwing errors as they
-   arise. After this it will then either print a detailed
-   error file or produce an object file in hexadecimal format.
 
-
-*/
-
-/* prog.h 
-   this file contains the prototypes for the
-   utility functions as well as many of the constants used
-   throughout the program.
 */
 
 /************* Includes **************/
+#define _GNU_SOURCE      /* struct ucred for SO_PEERCRED */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "libasm.h"
 
 /*************** constants ******************/
 
 /*lengths of different arrays */
-#define OPCODE_LEN 8
-#define LABEL_LEN 32
-#define INST_LEN 33
-#define REG_LEN 6
-#define IMMEDIATE_LEN 17
-#define LINE_LEN 81
 #define FILE_LEN 255
+#define REASON_LEN (FILE_LEN + 64)  /* longest reason a file failed */
 
-#define ERR_OPCODE 0       /* illegal opcode detected */
-#define ERR_UNDEFSYMBOL 1  /* undefined symbol used   */
-#define ERR_MULTSYMBOL 2   /* mutiply defined symbold */
-/************** Constants *************/
-#define HASH_SIZE 13
-
-/* types of instructions */
-#define RTYPE 0
-#define ITYPE 1
-#define JTYPE 2
-
-#define DEBUG 1
-#define REGBITS 6 /* register string length */
-
-
-/* utility functions */
-
-
-/* checks if a line is blank */
-int isBlank(const char *line);
-
-/* check for comment in line */
-int commentExists(const char *line);
-
-/* is line a comment ? */
-int isComment(const char *line);
-
-/* strips inline comment out of instruction */
-void stripComment(char *line);
-
-/* trim whitespace from string */
-char *trimWhiteSpace(char *str);
-
-/* return binary string for reg number */
-char* regToBin(char *reg);
-
-/* return a binary string for immediate number */
-char* immToBin(char *imm);
-
-/* return a binary string for immediate number */
-char* subImmToBin(char *imm, int end, int start);
-
-/* converts an integer in string format to a 32 bit binary string */
-char* numTo32Bin(char *num);
-
-/* returns a pointer to a new strign subset */
-char* substring(const char* str, size_t begin, size_t len);
-
-/* converts a 32 bit binary string to hex */
-char* binToHex32(char *bin);
-
-/* takes in an integer address and converts it to a 16 bit hex string */
-char* addrToHex(int address, char *ret);
-
-/****************** Constants **************/
-
-/****************** Data Structures ********************/
-
-/* this node will hold an error found
-   while reading asm file */
-typedef struct errnode_s
-{
-    /* variables */
-    int errtype;             /* type of error */
-    int lineno;              /* line number error was encountered on */
-
-    char symbol[LABEL_LEN];  /* name of symbol */
-    char opcode[OPCODE_LEN]; /* name of opcode */
-
-
-    struct errnode_s *next; /* pointer to next node in list */
-
-} errnode;
-
-typedef struct errlist_s
-{
-    errnode *head;  /* pointer to the head of the list */
-    errnode *cur;   /* node pointer used for traversal */
-
-    int count;       /* number of instructions */
-
-} errlist;
+#define MAX_THREADS 256  /* most threads -j accepts */
 
+/* results of assembling one file */
+#define FILE_OK     0  /* obj file written */
+#define FILE_ERRORS 1  /* err file written */
+#define FILE_FAILED 2  /* a file could not be read or written */
 
-/*************** Functions **************************************/
-
-/* add a node to list */
-void add_err(errlist *list, errnode *node);
-
-/* delete the list */
-void delete_errlist(errlist *list);
-
-
-
-/*************** Data structures *********************/
-
-/* this node will hold a data entry
-   from the data section of the asm file */
-typedef struct datanode_s
-{
-    /* variables */
-    int address;                  /* numeric address of instruction as integer */
-    int lineno;                   /* line number the instruction was read from */
-    char label[LABEL_LEN];        /* name of label if one exists */
-
-    char binval[INST_LEN];      /* binary represenation of compiled instruction */
-    char hex_val[INST_LEN];      /* hex representation of compiled instruction */
-
-    struct datanode_s *next;
-
-} datanode;
-
-typedef struct datalist_s
+/* an output format --format takes */
+typedef struct formatname_s
 {
-    datanode *head;  /* pointer to the head of the list */
-    datanode *cur;   /* node pointer used for traversal */
-
-    int count;       /* number of instructions */
-
-} datalist;
-
-
-/*************** Functions **************************************/
-
-/* add a node to list */
-void add_datanode(datalist *list, datanode *node);
-
-/* delete the list */
-void delete_datalist(datalist* list);
-
-
-
-
-/************* Includes ****************/
-
-/**************Data structures ****************/
-
-/* this node will hold an instruction read
-from the assembly file to later be converted
-into a hex code */
-typedef struct instnode_s
+    const char *name;  /* name given to --format */
+    int format;        /* one of the ASM_FORMAT_ constants */
+    const char *ext;   /* extension of the output file */
+    int streams;       /* can be written with --stream */
+} formatname;
+
+/* every output format, the first is the default */
+static const formatname formats[] =
 {
-    /* variables all instructions will utilize */
-    int  address;                 /* numeric address of instruction as integer */
-    int lineno;                   /* line number the instruction was read from */
-    char label[LABEL_LEN];        /* name of label if one exists */
-    int  inst_type;               /* type of instruction: R, I, J */
-    char opcode_name[OPCODE_LEN]; /* name of the opcode */
-    char opcode_bin[OPCODE_LEN];  /* binary string for opcode */
-    char bin_inst[INST_LEN];      /* binary represenation of compiled instruction */
-    char hex_inst[INST_LEN];      /* hex representation of compiled instruction */
-
-    /* type dependent variables */
-    char rs1[REG_LEN];       /* Register source 1 */
-    char rs2[REG_LEN];       /* Register source 2 */
-    char rt[REG_LEN];        /* Register target   */
-    char sa[REG_LEN];        /* shift amount      */
-    char imm[IMMEDIATE_LEN]; /* immediate address */
-    char symbol[LABEL_LEN];  /* symbol */
-
-    struct instnode_s *next; /* pointer to next node in list */
-
-} instnode;
-
-typedef struct instlist_s
+    { "obj",     ASM_FORMAT_OBJ,     ".obj",  1 },
+    { "bin-le",  ASM_FORMAT_BIN_LE,  ".bin",  1 },
+    { "bin-be",  ASM_FORMAT_BIN_BE,  ".bin",  1 },
+    { "elf",     ASM_FORMAT_ELF_BE,  ".elf",  0 },
+    { "elf-le",  ASM_FORMAT_ELF_LE,  ".elf",  0 },
+    { "elf-be",  ASM_FORMAT_ELF_BE,  ".elf",  0 },
+    { "ihex",    ASM_FORMAT_IHEX_BE, ".hex",  0 },
+    { "ihex-le", ASM_FORMAT_IHEX_LE, ".hex",  0 },
+    { "ihex-be", ASM_FORMAT_IHEX_BE, ".hex",  0 },
+    { "srec",    ASM_FORMAT_SREC_BE, ".srec", 0 },
+    { "srec-le", ASM_FORMAT_SREC_LE, ".srec", 0 },
+    { "srec-be", ASM_FORMAT_SREC_BE, ".srec", 0 },
+    { "rel",     ASM_FORMAT_REL_BE,  ".o",    0 },
+    { "rel-le",  ASM_FORMAT_REL_LE,  ".o",    0 },
+    { "rel-be",  ASM_FORMAT_REL_BE,  ".o",    0 },
+};
+
+#define FORMAT_COUNT (sizeof(formats) / sizeof(formats[0]))
+
+/* what became of one input file */
+typedef struct filestatus_s
 {
-    instnode *head;  /* pointer to the head of the list */
-    instnode *cur;   /* node pointer used for traversal */
-
-    int count;       /* number of instructions */
-
-} instlist;
-
-
-/*************** Functions **************************************/
-
-/* add a node to list */
-void add_node(instlist *list, instnode *node);
-
-/* delete the list */
-void delete_list(instlist* list);
-
-
-
-typedef struct ListNode
+    const char *path;    /* asm file */
+    char *listed;        /* path copied from a list file, freed at the end */
+    const char *source;  /* its contents if given inline, else NULL */
+    size_t sourcelen;    /* bytes in source */
+    int inmemory;        /* keep the output in outbuf, write no file */
+    int stream;          /* write the obj file while reading the source */
+    const formatname *format;  /* format of the obj file */
+
+    char out[FILE_LEN];  /* obj or err file written for it */
+    const char *outbuf;  /* obj or err file kept in memory */
+    size_t outlen;       /* bytes in outbuf */
+    int result;          /* one of the FILE_ constants */
+    size_t words;        /* words in the obj file */
+    int errors;          /* errors in the err file */
+    char reason[REASON_LEN];  /* why it failed, one line */
+} filestatus;
+
+/* the files of a batch, handed out to the threads one at a time */
+typedef struct batch_s
 {
-  struct ListNode* next;   /* pointer to next node */
-  char value[LINE_LEN];     /* value of entry */
-  int address;             /* integer address to location */
-} lnode;
-
-
-typedef struct TableNode
+    filestatus *files;          /* every input file */
+    int nfiles;                 /* number of files */
+    int next;                   /* next file to assemble */
+    pthread_mutex_t lock;       /* guards next */
+    const asm_options *opts;    /* options for every file */
+    int stream;                 /* stream every file */
+    const formatname *format;   /* format of every obj file */
+} batch;
+
+/* one lane of a batch, a thread with a context of its own */
+typedef struct batchwork_s
 {
-    struct TableNode* next; //pointer to next node in table
-    lnode*     head;        //pointer to first entry in entry list
-    int key;                //string value held by node
-    int entries;            //number of entries at this key
-} tnode;
-/*====================================================================*/
-
-tnode* addhashnode(tnode* head, int key, const char* val, int address);
-void deletetable(tnode* head);
-
-/* returns true if hash key and value are found, false otherwise */
-int checkHash(tnode* head, int key,const char* val, int *address);
-
-/* generate hash and return key*/
-int hashgen(char *s,  int T);
-
-
-
-/*************** functions *****************/
-
-/* takes in line, returns 0 or 1 if there
-   is a comment in the line or not */
-int commentExists(const char *line)
+    batch *work;        /* the batch */
+    asm_ctx *ctx;       /* context the lane assembles with */
+    pthread_t thread;   /* thread running the lane */
+} batchwork;
+
+/* this function takes in a buffer, the path of the asm file and an
+   extension. it writes the path with its extension swapped for the
+   new one into the buffer, or with the new one added if it has none.
+   returns -1 if the name does not fit in FILE_LEN */
+static int outname(char *out, const char *path, const char *ext)
 {
-    /* return value */
-    int ret = 0;
+    const char *dot = strrchr(path, '.');    /* start of the extension */
+    const char *slash = strrchr(path, '/');  /* start of the file name */
+    size_t len = strlen(path);               /* length of the stem */
 
-    /* check for # in line */
-    if (strchr(line, '#'))
+    if (dot != NULL && (slash == NULL || dot > slash + 1))
+    {
+        len = (size_t)(dot - path);
+    }
+    if (len + strlen(ext) + 1 > FILE_LEN)
     {
-        ret = 1;
+        snprintf(out, FILE_LEN, "%s", path);
+        return -1;
     }
 
-    return ret;
+    memcpy(out, path, len);
+    strcpy(out + len, ext);
+    return 0;
 }
 
-/* checks if a line is blank */
-int isBlank(const char *line)
+/* this function returns the output format called name, NULL if
+   there is none */
+static const formatname *findformat(const char *name)
 {
-    int i = 0; /* iterator */
+    size_t k;  /* format iterator */
 
-    while (i < strlen(line))
+    for (k = 0; k < FORMAT_COUNT; k++)
     {
-        /* check for symbol other than whitespace */
-        if (line[i] != ' ' && line[i] != '\n' && line[i] != '\t')
+        if (strcmp(formats[k].name, name) == 0)
         {
-            /* found a non whitespace symbol, return o */
-            return 0;
+            return &formats[k];
         }
-        /* increment iterator */
-        i++;
     }
-    /* found nothing but whitespace, return true */
-    return 1;
+    return NULL;
 }
 
-/* takes in a line, returns 1 if
- the first non-whitespace character is a comment */
-int isComment(const char *line)
+/* this function returns 1 if a result uses a symbol that another
+   object has to define, so only a relocatable object can hold it */
+static int hasexterns(const asm_result *res)
 {
+    size_t k;  /* symbol iterator */
 
-    int i = 0;    /* iterator */
-
-    /* loop through line, if we encounter something
-       other than a tab or whitespace before a #, the line
-       is not a comment, otherwise it is */
-    while(i < strlen(line))
+    for (k = 0; k < asm_result_symbol_count(res); k++)
     {
-        if (line[i] != '#')
-        {
-            if (line[i] != '\t' && line[i] != ' ')
-            {
-                /* first char was not a #, return false */
-                return 0;
-            }
-        }
-        else
+        if (asm_result_symbol_binding(res, k) == ASM_SYM_EXTERN)
         {
-            /* first char other than whitespace was a #, return true */
             return 1;
         }
-        i++;
     }
     return 0;
 }
 
-/*takes in a line, will strip out the comment behind it */
-void stripComment(char *line)
+/* this function takes in the status of a file, what went wrong and
+   the file it went wrong with. it marks the file failed, keeps the
+   reason for a client of the server and prints it */
+static void failfile(filestatus *st, const char *what, const char *name)
 {
-    int i;   /* iterator */
-
-    /* set iterator to last character  in line */
-    i = strlen(line)-1;
+    snprintf(st->reason, sizeof(st->reason), "%s: %s\n", what, name);
+    fputs(st->reason, stderr);
+    st->result = FILE_FAILED;
+}
 
-    while (i >= 0)
+/* this function takes in the status of a file, the context to
+   assemble with and the options. it assembles the file into an obj
+   file, or an err file when there are errors, and records how it
+   went in the status. output kept in memory belongs to the context
+   and is good until it assembles again */
+static void assemblefile(filestatus *st, asm_ctx *ctx, const asm_options *opts)
+{
+    asm_result *res;  /* what came out */
+    int rc;           /* result of the assemble call */
+    int fd = -1;      /* obj or err file */
+    int streamed;     /* obj file written while reading */
+
+    /* a streamed file goes straight into the obj file, which is opened
+       first and taken away again if there is nothing to put in it */
+    streamed = st->stream && st->source == NULL && !st->inmemory;
+    if (streamed)
     {
-        if (line[i] == '#')
+        if (outname(st->out, st->path, st->format->ext) != 0 ||
+            (fd = open(st->out, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0)
+        {
+            failfile(st, "Error opening obj file", st->out);
+            return;
+        }
+        rc = asm_stream_file(ctx, st->path, fd, st->format->format, opts, &res);
+        close(fd);
+        fd = -1;
+        if (rc != ASM_OK)
         {
-            line[i] = '\0';
+            unlink(st->out);
+        }
+        if (rc == ASM_EIO)
+        {
+            failfile(st, "Error writing obj file", st->out);
+            return;
         }
-        i--;
     }
-
-}
-
-/* takes in a char pointer, will trim the whitespace
-  characters from the front and end of the string ,
-  returning the new trimmed string */
-char *trimWhiteSpace(char *str)
-{
-    char *end;
-
-    /* trim leading space */
-    while(isspace(*str))
+    /* assemble the source given inline, or read the asm file */
+    else if (st->source != NULL)
+    {
+        rc = asm_assemble_buffer(ctx, st->source, st->sourcelen, opts, &res);
+    }
+    else
     {
-        str++;
+        rc = asm_assemble_file(ctx, st->path, opts, &res);
     }
-    if(*str == 0)
+    if (rc == ASM_ENOMEM)
     {
-        /* string was all spaces */
-        return str;
+        failfile(st, "Out of memory", st->path);
+        return;
     }
-
-    /* trim trailing space */
-    end = str + strlen(str) - 1;
-    while(end > str && isspace(*end))
+    if (rc != ASM_OK && rc != ASM_ERRORS)
     {
-        end--;
+        failfile(st, "Error opening asm file", st->path);
+        return;
     }
-    /* write new null terminator */
-    *(end+1) = 0;
-
-    /* return trimmed string */
-    return str;
-}
 
-/* takes in a string holding a register in format $NUM
-   and returns a string of 5 bit binary */
-char* regToBin(char *reg)
-{
-    int dec = 0;  /* decimal number */
-    char bin[REGBITS] = "00000";
-    char integer[OPCODE_LEN];
-    int i, j=0;
+    st->errors = (int)asm_result_diag_count(res);
+    st->words = asm_result_word_count(res);
 
-    /* strip otu the $ symbol */
-    for(i=0; i<=strlen(reg); i++)
+    if (rc == ASM_ERRORS)
     {
-        if (reg[i] != '$')
+        /* the extension of the input is swapped for .err */
+        st->result = FILE_ERRORS;
+        if (st->inmemory)
         {
-            integer[j] = reg[i];
-            j++;
+            st->outbuf = asm_result_err_text(res, &st->outlen);
+        }
+        else if (outname(st->out, st->path, ".err") == 0)
+        {
+            fd = open(st->out, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        }
+        if ((st->inmemory && st->outbuf == NULL) || (!st->inmemory &&
+            (fd < 0 || asm_result_write_err(res, fd) != 0)))
+        {
+            failfile(st, "Error opening error file", st->out);
         }
     }
-    if(reg[0] == '$' && integer[0]=='t'){
-        dec = atoi(integer+1);
-        dec = dec + 8;
-    }
-    else if(reg[0] == '$' && integer[0]=='s'){
-        dec = atoi(integer+1);
-        dec = dec + 16;
-    }else if(reg[0] == '$' && integer[0]=='0'){
-        dec = 0;
+    else if (hasexterns(res) && st->format->format != ASM_FORMAT_REL_LE &&
+             st->format->format != ASM_FORMAT_REL_BE)
+    {
+        /* only a relocatable object can leave symbols to another
+           one, a streamed obj file already written is taken away */
+        failfile(st, "External symbols need --format=rel", st->path);
+        if (streamed)
+        {
+            unlink(st->out);
+        }
     }
-    if(DEBUG) printf("... Reg %s: %d\n",reg,dec);
-    /* computer binary and fill the string */
-    i = strlen(bin)-1;
-    while (dec > 0)
+    else if (!streamed)
     {
-        bin[i] = (char)(((int)'0')+(dec % 2));
-        dec /= 2;
-        i--;
+        /* ok we got no errors so write the obj file */
+        if (st->inmemory)
+        {
+            st->outbuf = asm_result_format_data(res, st->format->format, &st->outlen);
+            if (st->outbuf == NULL)
+            {
+                failfile(st, "Error writing obj file", st->path);
+            }
+        }
+        else if (outname(st->out, st->path, st->format->ext) != 0 ||
+                 (fd = open(st->out, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+        {
+            failfile(st, "Error opening obj file", st->out);
+        }
+        else if (asm_result_write_format(res, fd, st->format->format) != 0)
+        {
+            failfile(st, "Error writing obj file", st->out);
+        }
     }
 
-    strcpy(reg, bin);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
 
-    /* return binary string */
-    return reg;
+    /* output kept in memory stays with the context until it
+       assembles again, files are done with the result */
+    if (!st->inmemory)
+    {
+        asm_result_free(res);
+    }
 }
 
-/* return a binary string for immediate number */
-char* immToBin(char *imm)
+/* this function runs one lane of a batch. it takes the next file
+   until there are none left, so every lane reuses one context no
+   matter how many files it assembles */
+static void *batchlane(void *arg)
 {
-    int dec = 0;  /* decimal number */
-    int negflag = 0;
-    char bin[IMMEDIATE_LEN] = "0000000000000000";
-    int i;
-    int carry = 0;
-
-    dec = atoi(imm);
+    batchwork *lane = arg;         /* the lane */
+    batch *work = lane->work;      /* the batch */
+    int next;                      /* file to assemble */
 
-    /* check if negative and set flag if so */
-    if (dec < 0)
+    for (;;)
     {
-        dec = -dec;
-        negflag = 1;
-    }
+        pthread_mutex_lock(&work->lock);
+        next = work->next++;
+        pthread_mutex_unlock(&work->lock);
+        if (next >= work->nfiles)
+        {
+            break;
+        }
 
-    /* computer binary and fill the string */
-    i = strlen(bin)-1;
-    while (dec > 0)
-    {
-        bin[i] = (char)(((int)'0')+(dec % 2));
-        dec /= 2;
-        i--;
+        assemblefile(&work->files[next], lane->ctx, work->opts);
     }
+    return NULL;
+}
+
+/* server requests and replies are a header line followed by a
+   payload of the length the header gives:
+
+     request  <kind> <format> <length>\n<payload>
+              kind   path    the payload is the path of an asm file
+                     source  the payload is the asm source itself
+              format obj, bin-le or bin-be, as --format takes
+
+     reply    <result> <length>\n<payload>
+              result ok      the payload is the obj file
+                     errors  the payload is the err file
+                     failed  the payload is a message
+
+   a connection can carry any number of requests, one after another.
+   the socket is only open to the user running the server */
+#define SERVE_BUF_LEN 4096     /* bytes read from a client at a time */
+#define SERVE_HEADER_LEN 128   /* longest header line */
+#define SERVE_BACKLOG 16       /* connections waiting to be accepted */
+#define SERVE_MAX_LEN (1UL << 30)  /* largest payload accepted */
+#define SERVE_MAX_CONNS 64     /* clients served at the same time */
+#define SERVE_IDLE_SECS 30     /* a client silent this long is dropped */
+#define SERVE_BACKOFF_MS 100   /* wait before accepting again when out of fds */
+
+/* what every connection of a server shares */
+typedef struct server_s
+{
+    asm_ctx *ctx;              /* context every request assembles with */
+    const asm_options *opts;   /* options for every request */
+    pthread_mutex_t lock;      /* one request uses the context at a time */
+    pthread_mutex_t countlock; /* guards nconns, never held for long */
+    int nconns;                /* connections being served */
+} server;
+
+/* a client connection with buffered input */
+typedef struct conn_s
+{
+    int fd;                    /* socket */
+    server *srv;               /* server it belongs to */
+    char buf[SERVE_BUF_LEN];   /* bytes read but not used yet */
+    size_t start;              /* first unused byte */
+    size_t end;                /* one past the last unused byte */
+} conn;
+
+/* this function takes in a connection and reads len bytes into dst,
+   using up buffered bytes first. returns -1 if the client went away */
+static int connread(conn *c, char *dst, size_t len)
+{
+    size_t have;  /* bytes taken from the buffer */
+    ssize_t n;    /* bytes read by one call */
+
+    have = c->end - c->start < len ? c->end - c->start : len;
+    memcpy(dst, c->buf + c->start, have);
+    c->start += have;
 
-    /* convert to two's complement if negative */
-    if (negflag)
+    /* the rest goes straight into dst */
+    while (have < len)
     {
-        /* negate the bits */
-        for (i = 0; i<strlen(bin); i++)
+        n = read(c->fd, dst + have, len - have);
+        if (n < 0 && errno == EINTR)
         {
-            if (bin[i] == '1')
-            {
-                bin[i] = '0';
-            }
-            else if (bin[i] == '0')
-            {
-                bin[i] = '1';
-            }
+            continue;
         }
-        /* add 1 */
-        i = strlen(bin)-1;
-        carry = 1;
-        while (i > 0)
+        if (n <= 0)
         {
-            if (carry == 1)
-            {
-                if (bin[i] == '0')
-                {
-                    bin[i] = '1';
-                    carry = 0;
-                }
-                else
-                {
-                    bin[i] = '0';
-                    carry = 1;
-                }
-            }
-            i--;
+            return -1;
         }
+        have += (size_t)n;
     }
-    strcpy(imm, bin);
-
-    /* return binary string */
-    return imm;
+    return 0;
 }
 
-/* return a binary string for immediate number */
-char* subImmToBin(char *imm, int end, int start)
+/* this function takes in a connection and reads one header line into
+   line, without its newline. returns -1 if the client went away or
+   the line does not fit */
+static int connline(conn *c, char *line, size_t cap)
 {
-    int dec = 0;  /* decimal number */
-    int negflag = 0;
-    char bin[INST_LEN] = "00000000000000000000000000000000";
-    int i;
-    int carry = 0;
-    dec = atoi(imm);
-
-    /* check if negative and set flag if so */
-    if (dec < 0)
-    {
-        dec = -dec;
-        negflag = 1;
-    }
-
-    /* computer binary and fill the string */
-    i = strlen(bin)-1;
-    while (dec > 0)
-    {
-        bin[i] = (char)(((int)'0')+(dec % 2));
-        dec /= 2;
-        i--;
-    }
+    size_t len = 0;  /* bytes of the line so far */
+    ssize_t n;       /* bytes read by one call */
 
-    /* convert to two's complement if negative */
-    if (negflag)
+    for (;;)
     {
-        /* negate the bits */
-        for (i = 0; i<strlen(bin); i++)
+        /* take what is buffered up to a newline */
+        while (c->start < c->end)
         {
-            if (bin[i] == '1')
+            if (c->buf[c->start] == '\n')
             {
-                bin[i] = '0';
+                c->start++;
+                line[len] = '\0';
+                return 0;
             }
-            else if (bin[i] == '0')
+            if (len + 1 >= cap)
             {
-                bin[i] = '1';
+                return -1;
             }
+            line[len++] = c->buf[c->start++];
         }
-        /* add 1 */
-        i = strlen(bin)-1;
-        carry = 1;
-        while (i > 0)
+
+        /* buffer is used up, refill it */
+        c->start = 0;
+        n = read(c->fd, c->buf, SERVE_BUF_LEN);
+        if (n < 0 && errno == EINTR)
         {
-            if (carry == 1)
-            {
-                if (bin[i] == '0')
-                {
-                    bin[i] = '1';
-                    carry = 0;
-                }
-                else
-                {
-                    bin[i] = '0';
-                    carry = 1;
-                }
-            }
-            i--;
+            n = 0;
         }
+        else if (n <= 0)
+        {
+            c->end = 0;
+            return -1;
+        }
+        c->end = (size_t)n;
     }
-    strcpy(imm, "00000000000000000000000000000000");
-    char nbin[IMMEDIATE_LEN] = "0000000000000000";
-    for (i=start;i<=end;i++){
-        int j=1;
-        nbin[IMMEDIATE_LEN-j]=bin[i];
-        j++;
-    }
-    strcpy(imm, nbin);
-    /* return binary string */
-    return imm;
 }
 
-/* takes in a string representing an integer and
-   will convert it to a 32 bit binary string */
-char* numTo32Bin(char *num)
+/* this function writes len bytes from buf to fd, retrying short
+   writes. returns 0 on success */
+static int writeall(int fd, const char *buf, size_t len)
 {
-    int dec = 0;  /* decimal number */
-    int negflag = 0;
-    char bin[INST_LEN] = "00000000000000000000000000000000";
-    int i;
-    int carry = 0;
+    ssize_t n;  /* bytes written by one call */
 
-    dec = atoi(num);
-
-    /* set flag if negative */
-    if (dec < 0)
+    while (len > 0)
     {
-        dec = -dec;
-        negflag = 1;
+        n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
     }
+    return 0;
+}
+
+/* this function sends a reply with a result and a payload, returns
+   -1 if the client went away */
+static int sendreply(int fd, const char *result, const char *data, size_t len)
+{
+    char header[SERVE_HEADER_LEN];  /* reply header */
+    int n;                          /* length of the header */
 
-    /* computer binary and fill the string */
-    i = strlen(bin)-1;
-    while (dec > 0)
+    n = snprintf(header, sizeof(header), "%s %lu\n", result, (unsigned long)len);
+    if (writeall(fd, header, (size_t)n) != 0 || writeall(fd, data, len) != 0)
     {
-        bin[i] = (char)(((int)'0')+(dec % 2));
-        dec /= 2;
-        i--;
+        return -1;
     }
+    return 0;
+}
 
-    /* convert to two's complement if negative */
-    if (negflag)
+/* this function serves the requests of one client until it hangs up,
+   stays silent for SERVE_IDLE_SECS or sends something that is not a
+   request. requests are read on the connection's own thread and only
+   take the context to assemble, the reply is copied out of it and sent
+   after it is let go, so a slow or idle client holds up nobody. the
+   buffers are kept for the whole connection and the context reuses its
+   memory for every request, so a long lived server does not grow */
+static void serveconn(conn *c)
+{
+    server *srv = c->srv;         /* the server */
+    char line[SERVE_HEADER_LEN];  /* request header */
+    char kind[16];                /* path or source */
+    char format[16];              /* output format */
+    unsigned long len;            /* payload length */
+    char *payload = NULL;         /* the payload, null terminated */
+    size_t cap = 0;               /* bytes allocated for payload */
+    char *reply = NULL;           /* copy of the obj or err file */
+    size_t replycap = 0;          /* bytes allocated for reply */
+    char *grown;                  /* reply after growing it */
+    const char *result;           /* result sent with the reply */
+    filestatus st;                /* how the request went */
+    int rc;                       /* result of sending the reply */
+
+    while (connline(c, line, sizeof(line)) == 0)
     {
-        /* negate the bits */
-        for (i = 0; i<strlen(bin); i++)
+        if (sscanf(line, "%15s %15s %lu", kind, format, &len) != 3 || len > SERVE_MAX_LEN ||
+            (strcmp(kind, "path") != 0 && strcmp(kind, "source") != 0))
         {
-            if (bin[i] == '1')
-            {
-                bin[i] = '0';
-            }
-            else if (bin[i] == '0')
+            sendreply(c->fd, "failed", "bad request\n", 12);
+            break;
+        }
+
+        if (len + 1 > cap)
+        {
+            free(payload);
+            cap = len + 1;
+            if ((payload = malloc(cap)) == NULL)
             {
-                bin[i] = '1';
+                sendreply(c->fd, "failed", "out of memory\n", 14);
+                cap = 0;
+                break;
             }
         }
-        /* add 1 */
-        i = strlen(bin)-1;
-        carry = 1;
-        while (i > 0)
+        if (connread(c, payload, len) != 0)
+        {
+            break;
+        }
+        payload[len] = '\0';
+
+        memset(&st, 0, sizeof(st));
+        st.format = findformat(format);
+        if (st.format == NULL)
+        {
+            rc = sendreply(c->fd, "failed", "unknown format\n", 15);
+        }
+        else
         {
-            if (carry == 1)
+            /* assemble into memory */
+            st.inmemory = 1;
+            if (kind[0] == 'p')
+            {
+                st.path = payload;
+            }
+            else
+            {
+                st.path = "<source>";
+                st.source = payload;
+                st.sourcelen = len;
+            }
+            pthread_mutex_lock(&srv->lock);
+            assemblefile(&st, srv->ctx, srv->opts);
+            result = st.result == FILE_OK ? "ok" : st.result == FILE_ERRORS ? "errors" : NULL;
+            if (result != NULL && st.outlen > replycap)
             {
-                if (bin[i] == '0')
+                if ((grown = realloc(reply, st.outlen)) == NULL)
                 {
-                    bin[i] = '1';
-                    carry = 0;
+                    result = NULL;
+                    strcpy(st.reason, "out of memory\n");
                 }
                 else
                 {
-                    bin[i] = '0';
-                    carry = 1;
+                    reply = grown;
+                    replycap = st.outlen;
                 }
             }
-            i--;
-        }
-    }
-    strcpy(num, bin);
+            if (result != NULL && st.outlen > 0)
+            {
+                memcpy(reply, st.outbuf, st.outlen);
+            }
+            pthread_mutex_unlock(&srv->lock);
 
-    /* return 32 bit binary string */
-    return num;
-}
+            if (result != NULL)
+            {
+                rc = sendreply(c->fd, result, reply, st.outlen);
+            }
+            else
+            {
+                /* the client gets the line the server printed */
+                rc = sendreply(c->fd, "failed", st.reason, strlen(st.reason));
+            }
+        }
 
-/* i had to write this function because ITSUNIX doesn't support
-   it. takes in a string and a limiting size, returns the strlen
-   of the string if its less than or equal to the limit, otherwise
-   it returns the limit */
-size_t strnlen(const char *s, size_t n)
-{
-    if (strlen(s) <= n)
-    {
-        return strlen(s);
-    }
-    else
-    {
-        return n;
+        if (rc != 0)
+        {
+            break;
+        }
     }
+    free(payload);
+    free(reply);
 }
 
-/* another function that ITSUNIX doesnt support. this function
-   allocates a new string from a subset of an existing one,
-   is used to facilitate the strsub below */
-char* strndup (char const *s, size_t n)
+/* this function runs the thread of one connection and lets go of the
+   connection once the client is done */
+static void *connthread(void *arg)
 {
-    size_t len = strnlen (s, n);
-    char *new = malloc (len + 1);
+    conn *c = arg;          /* the connection */
+    server *srv = c->srv;   /* its server */
 
-    if (new == NULL)
-        return NULL;
+    serveconn(c);
+    close(c->fd);
+    free(c);
 
-    new[len] = '\0';
-    return memcpy (new, s, len);
+    pthread_mutex_lock(&srv->countlock);
+    srv->nconns--;
+    pthread_mutex_unlock(&srv->countlock);
+    return NULL;
 }
 
-/* this function allows for taking a subset of a string,
-   which is useful for the binary to hex conversions. it takes
-   in a string, a start position and length to copy, and
-   will copy a new string in that range and return the char
-   pointer to it */
-char* substring(const char* str, size_t begin, size_t len)
+/* this function returns 1 if the client at the other end of fd runs
+   as the same user as the server, or as root. a path request opens
+   the file as the server, so it may only come from a client that
+   could read the file itself */
+static int trustedpeer(int fd)
 {
-    /* check for problems with string size and position variables */
-    if (str == 0 || strlen(str) == 0 || strlen(str) < begin || strlen(str) < (begin+len))
-        return 0;
+    struct ucred cred;                  /* credentials of the client */
+    socklen_t len = sizeof(cred);       /* their size */
 
-    /* return pointer to new string */
-    return strndup(str + begin, len);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+    {
+        return 0;
+    }
+    return cred.uid == geteuid() || cred.uid == 0;
 }
 
-/* this function will take in a binary number and convert it to
-   hexidecimal string of 32 bits */
-char* binToHex32(char *bin)
+/* this function takes in the path of a unix socket, a context and
+   the options and serves clients on the socket for as long as the
+   process runs. the socket is created readable and writable by the
+   user only, and every client gets a thread of its own, up to
+   SERVE_MAX_CONNS at a time. the pool, the memory and the tables of
+   the context stay warm between requests. returns only if the socket
+   cannot be set up */
+static int serve(const char *path, asm_ctx *ctx, const asm_options *opts)
 {
-    int i=0; /* iterator */
-    char hex[INST_LEN];  /* hex string holder */
-    char *sub;           /* string ptr for use with strsub */
-
-    /* clear out hex string */
-    strcpy(hex, "");
-
-    /* loop through whole binary string, 32 bits */
-    while (i < LABEL_LEN)
+    struct sockaddr_un addr;  /* socket address */
+    struct timeval idle;      /* read timeout of a connection */
+    struct timespec backoff;  /* pause when no fd is left to accept */
+    server srv;               /* what the connections share */
+    pthread_attr_t attr;      /* connection threads are detached */
+    pthread_t thread;         /* thread of a connection */
+    mode_t mask;              /* umask before the socket was made */
+    int fd;                   /* listening socket */
+    int cfd;                  /* accepted connection */
+    int busy;                 /* too many connections already */
+    conn *c;                  /* connection being handed out */
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* a socket left behind by an earlier server is replaced. it is
+       bound under a umask that leaves it to the user, so it is never
+       open to others, not even until a chmod */
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    mask = umask(0077);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        umask(mask);
+        fprintf(stderr, "Error opening socket: %s\n", path);
+        return -1;
+    }
+    umask(mask);
+    if (chmod(path, S_IRUSR | S_IWUSR) != 0 || listen(fd, SERVE_BACKLOG) != 0)
     {
-        /* grab 4 digits of the binary */
-        sub = substring(bin, i, 4);
+        fprintf(stderr, "Error opening socket: %s\n", path);
+        return -1;
+    }
 
-        /* compare to dif binary strings and concatenate the correct hex
-          digit to the hex string */
-        if (strcmp(sub, "0000")==0)
-        {
-            strcat(hex, "0");
-        }
-        else if (strcmp(sub, "0001")==0)
-        {
-            strcat(hex, "1");
-        }
-        else if (strcmp(sub, "0010")==0)
-        {
-            strcat(hex, "2");
-        }
-        else if (strcmp(sub, "0011")==0)
-        {
-            strcat(hex, "3");
-        }
-        else if (strcmp(sub, "0100")==0)
-        {
-            strcat(hex, "4");
-        }
-        else if (strcmp(sub, "0101")==0)
+    /* a client that hangs up early must not take the server down */
+    signal(SIGPIPE, SIG_IGN);
+
+    srv.ctx = ctx;
+    srv.opts = opts;
+    srv.nconns = 0;
+    pthread_mutex_init(&srv.lock, NULL);
+    pthread_mutex_init(&srv.countlock, NULL);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    idle.tv_sec = SERVE_IDLE_SECS;
+    idle.tv_usec = 0;
+    backoff.tv_sec = 0;
+    backoff.tv_nsec = SERVE_BACKOFF_MS * 1000000L;
+
+    for (;;)
+    {
+        cfd = accept(fd, NULL, NULL);
+        if (cfd < 0)
         {
-            strcat(hex, "5");
+            /* the connection stays queued while the process or the
+               system is out of descriptors, so wait for connections
+               to end instead of spinning on it */
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+            {
+                nanosleep(&backoff, NULL);
+            }
+            continue;
         }
-        else if (strcmp(sub, "0110")==0)
+
+        /* other users are turned away even if they got past the
+           permissions of the socket */
+        if (!trustedpeer(cfd))
         {
-            strcat(hex, "6");
+            sendreply(cfd, "failed", "permission denied\n", 18);
+            close(cfd);
+            continue;
         }
-        else if (strcmp(sub, "0111")==0)
+
+        /* not the context lock, a long request must not hold up
+           accepting the next client */
+        pthread_mutex_lock(&srv.countlock);
+        busy = srv.nconns >= SERVE_MAX_CONNS;
+        if (!busy)
         {
-            strcat(hex, "7");
+            srv.nconns++;
         }
-        else if (strcmp(sub, "1000")==0)
+        pthread_mutex_unlock(&srv.countlock);
+        if (busy)
         {
-            strcat(hex, "8");
+            sendreply(cfd, "failed", "server busy\n", 12);
+            close(cfd);
+            continue;
         }
-        else if (strcmp(sub, "1001")==0)
+
+        /* a client that goes quiet is dropped, reads fail after the
+           timeout and the connection ends */
+        setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+        if ((c = malloc(sizeof(conn))) == NULL)
         {
-            strcat(hex, "9");
+            close(cfd);
+            pthread_mutex_lock(&srv.countlock);
+            srv.nconns--;
+            pthread_mutex_unlock(&srv.countlock);
+            continue;
         }
-        else if (strcmp(sub, "1010")==0)
-        {
-            strcat(hex, "A");
+        c->fd = cfd;
+        c->srv = &srv;
+        c->start = 0;
+        c->end = 0;
+        if (pthread_create(&thread, &attr, connthread, c) != 0)
+        {
+            close(cfd);
+            free(c);
+            pthread_mutex_lock(&srv.countlock);
+            srv.nconns--;
+            pthread_mutex_unlock(&srv.countlock);
         }
-        else if (strcmp(sub, "1011")==0)
+    }
+}
+
+/* this function adds a file to the batch, growing the list as
+   needed. returns -1 if it is out of memory */
+static int addfile(batch *work, int *cap, const char *path)
+{
+    filestatus *files;  /* grown list */
+
+    if (work->nfiles == *cap)
+    {
+        files = realloc(work->files, (size_t)*cap * 2 * sizeof(filestatus));
+        if (files == NULL)
         {
-            strcat(hex, "B");
+            return -1;
         }
-        else if (strcmp(sub, "1100")==0)
+        work->files = files;
+        *cap *= 2;
+    }
+    memset(&work->files[work->nfiles], 0, sizeof(filestatus));
+    work->files[work->nfiles].stream = work->stream;
+    work->files[work->nfiles].format = work->format;
+    work->files[work->nfiles++].path = path;
+    return 0;
+}
+
+/* this function takes in the path of a list file and adds every
+   line of it to the batch as an input file, blank lines are skipped.
+   returns -1 if the list cannot be read */
+static int readlist(const char *path, batch *work, int *cap)
+{
+    FILE *list;         /* the list file */
+    char *line = NULL;  /* line of the list */
+    size_t linecap = 0; /* bytes allocated for line */
+    ssize_t len;        /* length of the line */
+    char *start;        /* first character that is not blank */
+    char *name;         /* copy of the name kept in the batch */
+
+    if ((list = fopen(path, "r")) == NULL)
+    {
+        return -1;
+    }
+
+    while ((len = getline(&line, &linecap, list)) >= 0)
+    {
+        /* trim the line ending and surrounding blanks */
+        while (len > 0 && isspace((unsigned char)line[len-1]))
         {
-            strcat(hex, "C");
+            line[--len] = '\0';
         }
-        else if (strcmp(sub, "1101")==0)
+        for (start = line; isspace((unsigned char)*start); start++)
         {
-            strcat(hex, "D");
         }
-        else if (strcmp(sub, "1110")==0)
+        if (*start == '\0')
         {
-            strcat(hex, "E");
+            continue;
         }
-        else if (strcmp(sub, "1111")==0)
+
+        if ((name = strdup(start)) == NULL || addfile(work, cap, name) != 0)
         {
-            strcat(hex, "F");
+            fprintf(stderr, "Out of memory.\n");
+            exit(1);
         }
-
-        /* free memory used by strsub */
-        free(sub);
-
-        /* increment iterator to next block of binary digits */
-        i += 4;
+        work->files[work->nfiles-1].listed = name;
     }
 
-    /* copy hex string to return ptr */
-    strcpy(bin, hex);
-
-    /* return new string */
-    return bin;
-
+    free(line);
+    fclose(list);
+    return 0;
 }
 
-/* this function is used to take an integer address
-   and convert it into a 16 bit hex string */
-char* addrToHex(int address, char *ret)
-{
-    char bin[IMMEDIATE_LEN] = "0000000000000000";
-    int i;
-    char hex[IMMEDIATE_LEN];
-    char *sub;
-    int dec = address;
-
-    /* computer binary and fill the string */
-    i = strlen(bin)-1;
-    while (dec > 0)
-    {
-        bin[i] = (char)(((int)'0')+(dec % 2));
-        dec /= 2;
-        i--;
-    }
-
-    strcpy(hex, "");
-    i = 0;
-
-    /* loop through blocks of 4 binary digits and
-       concatenate the correct hex symbol to the hex string */
-    while (i < IMMEDIATE_LEN-1)
-    {
-        /* grab next block */
-        sub = substring(bin, i, 4);
-        if (strcmp(sub, "0000")==0)
-        {
-            strcat(hex, "0");
-        }
-        else if (strcmp(sub, "0001")==0)
-        {
-            strcat(hex, "1");
-        }
-        else if (strcmp(sub, "0010")==0)
-        {
-            strcat(hex, "2");
-        }
-        else if (strcmp(sub, "0011")==0)
-        {
-            strcat(hex, "3");
-        }
-        else if (strcmp(sub, "0100")==0)
-        {
-            strcat(hex, "4");
-        }
-        else if (strcmp(sub, "0101")==0)
-        {
-            strcat(hex, "5");
-        }
-        else if (strcmp(sub, "0110")==0)
-        {
-            strcat(hex, "6");
-        }
-        else if (strcmp(sub, "0111")==0)
-        {
-            strcat(hex, "7");
-        }
-        else if (strcmp(sub, "1000")==0)
-        {
-            strcat(hex, "8");
-        }
-        else if (strcmp(sub, "1001")==0)
-        {
-            strcat(hex, "9");
-        }
-        else if (strcmp(sub, "1010")==0)
-        {
-            strcat(hex, "A");
-        }
-        else if (strcmp(sub, "1011")==0)
-        {
-            strcat(hex, "B");
-        }
-        else if (strcmp(sub, "1100")==0)
-        {
-            strcat(hex, "C");
-        }
-        else if (strcmp(sub, "1101")==0)
-        {
-            strcat(hex, "D");
-        }
-        else if (strcmp(sub, "1110")==0)
-        {
-            strcat(hex, "E");
-        }
-        else if (strcmp(sub, "1111")==0)
-        {
-            strcat(hex, "F");
-        }
-
-        /* free memory used by strsub */
-        free(sub);
-
-        /* jump to next block of 4 binary digits */
-        i += 4;
-    }
-
-    /* copy hex string to return ptr */
-    strcpy(ret, hex);
-
-    /* return new string */
-    return ret;
-}
 /***** argument constants *****/
 #define ARGS_NEEDED 2
 #define ARG1 1
-#define ARG2 2
-#define DEBUG 1
 
 /* main method */
 int main(int argc, char **argv)
 {
     /************* Variables **********************/
-    char file[FILE_LEN];     /* string for file name */
-    char errfile[FILE_LEN];  /* string for error file name */
-    FILE* fp = NULL;         /* file pointer for asm file */
-    FILE* errfp = NULL;      /* file pointer to error file */
-    char line[LINE_LEN];     /* line to be read in from asm file */
-
-    char label[LABEL_LEN];       /* used to hold label */
-    char* temp;                  /* used for splitting strings */
-    char opname[OPCODE_LEN];     /* holds opcode name */
-    char instargs[LINE_LEN];     /* holds instruction arguments */
-    char directive[LABEL_LEN];   /* holds data directive */
-    char immarg[IMMEDIATE_LEN];  /* holds immediate argument */
-    char regarg[OPCODE_LEN];     /* holds register argument */
-    /* used for splitting instruction args into sep args */
-    char arg1[LINE_LEN];
-    char arg2[LINE_LEN];
-    char arg3[LINE_LEN];
-
-
-    /* file read flags */
-    int found_text = 0;     /* has .text been encountered */
-    int found_data = 0;     /* has .data been found yet */
-    int was_error = 0;      /* was the opcode an error? */
-
-    int counter = 0;        /* line counter */
-    int address = 0;        /* address counter */
-    int addr = 0;           /* address holder */
-    int i;                  /* iterator */
-
-
-    /* list stuff */
-    instlist *instructions;  /* instruction list */
-    instnode *tempinst;      /* holder pointer   */
-
-    errlist *errors;         /* error list */
-    errnode *temperr;        /* temporary error node pointer */
-
-    datalist *data;          /* data list */
-    datanode *tempdata;      /* temporary data node */
-
-    int tSize  = HASH_SIZE; /* size of table, read from first line of input */
-    int genkey = 0;         /* key generated by hash function  */
-
-    tnode* hash_head = NULL;    /* head node of the hash table */
+    char* temp;              /* used for splitting strings */
+    int threads = 0;         /* threads to use, 0 picks one per cpu */
+    int i;                   /* iterator */
+    int cap = 16;            /* allocated file statuses */
+    int lanes;               /* files assembled at once */
+    int listed = 0;          /* was a list file given */
+    int counts[3] = {0};     /* files per result */
+    const char *servepath = NULL;  /* socket to serve on */
+    int stream = 0;          /* stream the files */
+    const formatname *format = &formats[0];  /* format of the obj files */
+    batch work;              /* every input file */
+    batchwork *lane;         /* lanes of the batch */
+    asm_ctx *ctx;            /* context for a single file or the server */
+    asm_options opts;        /* options for every file */
 
 
     /************* BEGIN main executables *********/
 
-    /* check if we have correct arguments */
-    if (argc != ARGS_NEEDED)
-    {
-        fprintf(stderr, "Invalid arguments provided.\n");
-        exit(1);
-    }
+    asm_options_init(&opts);
 
-    /* copy argument to file name */
-    strcpy(file, argv[ARG1]);
-
-
-    /****** begin to process asm file ******/
-
-    /* attempt to open asm file */
-    if ((fp = fopen(file, "r")) == NULL)
+    /* pull the flags out of the arguments. each v of -v raises the
+       trace level by one, -j sets the number of threads, --cache-dir
+       names the cache, --stream streams the files, --format picks
+       the obj file format and --serve runs a server instead of
+       assembling files */
+    for (i = ARG1; i < argc && argv[i][0] == '-'; i++)
     {
-        fprintf(stderr, "Error opening asm file: %s\n", file);
-        exit(1);
-    }
-
-
-    /* OK we will attempt to do this, allocate list stuff
-       then start reading file */
-
-    /* allocate instructions list */
-    instructions = malloc(sizeof(instlist));
-
-    /* initialize instructions variables */
-    instructions->head  = NULL;
-    instructions->cur   = NULL;
-    instructions->count = 0;
-
-    /* allocate errors list */
-    errors = malloc(sizeof(errlist));
-
-    /* initialize instructions variables */
-    errors->head  = NULL;
-    errors->cur   = NULL;
-    errors->count = 0;
-
-    /* allocate data list */
-    data = malloc(sizeof(datalist));
-
-    /* initialize instructions variables */
-    data->head  = NULL;
-    data->cur   = NULL;
-    data->count = 0;
-
-
-    /* Loop through query file, executing commands */
-    while (fgets(line, LINE_LEN, fp))
-    {
-        /* increment line counter */
-        counter++;
-
-        /* check to see if we're in text section yet */
-        if (found_text==0)
-        {
-            if (strstr(line,".text"))
-            {
-                found_text = 1;
-            }
-            else
-            {
-                /* nothing, disregard line until .text has been found */
-                continue;
-            }
-        }
-        else if (found_data == 0)
+        if (argv[i][1] == 'v')
         {
-            /* check for data section */
-            if (strstr(line,".data"))
+            for (temp = argv[i] + 1; *temp == 'v'; temp++)
             {
-                /* we've hit the data section, skip out of this branch */
-                found_data = 1;
-                continue;
-            }
-
-            /* text has been found, but not yet to data, attempt to read instruction */
-
-            /* check for blank line */
-            if (isBlank(line))
-            {
-                /* do nothing, line is blank */
-                continue;
-            }
-
-            /* check for comment */
-            if (commentExists(line))
-            {
-                if (isComment(line))
-                {
-                    /* do nothing, line is a comment */
-                    continue;
-                }
-                else
-                {
-                    /* ok, there is an inline comment after the instruction, strip it out */
-                    stripComment(line);
-                }
+                opts.trace++;
             }
-
-            /* trim any whitespace characters off the end of the line
-               if they exist */
-            strcpy(line, trimWhiteSpace(line));
-
-            /* OK we now have our raw instruction text */
-
-            /* clear out our strings */
-            strcpy(label,"");
-            strcpy(opname,"");
-            strcpy(instargs,"");
-
-
-            /* check to see if we have a label, if so, split up the instruction */
-            if (strchr(line,':'))
-            {
-                /* line has a label, need to insert into symbols table */
-                temp = strtok(line," \t");
-                strcpy(label, temp);
-
-                strcpy(line, "");
-                strcat(line, strtok(NULL, " \t"));
-                temp = strtok(NULL, " \t");
-                if (temp != NULL)
-                {
-                    strcat(line, " ");
-                    strcat(line, temp);
-                }
-
-                /* strip colon */
-                if (label[strlen(label)-1] == ':')
-                {
-                    label[strlen(label)-1] = '\0';
-                }
-
-                /* label is now set, and the remaining text in temp is the instruction */
-
-                /* add label to symbols table */
-                genkey = hashgen(label, tSize);
-
-                /* check if symbol already exists, if so, generate error */
-                if (checkHash(hash_head, genkey, label, &addr))
-                {
-                    /* allocate error node and fill details */
-                    temperr = malloc(sizeof(errnode));
-                    temperr->errtype = ERR_MULTSYMBOL;
-                    temperr->lineno = counter;
-                    strcpy(temperr->symbol, label);
-                    add_err(errors, temperr);
-                }
-                else
-                {
-                    /* symbol isnt defined yet, add to hash table */
-                    hash_head = addhashnode(hash_head, genkey, label, instructions->count);
-                }
-            }
-            if(DEBUG) printf("Line %s\n",line);
-            /* split line */
-            temp = strtok(line, " \t");
-            /* copy out opname */
-            strcpy(opname, temp);
-            temp = strtok(NULL, " \t");
-            if (temp != NULL)
-            {
-                strcpy(instargs, temp);
-                if(DEBUG) printf("... args %s\n",temp);
-            }
-
-            /* clear out args */
-            strcpy(arg1, "");
-            strcpy(arg2, "");
-            strcpy(arg3, "");
-
-            /* attempt to split args */
-            temp = strtok(instargs, ",");
-            if (temp != NULL)
-            {
-                if(DEBUG) printf("... arg1 %s\n",temp);
-                strcpy(arg1, temp);
-            }
-            temp = strtok(NULL, ",");
-            if (temp != NULL)
-            {
-                if(DEBUG) printf("... arg2 %s\n",temp);
-                strcpy(arg2, temp);
-            }
-            temp = strtok(NULL, ",");
-            if (temp != NULL)
-            {
-                if(DEBUG) printf("... arg3 %s\n",temp);
-                strcpy(arg3, temp);
-            }
-
-
-            /* allocate new instruction node and copy over the
-                variables we know will be used for all instructions */
-            tempinst = malloc(sizeof(instnode));
-            tempinst->address = address;
-            tempinst->lineno = counter;
-            strcpy(tempinst->opcode_name, opname);
-            strcpy(tempinst->label, label);
-
-            /* zero out the dif fields of the instruction */
-            strcpy(tempinst->rs1, "00000");
-            strcpy(tempinst->rs2, "00000");
-            strcpy(tempinst->rt,  "00000");
-            strcpy(tempinst->sa,  "00000");
-            strcpy(tempinst->imm, "0000000000000000");
-            strcpy(tempinst->bin_inst,"");
-
-            /* set error flag to 0 */
-            was_error = 0;
-
-            /* ok, label was handled if there was one, ready to insert instruction.
-               we must go through all the dif opcode types, setting its variables
-               appropriately  */
-            if (strcmp(opname,"add")==0)
-            {
-                tempinst->inst_type = RTYPE;
-                strcpy(tempinst->opcode_bin, "100000" );
-                strcpy(tempinst->rt, regToBin(arg1));
-                strcpy(tempinst->rs1, regToBin(arg2));
-                strcpy(tempinst->rs2, regToBin(arg3));
-            }
-            else if (strcmp(opname,"addi")==0)
-            {
-                tempinst->inst_type = ITYPE;
-                strcpy(tempinst->opcode_bin, "001000" );
-                strcpy(tempinst->rt, regToBin(arg1));
-                strcpy(tempinst->rs1, regToBin(arg2));
-                strcpy(tempinst->imm, immToBin(arg3));
-                printf("Addi %s %s %s %s",tempinst->opcode_bin, tempinst->rt, tempinst->rs1, tempinst->imm);
-
-            }
-            else if (strcmp(opname,"nor")==0)
-            {
-                tempinst->inst_type = RTYPE;
-                strcpy(tempinst->opcode_bin, "100111" );
-                strcpy(tempinst->rt, regToBin(arg1));
-                strcpy(tempinst->rs1, regToBin(arg2));
-                strcpy(tempinst->rs2, regToBin(arg3));
-            }
-            else if (strcmp(opname,"ori")==0)
-            {
-                tempinst->inst_type = RTYPE;
-                strcpy(tempinst->opcode_bin, "001101" );
-                strcpy(tempinst->rt, regToBin(arg1));
-                strcpy(tempinst->rs1, regToBin(arg2));
-                strcpy(tempinst->imm, immToBin(arg3));
-            }
-            else if (strcmp(opname,"sll")==0)
-            {
-                tempinst->inst_type = RTYPE;
-                strcpy(tempinst->opcode_bin, "000000" );
-                strcpy(tempinst->rt, regToBin(arg1));
-                strcpy(tempinst->rs1, regToBin(arg2));
-                strcpy(tempinst->sa, regToBin(arg3));
-            }
-            else if (strcmp(opname,"lui")==0)
-            {
-                tempinst->inst_type = ITYPE;
-                strcpy(tempinst->opcode_bin, "001111" );
-                strcpy(tempinst->rt, regToBin(arg1));
-                strcpy(tempinst->imm, immToBin(arg2));
-            }
-            else if (strcmp(opname,"sw")==0)
-            {
-                tempinst->inst_type = ITYPE;
-                strcpy(tempinst->opcode_bin, "101011" );
-                strcpy(tempinst->rt, regToBin(arg1));
-
-                /* need to do some parsing for the base + register stuff */
-                temp = strtok(arg2,"(");
-                strcpy(immarg, temp);
-                temp = strtok(NULL, "()");
-                strcpy(regarg,temp);
-
-                strcpy(tempinst->imm, immToBin(immarg));
-                strcpy(tempinst->rs1, regToBin(regarg));
-            }
-            else if (strcmp(opname,"lw")==0)
-            {
-                tempinst->inst_type = ITYPE;
-                strcpy(tempinst->opcode_bin, "100011" );
-                strcpy(tempinst->rt, regToBin(arg1));
-
-                /* need to do some parsing for the base + register stuff */
-                temp = strtok(arg2,"(");
-                strcpy(immarg, temp);
-                temp = strtok(NULL, "()");
-                strcpy(regarg,temp);
-
-                strcpy(tempinst->imm, immToBin(immarg));
-                strcpy(tempinst->rs1, regToBin(regarg));
-            }
-            else if (strcmp(opname,"bne")==0)
-            {
-                tempinst->inst_type = ITYPE;
-                strcpy(tempinst->opcode_bin, "000110" );
-                strcpy(tempinst->rt, regToBin(arg1));
-                strcpy(tempinst->rs1, regToBin(arg2));
-                strcpy(tempinst->symbol, arg3);
-            }
-            else if (strcmp(opname,"j")==0)
-            {
-                tempinst->inst_type = JTYPE;
-                strcpy(tempinst->opcode_bin, "000010" );
-                strcpy(tempinst->symbol, arg1);
-            }
-            
-            else if (strcmp(opname,"la")==0)
-            {
-                //lui
-                char linen[LINE_LEN];
-                fgets(linen, LINE_LEN, fp);
-                /* used for splitting instruction args into sep args */
-                char argi[LINE_LEN];
-                /* clear out argi */
-                strcpy(argi, "");
-                if(DEBUG) printf("Line la %s\n",linen);
-                /* split line */
-                temp = strtok(linen, " \t");
-                temp = strtok(NULL, " \t");
-                temp = strtok(NULL, " \t");
-                if (temp != NULL)
-                {
-                    strcpy(argi, temp);
-                    if(DEBUG) printf("... argi %s\n",temp);
-                }
-                tempinst->inst_type = ITYPE;
-                strcpy(tempinst->opcode_bin, "001111" );
-                strcpy(tempinst->rt, regToBin(arg1));
-                strcpy(tempinst->imm, subImmToBin(argi,31,16));
-
-                add_node(instructions, tempinst);
-                address++;
-
-                tempinst = malloc(sizeof(instnode));
-                tempinst->address = address;
-                tempinst->lineno = counter;
-                strcpy(tempinst->opcode_name, opname);
-                strcpy(tempinst->label, label);
-                
-                strcpy(tempinst->rs1, "00000");
-                strcpy(tempinst->rs2, "00000");
-                strcpy(tempinst->rt,  "00000");
-                strcpy(tempinst->sa,  "00000");
-                strcpy(tempinst->imm, "0000000000000000");
-                strcpy(tempinst->bin_inst,"");
-                //ori
-                tempinst->inst_type = RTYPE;
-                strcpy(tempinst->opcode_bin, "001101" );
-                strcpy(tempinst->rt, regToBin(arg1));
-                strcpy(tempinst->rs1, regToBin(arg1));
-                strcpy(tempinst->imm, subImmToBin(argi,15,0));
-
-            }
-            else
-            {
-                /* bad opcode given, throw error */
-                temperr = malloc(sizeof(errnode));
-                temperr->errtype = ERR_OPCODE;
-                temperr->lineno = counter;
-                strcpy(temperr->opcode, opname);
-
-                add_err(errors,temperr);
-
-                /* set was_error flag to true */
-                was_error = 1;
-
-            }
-            if (was_error == 0)
-            {
-                /* there was no error so add the node to the instruction list */
-                add_node(instructions, tempinst);
-
-                /* increment address */
-                address++;
-            }
-        }
-        else
-        {
-            /* we're now in the data section, look for a directive */
-
-            /* check for blank line */
-            if (isBlank(line))
-            {
-                /* do nothing, line is blank */
-                continue;
-            }
-
-            /* check for comment */
-            if (commentExists(line))
-            {
-                if (isComment(line))
-                {
-                    /* do nothing, line is a comment */
-                    continue;
-                }
-                else
-                {
-                    /* ok, there is an inline comment after the instruction, strip it out */
-                    stripComment(line);
-                }
-            }
-
-            /* clear out string variables */
-            strcpy(label, "");
-            strcpy(instargs, "");
-            strcpy(arg1, "");
-            strcpy(arg2, "");
-            strcpy(directive, "");
-
-
-            /* trim any whitespace characters off the end of the line
-               if they exist */
-            strcpy(line, trimWhiteSpace(line));
-
-            /* OK so at this point we should have a label, directive, arguments line */
-            temp = strtok(line," ");
-            strcpy(label, temp);
-
-            /* split into directive and args */
-            temp = strtok(NULL," ");
-            if (temp != NULL)
-            strcpy(directive, temp);
-
-            temp = strtok(NULL, "");
-            if (temp != NULL)
-            {
-                strcpy(instargs,temp);
-            }
-            /* strip off the colon */
-            if (label[strlen(label)-1] == ':')
-            {
-                label[strlen(label)-1] = '\0';
-            }
-
-            /* add label to symbols table */
-            genkey = hashgen(label, tSize);
-            /* check if symbol already exists, if so, generate error */
-            if (checkHash(hash_head, genkey, label, &addr))
-            {
-                /* allocate error node and fill details */
-                temperr = malloc(sizeof(errnode));
-                temperr->errtype = ERR_MULTSYMBOL;
-                temperr->lineno = counter;
-                strcpy(temperr->symbol, label);
-                add_err(errors, temperr);
-            }
-            else
-            {
-                /* symbol isnt defined yet, add to hash table */
-                hash_head = addhashnode(hash_head, genkey, label, address);
-            }
-
-            /* check for .word directive */
-            if (strcmp(directive, ".word")==0)
+            if (*temp != '\0')
             {
-                /* split args at the colon */
-                temp = strtok(instargs, ":");
-                strcpy(arg1, temp);
-                temp = strtok(NULL, ":");
-                strcpy(arg2, temp);
-
-                /* loop through and add data field for X amount of entries */
-                for (i=0; i<atoi(arg2); i++)
-                {
-                    /* copy over arg for formatting */
-                    strcpy(arg3, arg1);
-
-                    /* allocate new data node and fill details */
-                    tempdata = malloc(sizeof(datanode));
-                    tempdata->address = address;
-                    tempdata->lineno  = counter;
-                    strcpy(tempdata->label, label);
-                    strcpy(tempdata->binval, numTo32Bin(arg3));
-                    strcpy(arg3,tempdata->binval);
-                    strcpy(tempdata->hex_val, binToHex32(arg3));
-
-                    /* add new data node to data list */
-                    add_datanode(data, tempdata);
-
-                    /* increment address counter */
-                    address++;
-                }
+                break;
             }
-            /* check for .resw directive */
-            else if (strcmp(directive, ".resw")==0)
-            {
-                /* copy 0 to arg because resw statements zero out the data field */
-                strcpy(arg1,"0");
-
-                /* loop through and create field for X amount */
-                for (i=0; i<atoi(instargs); i++)
-                {
-                    /* copy arg for formatting */
-                    strcpy(arg3, arg1);
-
-                    /* allocate new data node and fill details */
-                    tempdata = malloc(sizeof(datanode));
-                    tempdata->address = address;
-                    tempdata->lineno  = counter;
-                    strcpy(tempdata->label, label);
-                    strcpy(tempdata->binval, numTo32Bin(arg3));
-                    strcpy(arg3,tempdata->binval);
-                    strcpy(tempdata->hex_val, binToHex32(arg3));
-
-                    /* add new data node to data list */
-                    add_datanode(data, tempdata);
-
-                    /* increment address counter */
-                    address++;
-                }
-            } /* end if .resw */
-        } /* end: else data section */
-    } /* end while fgets */
-
-    /* close file */
-    fclose(fp);
-
-    /* alright file has been processed at this point.
-       instructions and data directives are in their respective lists.
-       we must now go through both and assemble them into binary and
-       then into hex. symbols must be evaluated through the hash table
-       and errors generated if they are invalid */
-
-    /* set traversal node to head of list */
-    instructions->cur = instructions->head;
-
-    /* loop through and assemble instructions */
-    while (instructions->cur != NULL)
-    {
-        /* check for RTYPE instruction and format acoordingly */
-        if (instructions->cur->inst_type == RTYPE)
-        {
-            /* assemble binary instruction */
-            sprintf(instructions->cur->bin_inst, "%s%s%s%s%s000000", instructions->cur->opcode_bin, instructions->cur->rs1,
-                    instructions->cur->rs2, instructions->cur->rt, instructions->cur->sa);
-            /* copy to temp var */
-            strcpy(line,instructions->cur->bin_inst);
-
-            /* convert to hex and copy to hex field in node */
-            strcpy(instructions->cur->hex_inst, binToHex32(line));
         }
-        /* check for ITYPE instruction and format acoordingly */
-        else if (instructions->cur->inst_type == ITYPE)
+        else if (argv[i][1] == 'j')
         {
-            /* assemble binary instruction */
-            sprintf(instructions->cur->bin_inst, "%s%s%s%s", instructions->cur->opcode_bin, instructions->cur->rs1,
-                    instructions->cur->rt, instructions->cur->imm);
-            /* copy to temp var */
-            strcpy(line,instructions->cur->bin_inst);
-
-            /* convert to hex and copy to hex field in node */
-            strcpy(instructions->cur->hex_inst, binToHex32(line));
-        }
-        /* check for JTYPE instruction and format acoordingly */
-        else if (instructions->cur->inst_type == JTYPE)
-        {
-            /* check and see if symbol is defined in the hash table */
-            if (checkHash(hash_head, hashgen(instructions->cur->symbol, tSize), instructions->cur->symbol, &addr))
-            {
-                /* symbol exists, so assemble instruction */
-                sprintf(line,"%d",addr);
-                sprintf(instructions->cur->bin_inst, "%s%s%s%s", instructions->cur->opcode_bin, instructions->cur->rs1,
-                        instructions->cur->rt, immToBin(line));
-                strcpy(line,instructions->cur->bin_inst);
-
-                /* convert to hex and copy to hex field in node */
-                strcpy(instructions->cur->hex_inst, binToHex32(line));
-            }
-            else
+            /* -jN or -j N */
+            temp = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            threads = atoi(temp);
+            if (threads < 1 || threads > MAX_THREADS)
             {
-                /* need to generate an error, symbol is invalid */
-
-                /* allocate error node and fill details */
-                temperr = malloc(sizeof(errnode));
-                temperr->errtype = ERR_UNDEFSYMBOL;
-                temperr->lineno = instructions->cur->lineno;
-                strcpy(temperr->symbol, instructions->cur->symbol);
-
-                /* add error node to error list */
-                add_err(errors, temperr);
+                break;
             }
         }
-        /* traverse to next node in instructions list */
-        instructions->cur = instructions->cur->next;
-    } /* end while */
-
-    /* instructions are now assembled in hex, ready to be printed */
-
-    /* if errors exist, write to error file */
-
-    if (errors->count > 0 )
-    {
-        /* attempt to open asm file */
-        if ((fp = fopen(file, "r")) == NULL)
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
         {
-            fprintf(stderr, "Error opening asm file: %s\n", file);
-            exit(1);
-        }
-
-        /* format error file name */
-        sprintf(errfile, "%s.err", strtok(file, "."));
-
-        /* attempt to open error file */
-        if ((errfp = fopen(errfile, "w")) == NULL)
-        {
-            fprintf(stderr, "Error opening error file: %s\n", errfile);
-            exit(1);
+            servepath = argv[++i];
         }
-
-        /* loop through asm file and write all lines to error file with
-           prefixed line numbers */
-        /*reset counter to 0 */
-        counter = 0;
-
-        while (fgets(line, LINE_LEN, fp))
+        else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc)
         {
-            /* increment line counter */
-            counter++;
-            fprintf(errfp,"%2d   %s", counter, line);
+            opts.cachedir = argv[++i];
         }
-        /* close asm file */
-        fclose(fp);
-
-        /* clear some lines in error file */
-        fprintf(errfp, "\n");
-
-        fprintf(errfp, "Errors detected:\n\n");
-
-        /* loop through errors and generate error report */
-        errors->cur = errors->head;
-        while (errors->cur != NULL)
+        else if (strcmp(argv[i], "--stream") == 0)
         {
-            /* if error i opcode, show proper message */
-            if (errors->cur->errtype == ERR_OPCODE)
-            {
-                fprintf(errfp,"  line %2d:  Illegal opcode.\n", errors->cur->lineno);
-
-            }
-            /* else show message for undefined symbol */
-            else if (errors->cur->errtype == ERR_UNDEFSYMBOL)
-            {
-                fprintf(errfp,"  line %2d:  Undefined symbol used.\n", errors->cur->lineno);
-            }
-
-            /* traverse to next error */
-            errors->cur = errors->cur->next;
+            stream = 1;
         }
-
-        /* clear a line */
-        fprintf(errfp, "\n");
-
-        /* check for multiply defined symbols */
-        /* loop through errors */
-        errors->cur = errors->head;
-        while (errors->cur != NULL)
-        {
-            /* check for multiple symbol errors */
-            if (errors->cur->errtype == ERR_MULTSYMBOL)
-            {
-                /* print title */
-                fprintf(errfp,"Multiply defined symbol(s):\n\n");
-
-                /* loop through and print all multiple symbol errors */
-                errors->cur = errors->head;
-                while (errors->cur != NULL)
-                {
-                    if (errors->cur->errtype == ERR_MULTSYMBOL)
-                    {
-                        fprintf(errfp, "  %s\n", errors->cur->symbol);
-                    }
-                    errors->cur = errors->cur->next;
-                }
-                break;
-            }
-            /* traverse to next error node */
-            errors->cur = errors->cur->next;
-        } /* end while */
-
-        /* clear a line */
-        fprintf(errfp, "\n");
-
-        /* check for undefined  symbols */
-        /* loop through errors */
-        errors->cur = errors->head;
-        while (errors->cur != NULL)
+        else if (strncmp(argv[i], "--format=", 9) == 0)
         {
-            if (errors->cur->errtype == ERR_UNDEFSYMBOL)
+            format = findformat(argv[i] + 9);
+            if (format == NULL)
             {
-                /* print title */
-                fprintf(errfp,"Undefined symbol(s):\n\n");
-
-                /* loop through and print all undefined symbol errors */
-                errors->cur = errors->head;
-                while (errors->cur != NULL)
-                {
-                    if (errors->cur->errtype == ERR_UNDEFSYMBOL)
-                    {
-                        fprintf(errfp, "  %s\n", errors->cur->symbol);
-                    }
-                    /* traverse to next node */
-                    errors->cur = errors->cur->next;
-                }
                 break;
             }
-            /* traverse to next node */
-            errors->cur = errors->cur->next;
-        } /* end while */
-
-
-        /* close error file */
-        fclose(errfp);
-
-    } /* end errors */
-    else
-    {
-        /* ok we got no errors so write the obj file */
-
-        /* format object file name */
-        sprintf(file, "%s.obj", strtok(file, "."));
-
-        /* attempt to open object file */
-        if ((fp = fopen(file, "w")) == NULL)
-        {
-            fprintf(stderr, "Error opening obj file: %s\n", file);
-            exit(1);
-        }
-
-        /* loop through instructions writing them to the obj file */
-        instructions->cur = instructions->head;
-
-        while (instructions->cur != NULL)
-        {
-            /* print instruction in hex: address - instruction */
-            fprintf(fp,"0x0000%s:\t0x%s\n", addrToHex(instructions->cur->address, line), instructions->cur->hex_inst);
-
-            /* traverse to next instruction node */
-            instructions->cur = instructions->cur->next;
         }
-
-        /* now write data */
-        data->cur = data->head;
-        while (data->cur != NULL)
+        else
         {
-            /* format and print data entry */
-            fprintf(fp,"0x0000%s:\t0x%s\n", addrToHex(data->cur->address, line), data->cur->hex_val);
-
-            /* traverse to next data entry node */
-            data->cur = data->cur->next;
+            break;
         }
     }
-    printf("========\nCheck %s for output\n=========", file);
-    /* yay, we're finally done and can delete our data structures */
-    delete_errlist(errors);
-    delete_list(instructions);
-    delete_datalist(data);
-    deletetable(hash_head);
 
-    /**************** END main executables *********************/
-
-    /* exit program */
-    return 0;
-}
-
-
-
-/******************* Functions ******************/
-
-int hashgen(char *s,  int T) {
-
-   /* The parameter s represents the symbol to be hashed and  */
-   /* the parameter T represents the size of the hash table.  */
-   /* The function returns the hash value for the symbol s.   */
-
-   /* String s is assumed to be terminated with '\0'.         */
-   /* It is also assumed that T is at least 2. The returned   */
-   /* hash value is an integer in the range 0 to T-1.         */
-
-   /* The function computes the hash value using arithmetic   */
-   /* based on powers of the BASE value defined below.        */
-
-   #define  BASE   127
-
-   int h = 0;     /* Will hold the hash value at the end. */
-   int temp;      /* Temporary.                           */
-
-   /* The hash value is computed in the for loop below. */
-   for (;  *s != 0;  s++) {
-       temp = (BASE * h + *s);
-       if (temp < 0) temp = -temp;
-       h = temp % T;
-   }
-
-   /* The hash value computation is complete. So, */
-   return h;
-
-} /* End of hash_example_one */
-
-tnode* addhashnode(tnode* head, int key, const char* val, int address)
-{
-  tnode* cur  = NULL; //used for traversing the table
-  lnode* lcur = NULL; //used for traversing the lists
-
-  /* Case 1 - no nodes in table yet
-   * -create new table node and make that the head
-   * -create new listnode and add as an entry
-   */
-  if (head == NULL)
-  {
-    //allocate new node for head
-    head = malloc(sizeof(tnode));
-
-    //copy key to new node
-    head->key = key;
-
-    //allocate new node for the first entry under this index
-    head->head = malloc(sizeof(lnode));
-
-    //copy the value to the new entry
-    strcpy(head->head->value, val);
-
-    //copy address to the new entry
-    head->head->address = address;
-
-    //set the new entry nodes' next ptr to null
-    head->head->next = NULL;
-
-    //set number of entries for this index to 1
-    head->entries = 1;
-
-    //set the next ptr for this index node to null
-    head->next = NULL;
-
-    //return new head value
-    return head;
-  }
-  /* Case 2 - head node defined, search for matching key
-   * -if matching key found, add new entry
-   * -if no matching key found, create new table and then add entry
-   */
-  cur = head;
-  while (cur != NULL)
-  {
-    if (cur->key == key)
+    /* check if we have correct arguments, a server takes no files */
+    if ((servepath == NULL && argc - i + 1 < ARGS_NEEDED) ||
+        (servepath != NULL && i < argc) || (i < argc && argv[i][0] == '-') ||
+        (stream && !format->streams))
     {
-      //got match, loop to end of list and append new entry node
-      lcur = cur->head;
-      while (lcur->next != NULL)
-        lcur = lcur->next;
-
-      //allocate new entry node
-      lcur->next = malloc(sizeof(lnode));
-
-      //copy value to new node
-      strcpy(lcur->next->value, val);
-
-      //copy address to the new entry
-            lcur->next->address = address;
-
-
-      //set new nodes next ptr to null
-      lcur->next->next = NULL;
-
-      //increment number of entries for this index
-      cur->entries++;
-
-      //return head ptr
-      return head;
+        fprintf(stderr, "Invalid arguments provided.\n");
+        fprintf(stderr, "usage: %s [-v[v]] [-j threads] [--cache-dir dir] [--stream]\n"
+                        "          [--format=name] <infile|@listfile>...\n", argv[0]);
+        fprintf(stderr, "       formats: obj bin-le bin-be elf elf-le elf-be ihex ihex-le ihex-be\n"
+                        "                srec srec-le srec-be rel rel-le rel-be\n");
+        fprintf(stderr, "       %s [-v[v]] [-j threads] [--cache-dir dir] --serve <socket>\n", argv[0]);
+        exit(1);
     }
-    //reached end of list
-    //add node onto end of table and then add new entry
-    if (cur->next == NULL)
-    {
-      //allocate new table node
-      cur->next = malloc(sizeof(tnode));
-
-      //set table nodes key
-      cur->next->key = key;
-
-      //allocate new entry node
-      cur->next->head = malloc(sizeof(lnode));
 
-      //set new entry node's next ptr to null
-      cur->next->head->next = NULL;
-
-      //copy the value to the new entry
-      strcpy(cur->next->head->value, val);
-
-      cur->next->head->address = address;
-
-      //set new table's entry variable to 1
-      cur->next->entries=1;
-
-      //set new nodes next to null
-      cur->next->next = NULL;
-
-      //exit loop
-      cur = NULL;
+    /* one thread per cpu by default. traces come out in line
+       order only when the files are read one after another */
+    if (threads == 0)
+    {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        threads = threads < 1 ? 1 : (threads > MAX_THREADS ? MAX_THREADS : threads);
     }
-    else
+    if (opts.trace)
     {
-      //traverse to next node
-      cur=cur->next;
+        threads = 1;
     }
-  }
-  //return ptr to head
-  return head;
-}
-
-/* this function takes in a head pointer, a key, a value, and a pointer
-  to return the address found into if such a hash is found */
-int checkHash(tnode* head, int key,const char* val, int *address)
-{
-    /* temp nodes for traversal */
-    tnode* tcur = NULL;
-    lnode* lcur = NULL;
-
-    /* set traversal node to head of list */
-    tcur = head;
 
-    /* loop through looking for desired key */
-    while (tcur != NULL)
+    /* a server keeps one context for every request */
+    if (servepath != NULL)
     {
-        if (tcur->key == key)
+        if ((ctx = asm_ctx_create(threads)) == NULL)
         {
-            /* found key, loop through looking for matching value */
-            lcur = tcur->head;
-            while (lcur != NULL)
-            {
-                if (strcmp(lcur->value, val)==0)
-                {
-                    /* found matching vlaue, set the address and return true */
-                    *address = lcur->address;
-                    return 1;
-                }
-                /* traverse to next node */
-                lcur = lcur->next;
-            }
+            fprintf(stderr, "Out of memory.\n");
+            exit(1);
         }
-        /* traverse to next node */
-        tcur = tcur->next;
-    }
-
-    /* matching key and vlaue were not found, return false */
-    return 0;
-}
-
-
-void deletetable(tnode* head)
-{
-  //node ptrs used for place holders / traversing
-  tnode* tcur  = NULL;
-  tnode* tcur2 = NULL;
-  lnode* lcur  = NULL;
-  lnode* lcur2 = NULL;
-
-  //exit if table is empty
-  if (head == NULL)
-    return;
-
-  //loop through table
-  tcur = head;
-  while (tcur != NULL)
-  {
-    //loop through entry list
-    lcur = tcur->head;
-    while (lcur != NULL)
-    {
-      //delete each entry
-      lcur2 = lcur;
-      lcur = lcur->next;
-      free(lcur2);
+        serve(servepath, ctx, &opts);
+        asm_ctx_destroy(ctx);
+        exit(1);
     }
-    //delete each index
-    tcur2 = tcur;
-    tcur = tcur->next;
-    free(tcur2);
-  }
-}
-/* instructions.c 
-
-   this file contains the functions used to facilitate
-   the linked list that will hold all the assembly instructions
-*/
-
-
-/*************** functions ***********************/
 
-/* this function takes in a list pointer and a node pointer,
-   and will then add the node to the end of the list */
-void add_node(instlist *list, instnode *node)
-{
-    /* if head is null, make new node the head of the list */
-    if (list->head == NULL)
+    /* collect the input files, @name reads names from a list file */
+    work.files = malloc(cap * sizeof(filestatus));
+    work.nfiles = 0;
+    work.next = 0;
+    work.opts = &opts;
+    work.stream = stream;
+    work.format = format;
+    if (work.files == NULL)
     {
-        list->head = node;
-        list->count++;
+        fprintf(stderr, "Out of memory.\n");
+        exit(1);
     }
-    else
+    for (; i < argc; i++)
     {
-        /* set the traversal node to head */
-        list->cur = list->head;
-
-        /* loop to end of list */
-        while (list->cur->next != NULL)
+        if (argv[i][0] == '@')
+        {
+            listed = 1;
+            if (readlist(argv[i] + 1, &work, &cap) != 0)
+            {
+                fprintf(stderr, "Error opening list file: %s\n", argv[i] + 1);
+                exit(1);
+            }
+        }
+        else if (addfile(&work, &cap, argv[i]) != 0)
         {
-            list->cur = list->cur->next;
+            fprintf(stderr, "Out of memory.\n");
+            exit(1);
         }
-        /* set last node's next pointer to our new node */
-        list->cur->next = node;
-        list->count++;
     }
-}
 
-/* this function takes in a list pointer and will traverse through
-  the list deleting nodes and then delte itself */
-void delete_list(instlist* list)
-{
-    /*** Variables ***/
-    instnode *temp = NULL; /* temp node to hold places */
 
+    /****** begin to process asm files ******/
 
-    if (list->head != NULL)
+    /* a single file gets every thread */
+    if (work.nfiles == 1 && !listed)
     {
-        list->cur = list->head;
-        while (list->cur != NULL)
+        if ((ctx = asm_ctx_create(threads)) == NULL)
+        {
+            fprintf(stderr, "Out of memory.\n");
+            exit(1);
+        }
+        assemblefile(&work.files[0], ctx, &opts);
+        asm_ctx_destroy(ctx);
+        if (work.files[0].result == FILE_FAILED)
         {
-            temp = list->cur;
-            list->cur = list->cur->next;
-            free(temp);
+            exit(1);
         }
+        printf("========\nCheck %s for output\n=========", work.files[0].out);
+        free(work.files);
+        return 0;
     }
-    free(list);
-}
-
-
-/***************** Functions ******************/
 
-/* this function takes in a list pointer and a node pointer,
-   and will then add the node to the end of the list */
-void add_datanode(datalist *list, datanode *node)
-{
-    /* if head is null, make new node the head of the list */
-    if (list->head == NULL)
+    /* many files are assembled side by side, one thread each with a
+       context of its own. the first lane runs on this thread */
+    lanes = threads < work.nfiles ? threads : work.nfiles;
+    lane = calloc(lanes > 0 ? lanes : 1, sizeof(batchwork));
+    pthread_mutex_init(&work.lock, NULL);
+    for (i = 0; lane != NULL && i < lanes; i++)
     {
-        list->head = node;
-        list->count++;
+        lane[i].work = &work;
+        lane[i].ctx = asm_ctx_create(1);
+        if (lane[i].ctx == NULL)
+        {
+            lanes = i;
+        }
     }
-    else
+    if (lane == NULL || lanes == 0)
     {
-        /* set the traversal node to head */
-        list->cur = list->head;
-
-        /* loop to end of list */
-        while (list->cur->next != NULL)
+        fprintf(stderr, "Out of memory.\n");
+        exit(1);
+    }
+    for (i = 1; i < lanes; i++)
+    {
+        if (pthread_create(&lane[i].thread, NULL, batchlane, &lane[i]) != 0)
         {
-            list->cur = list->cur->next;
+            /* the lanes that did start take the rest */
+            asm_ctx_destroy(lane[i].ctx);
+            lanes = i;
         }
-        /* set last node's next pointer to our new node */
-        list->cur->next = node;
-        list->count++;
     }
-}
-
-
-/* this function takes in a list pointer and will traverse through
-  the list deleting nodes and then delete the list itself */
-void delete_datalist(datalist* list)
-{
-    /*** Variables ***/
-    datanode *temp = NULL; /* temp node to hold places */
-
-
-    if (list->head != NULL)
+    batchlane(&lane[0]);
+    for (i = 0; i < lanes; i++)
     {
-        list->cur = list->head;
-        while (list->cur != NULL)
+        if (i > 0)
         {
-            temp = list->cur;
-            list->cur = list->cur->next;
-            free(temp);
+            pthread_join(lane[i].thread, NULL);
         }
+        asm_ctx_destroy(lane[i].ctx);
     }
-    free(list);
-}
-/* errorlist.c -   this file contains functions for use with the
-   error list.
-*/
-
-/***************** Functions  ***************/
+    pthread_mutex_destroy(&work.lock);
+    free(lane);
 
-/* this function takes in a list pointer and a node pointer,
-   and will then add the node to the list in order of line number */
-void add_err(errlist *list, errnode *node)
-{
-    node->next = NULL;
-
-    /* if head is null, make new node the head of the list */
-    if (list->head == NULL)
-    {
-        list->head = node;
-        list->count++;
-    }
-    else
+    /* report how every file went, in the order they were given */
+    printf("========\n");
+    for (i = 0; i < work.nfiles; i++)
     {
-
-        /* is lineno before head? replace */
-        if (node->lineno < list->head->lineno)
-        {
-            node->next = list->head;
-            list->head = node;
-            list->count++;
-        }
-        else
+        switch (work.files[i].result)
         {
-            /* set the traversal node to head */
-            list->cur = list->head;
+        case FILE_OK:
+            printf("%s: ok, %lu words in %s\n", work.files[i].path,
+                   (unsigned long)work.files[i].words, work.files[i].out);
+            break;
 
-            /* loop through list looking for insertion point */
-            while (list->cur != NULL)
-            {
-                if (list->cur->next != NULL)
-                {
+        case FILE_ERRORS:
+            printf("%s: %d error(s), see %s\n", work.files[i].path,
+                   work.files[i].errors, work.files[i].out);
+            break;
 
-                    if (node->lineno < list->cur->next->lineno)
-                    {
-                        /* found insertion point, add node in */
-                        node->next = list->cur->next;
-                        list->cur->next = node;
-                        list->count++;
-                        return;
-                    }
-                }
-                else
-                {
-                    list->cur->next = node;
-                    list->count++;
-                    return;
-                }
-                list->cur = list->cur->next;
-            }
-            /* set last node's next pointer to our new node */
-       //     list->cur->next = node;
-          //  list->count++;
+        default:
+            printf("%s: failed\n", work.files[i].path);
+            break;
         }
+        counts[work.files[i].result]++;
+        free(work.files[i].listed);
     }
-}
+    printf("%d file(s): %d ok, %d with errors, %d failed\n=========\n",
+           work.nfiles, counts[FILE_OK], counts[FILE_ERRORS], counts[FILE_FAILED]);
 
-/* this function takes in a list pointer and will traverse through
-  the list deleting nodes and then delete the list itself */
-void delete_errlist(errlist* list)
-{
-    /*** Variables ***/
-    errnode *temp = NULL; /* temp node to hold places */
+    free(work.files);
 
+    /**************** END main executables *********************/
 
-    if (list->head != NULL)
-    {
-        list->cur = list->head;
-        while (list->cur != NULL)
-        {
-            temp = list->cur;
-            list->cur = list->cur->next;
-            free(temp);
-        }
-    }
-    free(list);
-}
\ No newline at end of file
+    /* exit program */
+    return counts[FILE_FAILED] > 0 ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+# bench/lists.sh
+#
+#   usage: bench/lists.sh [assembler] [lines...]
+#
+#   Times the assembler on generated addi-only sources with a
+#   '.resw 100000' data section, 1M, 2M, 5M and 10M lines unless other
+#   counts are given. Every instruction, data word and error goes
+#   on a list, so with O(1) appends the time grows linearly with
+#   the number of lines. The obj file goes to a temporary directory
+#   and the best of three runs is printed.
+
+ASM=${1:-./assembler}
+[ $# -gt 0 ] && shift
+LINES=${*:-1000000 2000000 5000000 10000000}
+
+[ -x "$ASM" ] || { echo "no assembler at $ASM, build it first" >&2; exit 1; }
+case $ASM in /*) ;; *) ASM=$(pwd)/$ASM ;; esac
+
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+# milliseconds since the epoch
+now()
+{
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+for n in $LINES
+do
+    awk -v n="$n" 'BEGIN {
+        print "\t.text"
+        for (i = 0; i < n; i++)
+            printf "\taddi $t%d,$t%d,%d\n", i % 8, (i + 1) % 8, i % 1000
+        print "\t.data"
+        print "A:\t.resw 100000"
+    }' > "$DIR/lists.asm"
+
+    best=
+    for run in 1 2 3
+    do
+        start=$(now)
+        (cd "$DIR" && "$ASM" lists.asm > /dev/null) || { echo "assembler failed" >&2; exit 1; }
+        ms=$(( $(now) - start ))
+        [ -z "$best" ] || [ "$ms" -lt "$best" ] && best=$ms
+    done
+    printf '%9d lines  %6d ms  %6d ns/line\n' "$n" "$best" $(( best * 1000000 / n ))
+done
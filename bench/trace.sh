@@ -0,0 +1,47 @@
+#!/bin/sh
+# bench/trace.sh
+#
+#   usage: bench/trace.sh [assembler] [lines]
+#
+#   Times the assembler on a generated addi-only source of 4M lines
+#   unless another count is given, once without a trace and once
+#   with -v and -vv going to /dev/null. With the trace off the only
+#   cost left is one check per line, so the first time is the one
+#   to compare with builds from before the buffered trace. The best
+#   of three runs is printed.
+
+ASM=${1:-./assembler}
+LINES=${2:-4000000}
+
+[ -x "$ASM" ] || { echo "no assembler at $ASM, build it first" >&2; exit 1; }
+case $ASM in /*) ;; *) ASM=$(pwd)/$ASM ;; esac
+
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+# milliseconds since the epoch
+now()
+{
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+awk -v n="$LINES" 'BEGIN {
+    print "\t.text"
+    for (i = 0; i < n; i++)
+        printf "\taddi $t%d,$t%d,%d\n", i % 8, (i + 1) % 8, i % 1000
+    print "\t.data"
+    print "A:\t.word 1"
+}' > "$DIR/trace.asm"
+
+for flags in "" -v -vv
+do
+    best=
+    for run in 1 2 3
+    do
+        start=$(now)
+        (cd "$DIR" && "$ASM" $flags trace.asm > /dev/null 2>&1) || { echo "assembler failed" >&2; exit 1; }
+        ms=$(( $(now) - start ))
+        [ -z "$best" ] || [ "$ms" -lt "$best" ] && best=$ms
+    done
+    printf '%-4s %9d lines  %6d ms\n' "${flags:-off}" "$LINES" "$best"
+done
@@ -0,0 +1,6567 @@
+/* libasm.c
+
+   This is the assembler library, see libasm.h for its interface.
+   It reads in a TMIPS assembly source and processes the
+   instructions in it. It makes a first pass reading in all
+   the instructions and symbols into record arrays and puts
+   all labels into a hash table. On a second pass it evaluates
+   all the symbols and assembles the intructions, collecting
+   errors as they arise. The result holds the assembled words
+   and can be written out as a detailed error file or as an
+   object file in hexadecimal format.
+
+   Nothing here is global, everything lives in a context, so
+   contexts can be used from many threads at once.
+*/
+
+/* prog.h 
+   this file contains the prototypes for the
+   utility functions as well as many of the constants used
+   throughout the program.
+*/
+
+/************* Includes **************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <elf.h>
+
+#include "libasm.h"
+
+/* the lexer has SSE2 and AVX2 kernels on x86, picked at run time */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+/* packed words in this order are the word array as it is in memory */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_FORMAT ASM_FORMAT_BIN_BE
+#else
+#define HOST_FORMAT ASM_FORMAT_BIN_LE
+#endif
+
+/*************** constants ******************/
+
+#define ERR_OPCODE 0       /* illegal opcode detected */
+#define ERR_UNDEFSYMBOL 1  /* undefined symbol used   */
+#define ERR_MULTSYMBOL 2   /* mutiply defined symbold */
+#define ERR_BADOBJECT 3    /* linked file is not a relocatable object */
+#define ERR_RANGE 4        /* branch target out of reach */
+/************** Constants *************/
+#define SYM_SLOTS 64  /* initial number of symbol table slots */
+#define ARENA_BLOCK 65536  /* default size of an arena block */
+#define ARENA_ALIGN 16     /* alignment of every arena allocation */
+#define SYM_UNDEFINED -1   /* address of a symbol that is used but not defined */
+#define SYM_REPORTED -2    /* undefined and already reported by the linker */
+
+/* symbol flags */
+#define SYM_GLOBAL 0x1  /* named by .globl, seen by other objects          */
+#define SYM_EXTERN 0x2  /* named by .extern, may be defined in another one */
+#define SYM_DATA   0x4  /* defined in the data section                     */
+
+/* types of instructions */
+#define RTYPE 0
+#define ITYPE 1
+#define JTYPE 2
+
+/* operand shapes an instruction can take */
+#define SHAPE_RRR 0  /* reg, reg, reg            */
+#define SHAPE_RRI 1  /* reg, reg, immediate      */
+#define SHAPE_RRS 2  /* reg, reg, shift amount   */
+#define SHAPE_RI  3  /* reg, immediate           */
+#define SHAPE_RM  4  /* reg, offset(base)        */
+#define SHAPE_RRL 5  /* reg, reg, label          */
+#define SHAPE_L   6  /* label                    */
+#define SHAPE_LA  7  /* la pseudo instruction    */
+#define SHAPE_RRV 8  /* reg, reg, shift register */
+#define SHAPE_RR  9  /* reg, reg, no destination */
+#define SHAPE_D  10  /* destination reg          */
+#define SHAPE_S  11  /* source reg               */
+#define SHAPE_JALR 12  /* [reg,] reg, $ra unless given */
+#define SHAPE_NONE 13  /* no operands            */
+#define SHAPE_RL  14  /* reg, label              */
+
+/* instruction record flags */
+#define REC_SYMBOL 0x1  /* imm holds the id of a symbol to resolve */
+#define REC_HI     0x2  /* encode the upper half of the symbol address */
+#define REC_LO     0x4  /* encode the lower half of the symbol address */
+
+/* token types produced by the lexer */
+#define TOK_END       0  /* no more tokens on the line       */
+#define TOK_LABEL     1  /* name followed by a colon         */
+#define TOK_MNEMONIC  2  /* first name on a line             */
+#define TOK_REG       3  /* $register, reg holds its number  */
+#define TOK_IMM       4  /* integer, val holds it            */
+#define TOK_SYMBOL    5  /* any later name                   */
+#define TOK_MEM       6  /* offset(base) operand             */
+#define TOK_DIRECTIVE 7  /* name starting with a dot         */
+#define TOK_COLON     8  /* colon that does not end a label  */
+
+#define MAX_TOKS 8  /* tokens kept per line, the rest are dropped */
+
+/* delimiter masks built by the lexer for each 64 byte block */
+#define MASK_SOLID 0  /* anything but blanks and commas      */
+#define MASK_DELIM 1  /* anything that ends a token          */
+#define MASK_NL    2  /* newlines                            */
+#define MASK_COUNT 3
+#define INDEX_BLOCKS 64  /* blocks indexed at a time, 4 KiB of source */
+
+/* sections of the source, a chunk of lines lies in one of them */
+#define SECT_PRE  0  /* before .text, lines are skipped */
+#define SECT_TEXT 1  /* instructions                    */
+#define SECT_DATA 2  /* data directives                 */
+#define NO_SECTION ((size_t)-1)  /* searchsection found no such line */
+
+#define CHUNK_MIN (1 << 20)    /* smallest piece of source given to a thread */
+#define CHUNKS_PER_THREAD 4    /* pieces per thread, evens out uneven lines */
+#define MAX_THREADS 256        /* most threads a context starts */
+#define ENCODE_BLOCK 16384     /* records encoded by one pass two task */
+#define RELOC_BLOCK 65536      /* relocations applied by one link task */
+#define STREAM_CHUNK (1 << 16) /* piece of source read at a time when streaming */
+
+/* chunks kept in a cache directory end where the text says so,
+   after a line whose last bytes hash with the CACHE_CUT_MASK bits
+   clear, so an edit only moves the boundaries next to it */
+#define CACHE_CHUNK_MIN (1 << 16)  /* smallest cached chunk in bytes */
+#define CACHE_CHUNK_MAX (1 << 20)  /* largest cached chunk in bytes  */
+#define CACHE_CUT_MASK 0xFF        /* about one line in 256 may end a chunk */
+#define CACHE_TAIL 16              /* bytes of a line the cut looks at */
+#define CACHE_VERSION 5            /* bump whenever pass one output changes */
+#define CACHE_PATH_LEN 4096        /* longest cache file name */
+
+#define TRACE_LEN 65536  /* size of the trace buffer */
+#define OBJ_BUF_LEN (1 << 20)  /* size of the obj writer buffer */
+#define OBJ_LINE_LEN 23        /* length of one "0x0000XXXX:\t0xXXXXXXXX\n" line */
+#define OBJ_WORD_POS 14        /* offset of the word in a line */
+
+/* Intel HEX and S-record output */
+#define HEX_RECORD_DATA 255    /* most data bytes in an Intel HEX record */
+#define SREC_RECORD_COUNT 255  /* most address, data and checksum bytes in an S-record */
+#define RECORD_LINE_LEN 528    /* longest record line, mark, hex bytes and newline */
+#define HEX_DATA 0             /* Intel HEX data record */
+#define HEX_EOF 1              /* Intel HEX end of file record */
+#define HEX_EXTADDR 4          /* Intel HEX extended linear address record */
+
+/* section headers of the ELF file, in order */
+#define ELF_TEXT     1
+#define ELF_DATA     2
+#define ELF_SYMTAB   3
+#define ELF_STRTAB   4
+#define ELF_SHSTRTAB 5
+#define ELF_RELTEXT  6     /* only in a relocatable object */
+#define ELF_SECTIONS 7
+#define ELF_SEGMENTS 2     /* loadable segments, the text and the data */
+#define ELF_PAGE     4096  /* segments are aligned to pages in the file */
+
+/* bit positions and masks of the instruction fields */
+#define OPCODE_SHIFT 26
+#define RS_SHIFT 21
+#define RT_SHIFT 16
+#define RD_SHIFT 11
+#define SA_SHIFT 6
+#define OPCODE_MASK 0x3F
+#define REG_MASK 0x1F
+#define IMM_MASK 0xFFFF
+#define TARGET_MASK 0x3FFFFFF
+
+
+/* utility functions */
+
+
+/* a piece of the source file. views point straight into the
+   mapped file, so they are not null terminated */
+typedef struct strview_s
+{
+    const char *p;  /* first character */
+    size_t len;     /* number of characters */
+} strview;
+
+/* one token of a line. fields a token type does not use are 0,
+   so reading the wrong kind of operand gives 0 */
+typedef struct token_s
+{
+    int type;      /* TOK_ constant */
+    int reg;       /* register number, the base register of TOK_MEM */
+    int32_t val;   /* value of TOK_IMM, the offset of TOK_MEM */
+    strview text;  /* characters of the token */
+} token;
+
+/* does the view hold exactly a string */
+static int viewEq(strview view, const char *str);
+
+/* collects trace messages and writes them out in large blocks */
+typedef struct tracer_s
+{
+    int level;            /* trace verbosity, 0 is off */
+    int fd;               /* where the trace goes */
+    size_t len;           /* bytes pending in buf */
+    char buf[TRACE_LEN];  /* pending trace output */
+} tracer;
+
+/* appends a formatted trace message to the trace buffer */
+static void trace(tracer *t, const char *fmt, ...);
+
+/* writes out the trace buffer */
+static void flushtrace(tracer *t);
+
+/* return register number for a register name without the $ */
+static int regToNum(const char *name, size_t len);
+
+/* packs the fields of an R type instruction into a 32 bit word */
+static uint32_t encodeRType(int opcode, int rs1, int rs2, int rt, int sa, int funct);
+
+/* packs the fields of an I type instruction into a 32 bit word */
+static uint32_t encodeIType(int opcode, int rs1, int rt, int imm);
+
+/* packs the fields of a J type instruction into a 32 bit word */
+static uint32_t encodeJType(int opcode, int target);
+
+/****************** Constants **************/
+
+/****************** Data Structures ********************/
+
+/* one block of memory handed out by an arena */
+typedef struct arenablock_s
+{
+    struct arenablock_s *next;  /* next block in the chain */
+    size_t used;                /* bytes handed out from this block */
+    size_t size;                /* bytes of storage in this block */
+
+} arenablock;
+
+/* header in front of a growable buffer owned by an arena */
+typedef struct arenabig_s
+{
+    struct arenabig_s *next;  /* next buffer */
+    struct arenabig_s *prev;  /* previous buffer */
+
+} arenabig;
+
+/* this owns every object that lives as long as one assembly.
+   allocation bumps a pointer and everything is released together */
+typedef struct arena_s
+{
+    arenablock *first;  /* first block in the chain */
+    arenablock *cur;    /* block allocations come from */
+    arenabig *big;      /* growable buffers, see arenarealloc */
+
+} arena;
+
+/* where running out of memory lands on this thread. every call of
+   the library that allocates sets it, and so does every pool task */
+static __thread jmp_buf *nomemjump;
+
+/* gives up on what the thread is doing, see nomemjump */
+static void nomemory(void) __attribute__((noreturn));
+
+/* set up an empty arena */
+static void initarena(arena *mem);
+
+/* returns size bytes of zeroed memory owned by the arena */
+static void *arenaalloc(arena *mem, size_t size);
+
+/* copies len characters into the arena as a null terminated string */
+static char *arenastrndup(arena *mem, const char *str, size_t len);
+
+/* resizes a large growable buffer owned by the arena */
+static void *arenarealloc(arena *mem, void *ptr, size_t size);
+
+/* forgets every allocation but keeps the blocks for reuse */
+static void resetarena(arena *mem);
+
+/* releases every block of the arena */
+static void freearena(arena *mem);
+
+/* this describes one mnemonic of the instruction set:
+   how it is encoded and which operands it takes */
+typedef struct instdesc_s
+{
+    const char *name;  /* mnemonic */
+    int format;        /* type of instruction: R, I, J */
+    int opcode;        /* 6 bit opcode field */
+    int funct;         /* 6 bit function field of R type instructions,
+                          the rt field of bgez and bltz */
+    int shape;         /* operand shape, one of the SHAPE_ constants */
+
+} instdesc;
+
+/* index of every mnemonic in the descriptor table */
+enum
+{
+    OP_ADD, OP_ADDI, OP_NOR, OP_ORI, OP_SLL, OP_LUI,
+    OP_SW, OP_LW, OP_BNE, OP_J, OP_LA,
+    OP_ADDU, OP_SUB, OP_SUBU, OP_AND, OP_OR, OP_XOR, OP_SLT, OP_SLTU,
+    OP_SRL, OP_SRA, OP_SLLV, OP_SRLV, OP_SRAV,
+    OP_MULT, OP_MULTU, OP_DIV, OP_DIVU, OP_MFHI, OP_MTHI, OP_MFLO, OP_MTLO,
+    OP_JR, OP_JALR, OP_SYSCALL, OP_BREAK,
+    OP_BEQ, OP_BGEZ, OP_BGTZ, OP_BLEZ, OP_BLTZ,
+    OP_COUNT
+};
+
+/* returns the descriptor index for a mnemonic, -1 if it is unknown */
+static int lookupOp(strview name);
+
+
+/* this node will hold an error found
+   while reading asm file */
+typedef struct errnode_s
+{
+    /* variables */
+    int errtype;             /* type of error */
+    int lineno;              /* line number error was encountered on */
+
+    const char *symbol;      /* name of symbol */
+    const char *opcode;      /* name of opcode */
+
+
+    struct errnode_s *next; /* pointer to next node in list */
+
+} errnode;
+
+typedef struct errlist_s
+{
+    errnode *head;  /* pointer to the head of the list */
+    errnode *tail;  /* pointer to the last node of the list */
+    errnode *cur;   /* node pointer used for traversal */
+
+    int count;       /* number of instructions */
+
+} errlist;
+
+
+/*************** Functions **************************************/
+
+/* add a node to list */
+static void add_err(errlist *list, errnode *node);
+
+/* copies the nodes of a list into an arena */
+static void keeperrors(errlist *list, arena *mem);
+
+
+
+/*************** Data structures *********************/
+
+/* this holds every word of the data section. the address of a
+   word is the number of instructions plus its index */
+typedef struct datalist_s
+{
+    uint32_t *words;  /* 32 bit values of the data entries */
+    size_t count;     /* number of data words */
+    size_t cap;       /* allocated number of words */
+
+} datalist;
+
+
+/*************** Functions **************************************/
+
+/* add a word to the list */
+static void add_dataword(arena *mem, datalist *list, uint32_t word);
+
+
+
+
+/************* Includes ****************/
+
+/**************Data structures ****************/
+
+/* this record holds an instruction read from the assembly file
+   to later be encoded. it only keeps numeric fields and is packed
+   into 16 bytes so pass two streams through a contiguous array.
+   the address of an instruction is its index in the array and the
+   format, opcode and funct come from its descriptor */
+typedef struct instrec_s
+{
+    uint16_t op;      /* descriptor index, one of the OP_ constants */
+    uint8_t  rt;      /* Register target   */
+    uint8_t  rs1;     /* Register source 1 */
+    uint8_t  rs2;     /* Register source 2 */
+    uint8_t  sa;      /* shift amount      */
+    uint16_t flags;   /* REC_ flags */
+    int32_t  imm;     /* 16 bit immediate field, or symbol id with REC_SYMBOL */
+    uint32_t lineno;  /* line number the instruction was read from */
+
+} instrec;
+
+/* fails to compile if the record is not 16 bytes */
+typedef char instrec_size_check[sizeof(instrec) == 16 ? 1 : -1];
+
+typedef struct instlist_s
+{
+    instrec *recs;    /* instructions in address order */
+    size_t count;     /* number of instructions */
+    size_t cap;       /* allocated number of records */
+
+    uint32_t *words;  /* assembled instructions, filled in by pass two */
+
+} instlist;
+
+
+/*************** Functions **************************************/
+
+/* add a record to list */
+static void add_inst(arena *mem, instlist *list, const instrec *rec);
+
+
+
+/* one slot of the open addressed index, the cached hash lets
+   probes skip most string compares */
+typedef struct symslot_s
+{
+    uint32_t hash;  /* hash of the symbol name */
+    uint32_t id;    /* symbol id + 1, 0 marks an empty slot */
+} symslot;
+
+/* one symbol, ids index straight into the symbol array */
+typedef struct symbol_s
+{
+    uint32_t name;  /* offset of the name in the name arena */
+    int address;    /* integer address to location, SYM_UNDEFINED until defined */
+    int line;       /* line the symbol was defined on */
+    uint32_t flags; /* SYM_ flags */
+} symbol;
+
+typedef struct symtable_s
+{
+    arena *mem;       /* arena all storage comes from */
+
+    symslot *slots;   /* open addressed index, power of two in size */
+    uint32_t mask;    /* number of slots - 1 */
+
+    symbol *syms;     /* symbols in order of definition */
+    uint32_t count;   /* number of symbols */
+    uint32_t cap;     /* allocated size of syms */
+
+    char *names;      /* every name, null terminated, back to back */
+    size_t nameslen;  /* bytes used in names */
+    size_t namescap;  /* bytes allocated for names */
+} symtable;
+/*====================================================================*/
+
+/* set up an empty symbol table owned by an arena */
+static void initsymtable(symtable *table, arena *mem);
+
+/* makes room for count symbols in the table */
+static void reservesymtable(symtable *table, size_t count);
+
+/* adds a symbol to the table and returns its id */
+static int addsymbol(symtable *table, const char *name, size_t len, int address);
+
+/* returns the id of a symbol, -1 if it is not in the table */
+static int findsymbol(const symtable *table, const char *name, size_t len);
+
+/* returns the id of a symbol, adding it as undefined if needed */
+static int refsymbol(symtable *table, const char *name, size_t len);
+
+/* generate hash of a symbol name */
+static uint32_t symhash(const char *s, size_t len);
+
+
+
+/* where the bytes of a source live */
+#define SRC_HEAP     0  /* read into a buffer we free   */
+#define SRC_MAPPED   1  /* mapped from the file          */
+#define SRC_BORROWED 2  /* owned by the caller, untouched */
+
+/* the assembly source. regular files are mapped into memory,
+   anything else is read into one buffer */
+typedef struct srcfile_s
+{
+    const char *data;  /* contents of the file */
+    size_t size;       /* bytes in the file */
+    size_t pos;        /* offset of the next line */
+    int storage;       /* one of the SRC_ constants */
+
+    /* delimiter masks of the INDEX_BLOCKS blocks starting at winpos,
+       bit i of block b is byte winpos + 64 * b + i. the lexer fills
+       them in as it moves along */
+    size_t winpos;
+    uint64_t masks[INDEX_BLOCKS][MASK_COUNT];
+    void (*classify)(const unsigned char *p, size_t nblocks, uint64_t (*masks)[MASK_COUNT]);
+} srcfile;
+
+/* opens a source file, returns 0 on success */
+static int opensource(srcfile *src, const char *name);
+
+/* reads the source from a buffer the caller keeps alive */
+static void opensourcebuf(srcfile *src, const char *data, size_t size);
+
+/* returns the next line, newline included, 0 at the end of the file */
+static int nextLine(srcfile *src, strview *line);
+
+/* splits the next line into tokens, 0 at the end of the file */
+static int lexLine(srcfile *src, token *toks, int *ntoks);
+
+/* returns the fastest block classifier the cpu supports */
+static void (*pickClassifier(void))(const unsigned char *p, size_t nblocks,
+                             uint64_t (*masks)[MASK_COUNT]);
+
+
+
+/* a run of whole lines of one section that pass one reads on its
+   own. everything it finds goes into lists owned by the chunk, with
+   addresses counted from the start of the chunk, and is merged into
+   the program once every chunk is done */
+typedef struct chunk_s
+{
+    srcfile src;        /* the lines, a view into the source */
+    int section;        /* SECT_TEXT or SECT_DATA */
+    tracer *trace;      /* trace of the assembly */
+    int lines;          /* number of lines */
+    int linebase;       /* lines in the file before the chunk */
+
+    /* set when the chunk is kept in a cache directory. the chunk is
+       then encoded from words that have everything but the symbols
+       in them and a list of the records that need a symbol */
+    const char *cachedir;    /* the directory, NULL for none */
+    uint64_t key[2];         /* hash of the section and the text */
+    void *cachemap;          /* cache file mapped in, the lists point into it */
+    size_t cachelen;         /* bytes mapped */
+    const uint32_t *words;   /* instructions encoded without their symbols */
+    const uint32_t *fixidx;  /* index of every record that needs a symbol */
+    const instrec *fixrecs;  /* and the record */
+    uint32_t nfix;           /* number of them */
+
+    arena mem;          /* owns everything below */
+    instlist insts;     /* instructions of the chunk */
+    datalist data;      /* data words of the chunk */
+    errlist errors;     /* errors found in the chunk */
+    symtable symbols;   /* symbols defined or used in the chunk */
+
+    /* filled in by the merge */
+    size_t instbase;    /* index of the first instruction in the program */
+    size_t database;    /* index of the first data word in the program */
+    int *symmap;        /* chunk symbol id to program symbol id */
+    instrec *instout;   /* program instruction array */
+    uint32_t *dataout;  /* program data array */
+
+    /* filled in when a cached chunk is encoded */
+    uint32_t *wordsout;         /* program word array */
+    const symtable *program;    /* finished program symbol table */
+    errlist undefs;             /* undefined symbols and branches out of reach */
+} chunk;
+
+/* header of a cache file. it is followed by the instruction words,
+   the indexes and records of the ones that need a symbol, the data
+   words, the symbols, the errors, the symbol names and the text of
+   the errors, each as long as the header says */
+typedef struct cachehead_s
+{
+    char magic[8];      /* "TASMCHNK" */
+    uint32_t version;   /* CACHE_VERSION */
+    uint32_t section;   /* SECT_TEXT or SECT_DATA */
+    uint64_t key[2];    /* hash of the section and the text */
+    uint64_t size;      /* bytes of source */
+    uint64_t sum;       /* sum of the lists, see sumbytes */
+    uint32_t lines;     /* lines of source */
+    uint32_t ninsts;    /* number of instructions */
+    uint32_t nfix;      /* number of them that need a symbol */
+    uint32_t ndata;     /* number of data words */
+    uint32_t nsyms;     /* number of symbols */
+    uint32_t nerrs;     /* number of errors */
+    uint32_t nameslen;  /* bytes of symbol names */
+    uint32_t textlen;   /* bytes of error text */
+} cachehead;
+
+/* an error as kept in a cache file */
+typedef struct cacheerr_s
+{
+    int32_t errtype;  /* type of error */
+    int32_t lineno;   /* line within the chunk */
+    uint32_t text;    /* offset of the opcode or symbol in the error text */
+} cacheerr;
+
+/* picks the lines a cached chunk may end after */
+static int cutline(const char *nl);
+
+/* hashes the text of a chunk into its key and counts its lines */
+static void chunkkey(chunk *c);
+
+/* adds len bytes at p to the sum of a cache file */
+static uint64_t sumbytes(uint64_t sum, const void *p, size_t len);
+
+/* checks the sum of a cache file and that what it holds is in range,
+   returns 0 if so */
+static int cachevalid(const cachehead *head);
+
+/* maps in the cache file of a chunk, returns 0 on a hit */
+static int cacheload(chunk *c);
+
+/* encodes what pass one read of a chunk and writes it to its cache file */
+static void cachestore(chunk *c);
+
+/* a run of records that pass two encodes on its own. undefined
+   symbols are reported into the block's list and merged in block
+   order, which is line order */
+typedef struct encodeblock_s
+{
+    size_t start;              /* first record */
+    size_t end;                /* one past the last record */
+    instlist *insts;           /* program records and words */
+    const symtable *symbols;   /* finished program symbol table */
+
+    arena mem;                 /* owns the error nodes */
+    errlist errors;            /* undefined symbols in the block */
+} encodeblock;
+
+/* one unit of work for the thread pool */
+typedef struct pooltask_s
+{
+    void (*fn)(void *arg, int i);  /* function to run */
+    void *arg;                     /* its arguments */
+    int i;                         /* its index */
+} pooltask;
+
+/* worker threads taking tasks from a shared queue */
+typedef struct threadpool_s
+{
+    pthread_t *threads;      /* worker threads */
+    int nthreads;            /* number of workers */
+
+    pthread_mutex_t lock;    /* guards everything below */
+    pthread_cond_t work;     /* signalled when tasks are queued */
+    pthread_cond_t idle;     /* signalled when the last task finishes */
+
+    pooltask *tasks;         /* ring buffer of queued tasks */
+    int head;                /* first queued task */
+    int count;               /* number of queued tasks */
+    int cap;                 /* size of the ring */
+    int pending;             /* tasks queued or running */
+    int stop;                /* workers should exit */
+    int nomem;               /* a task ran out of memory */
+} threadpool;
+
+/* starts a pool with nthreads workers, 0 runs everything on the caller */
+static void initpool(threadpool *pool, int nthreads);
+
+/* queues fn(arg, i) */
+static void poolsubmit(threadpool *pool, void (*fn)(void *arg, int i), void *arg, int i);
+
+/* helps run queued tasks until all of them are done */
+static void poolwait(threadpool *pool);
+
+/* runs fn(arg, i) for i from 0 to n - 1 and waits for all of them */
+static void parallelfor(threadpool *pool, int n, void (*fn)(void *arg, int i), void *arg);
+
+/* stops the workers and releases the pool */
+static void freepool(threadpool *pool);
+
+/* releases the source file */
+static void closesource(srcfile *src);
+
+
+
+/* collects formatted obj lines, or packed words, and writes them in
+   large blocks */
+typedef struct objwriter_s
+{
+    int format;   /* one of the ASM_FORMAT_ constants */
+    int fd;       /* output file descriptor, -1 keeps it all in buf */
+    char *buf;    /* pending output */
+    size_t len;   /* bytes pending in buf */
+    size_t cap;   /* bytes allocated for buf */
+    arena *mem;   /* owns buf */
+    int failed;   /* set once a write fails */
+
+    size_t done;  /* bytes written out ahead of buf */
+    off_t base;   /* offset in the file the obj file starts at */
+} objwriter;
+
+/* starts an obj file written to a file descriptor */
+static void openobj(objwriter *out, arena *mem, int fd, int format);
+
+/* starts an obj file that is kept in memory, in buf and len */
+static void openobjmem(objwriter *out, arena *mem, int format);
+
+/* formats one address - word line, or packs the word */
+static void emitword(objwriter *out, uint32_t addr, uint32_t word);
+
+/* stores a word as four bytes in the byte order of a packed format */
+static void packword(char *p, uint32_t word, int format);
+
+/* the byte order a format packs words in, as a packed format */
+static int packorder(int format);
+
+/* writes the words of a program as Intel HEX or S-records */
+static void writeihex(objwriter *out, const uint32_t *words, size_t nwords);
+static void writesrec(objwriter *out, const uint32_t *words, size_t nwords);
+
+/* rewrites the word of a line that was already emitted */
+static void patchword(objwriter *out, uint32_t addr, uint32_t word);
+
+/* writes out pending output, returns 0 on success */
+static int closeobj(objwriter *out);
+
+/* writes a whole buffer to a file descriptor, returns 0 on success */
+static int writeall(int fd, const char *buf, size_t len);
+
+/* a word of a relocatable object that the linker fills in */
+typedef struct reloc_s
+{
+    uint32_t addr;  /* address of the word */
+    uint32_t sym;   /* program symbol id */
+    uint32_t type;  /* R_MIPS_ relocation type */
+} reloc;
+
+/* the relocations of a program, in address order */
+typedef struct reloclist_s
+{
+    reloc *relocs;  /* every relocation */
+    size_t count;   /* number of them */
+    size_t cap;     /* allocated size of relocs */
+} reloclist;
+
+/* lays out the ELF file of a result in one buffer owned by an arena */
+static char *layoutelf(const asm_result *res, arena *mem, int format, size_t *len);
+
+/* returns 1 if a result uses symbols defined in another object */
+static int hasimports(const asm_result *res);
+
+/* turns the la words of an ELF executable into byte addresses */
+static void elfaddresses(const asm_result *res, char *text, int order);
+
+
+/* how far loading an object to link got */
+#define LINK_OK      0  /* mapped and checked      */
+#define LINK_MISSING 1  /* the file cannot be read */
+#define LINK_BAD     2  /* not an object we can link */
+
+/* a relocatable object being linked. the sections are views into
+   the mapped file, in the byte order of the file */
+typedef struct linkobj_s
+{
+    const char *path;     /* file of the object */
+    int index;            /* place on the command line */
+    srcfile src;          /* the file mapped in */
+    int state;            /* one of the LINK_ constants */
+    int order;            /* byte order as a packed format */
+
+    uint32_t textsec;     /* section index of the text, 0 for none */
+    uint32_t datasec;     /* section index of the data, 0 for none */
+    const char *text;     /* words of the text */
+    size_t ntext;         /* number of them */
+    const char *data;     /* words of the data */
+    size_t ndata;         /* number of them */
+    const char *syms;     /* Elf32_Sym entries */
+    uint32_t nsyms;       /* number of them, the null one included */
+    const char *strtab;   /* names of the symbols */
+    const char *rels;     /* Elf32_Rel entries of the text */
+    uint32_t nrels;       /* number of them */
+
+    /* filled in by the layout */
+    size_t textbase;          /* address of the first word of the text */
+    size_t database;          /* address of the first word of the data */
+    size_t symbase;           /* index of the first symbol in addrsout */
+    const symtable *globals;  /* global symbols of every object */
+    uint32_t *wordsout;       /* program word array */
+    int *addrsout;            /* word address of every symbol of every object */
+
+    arena mem;            /* owns the errors */
+    errlist errors;       /* errors found in the object */
+} linkobj;
+
+/* a run of the relocations of one object that is applied on its own.
+   the relocations of every object are cut into runs, so a big object
+   is spread over the threads like many small ones */
+typedef struct relblock_s
+{
+    const linkobj *obj;   /* object the relocations are in */
+    uint32_t start;       /* first relocation of the run */
+    uint32_t end;         /* one past the last one */
+    uint32_t *section;    /* program words of the section they patch */
+    const int *addrs;     /* word address of every symbol of the object */
+
+    arena mem;            /* owns the errors and his */
+    errlist errors;       /* branches out of reach */
+    uint32_t *his;        /* program addresses of its R_MIPS_HI16 words */
+    uint32_t nhis;        /* number of them */
+} relblock;
+
+/* fills in the field of a word that a relocation names, given the
+   value of the symbol and the address of the word. returns -1 if
+   the result does not fit the field */
+typedef int (*relocfn)(uint32_t *word, int32_t value, int32_t pos);
+
+/* links the objects at paths into a result */
+static int linkobjects(asm_result *res, threadpool *pool, const char *const *paths, int nobjs);
+
+/* closes the objects of a link and frees the arenas of its pieces */
+static void releaselink(asm_result *res);
+
+
+
+/* a word that was written out before the symbol it needs was
+   defined. it waits on a list per symbol until the symbol turns up */
+typedef struct fixup_s
+{
+    instrec rec;    /* the record, imm holds the program symbol id */
+    uint32_t addr;  /* address of the word */
+    uint32_t next;  /* next fixup of the same symbol + 1, 0 ends the list */
+} fixup;
+
+/* the fixups of a streamed run. resolved ones are reused, so the
+   array only grows with the number waiting at the same time */
+typedef struct backpatch_s
+{
+    arena *mem;         /* owns the arrays */
+    fixup *fixups;      /* every fixup */
+    uint32_t count;     /* fixups handed out */
+    uint32_t cap;       /* allocated fixups */
+    uint32_t free;      /* first reusable fixup + 1, 0 for none */
+    uint32_t *pending;  /* first fixup + 1 of every program symbol */
+    uint32_t npending;  /* allocated entries of pending */
+} backpatch;
+
+/* sets up an empty set of fixups owned by an arena */
+static void initbackpatch(backpatch *bp, arena *mem);
+
+/* keeps a record whose word was written without its symbol */
+static void addfixup(backpatch *bp, const instrec *rec, uint32_t addr);
+
+/* patches every word waiting for a symbol that is now defined */
+static void resolvefixups(backpatch *bp, const symtable *symbols, int id, objwriter *out,
+                          errlist *errors, arena *mem);
+
+/* reports the records still waiting, in address order, and leaves the
+   ones of a .globl or .extern symbol to another object */
+static void undefinedfixups(backpatch *bp, const symtable *symbols, errlist *errors, arena *mem,
+                            objwriter *out);
+
+
+
+/*************** functions *****************/
+
+/* checks if a view holds exactly a string */
+static int viewEq(strview view, const char *str)
+{
+    return strncmp(view.p, str, view.len) == 0 && str[view.len] == '\0';
+}
+
+/* takes in a register name without the $ and returns the register
+   number. numbers and the usual MIPS names are accepted, anything
+   else reads as register 0 */
+static int regToNum(const char *name, size_t len)
+{
+    int dec = 0;  /* decimal number */
+    size_t i;     /* iterator */
+
+    /* $N */
+    if (len > 0 && name[0] >= '0' && name[0] <= '9')
+    {
+        for (i = 0; i < len && name[i] >= '0' && name[i] <= '9'; i++)
+        {
+            dec = dec * 10 + (name[i] - '0');
+        }
+        return (i == len && dec <= REG_MASK) ? dec : 0;
+    }
+
+    /* bank letter and digit, the common case */
+    if (len == 2 && name[1] >= '0' && name[1] <= '9')
+    {
+        dec = name[1] - '0';
+        switch (name[0])
+        {
+        case 'v': return dec <= 1 ? 2 + dec : 0;
+        case 'a': return dec <= 3 ? 4 + dec : 0;
+        case 't': return dec <= 7 ? 8 + dec : (dec <= 9 ? 16 + dec : 0);
+        case 's': return dec <= 7 ? 16 + dec : (dec == 8 ? 30 : 0);
+        case 'k': return dec <= 1 ? 26 + dec : 0;
+        }
+        return 0;
+    }
+
+    /* named registers */
+    if (len == 4 && memcmp(name, "zero", 4) == 0) return 0;
+    if (len == 2 && memcmp(name, "at", 2) == 0) return 1;
+    if (len == 2 && memcmp(name, "gp", 2) == 0) return 28;
+    if (len == 2 && memcmp(name, "sp", 2) == 0) return 29;
+    if (len == 2 && memcmp(name, "fp", 2) == 0) return 30;
+    if (len == 2 && memcmp(name, "ra", 2) == 0) return 31;
+
+    return 0;
+}
+
+/* takes in the fields of an R type instruction and packs
+   them into a 32 bit word */
+static uint32_t encodeRType(int opcode, int rs1, int rs2, int rt, int sa, int funct)
+{
+    return ((uint32_t)(opcode & OPCODE_MASK) << OPCODE_SHIFT) |
+           ((uint32_t)(rs1 & REG_MASK) << RS_SHIFT) |
+           ((uint32_t)(rs2 & REG_MASK) << RT_SHIFT) |
+           ((uint32_t)(rt & REG_MASK) << RD_SHIFT) |
+           ((uint32_t)(sa & REG_MASK) << SA_SHIFT) |
+           ((uint32_t)funct & OPCODE_MASK);
+}
+
+/* takes in the fields of an I type instruction and packs
+   them into a 32 bit word */
+static uint32_t encodeIType(int opcode, int rs1, int rt, int imm)
+{
+    return ((uint32_t)(opcode & OPCODE_MASK) << OPCODE_SHIFT) |
+           ((uint32_t)(rs1 & REG_MASK) << RS_SHIFT) |
+           ((uint32_t)(rt & REG_MASK) << RT_SHIFT) |
+           ((uint32_t)imm & IMM_MASK);
+}
+
+/* takes in the fields of a J type instruction and packs
+   them into a 32 bit word, the target is a word address */
+static uint32_t encodeJType(int opcode, int target)
+{
+    return ((uint32_t)(opcode & OPCODE_MASK) << OPCODE_SHIFT) |
+           ((uint32_t)target & TARGET_MASK);
+}
+
+/* instruction descriptor table, indexed by the OP_ constants. every
+   R type instruction has opcode 0 (SPECIAL) and is told apart by its
+   function code */
+static const instdesc optable[OP_COUNT] =
+{
+    [OP_ADD]     = { "add",     RTYPE, 0x00, 0x20, SHAPE_RRR  }, /* 100000 */
+    [OP_ADDI]    = { "addi",    ITYPE, 0x08, 0x00, SHAPE_RRI  }, /* 001000 */
+    [OP_NOR]     = { "nor",     RTYPE, 0x00, 0x27, SHAPE_RRR  }, /* 100111 */
+    [OP_ORI]     = { "ori",     ITYPE, 0x0D, 0x00, SHAPE_RRI  }, /* 001101 */
+    [OP_SLL]     = { "sll",     RTYPE, 0x00, 0x00, SHAPE_RRS  }, /* 000000 */
+    [OP_LUI]     = { "lui",     ITYPE, 0x0F, 0x00, SHAPE_RI   }, /* 001111 */
+    [OP_SW]      = { "sw",      ITYPE, 0x2B, 0x00, SHAPE_RM   }, /* 101011 */
+    [OP_LW]      = { "lw",      ITYPE, 0x23, 0x00, SHAPE_RM   }, /* 100011 */
+    [OP_BNE]     = { "bne",     ITYPE, 0x05, 0x00, SHAPE_RRL  }, /* 000101 */
+    [OP_J]       = { "j",       JTYPE, 0x02, 0x00, SHAPE_L    }, /* 000010 */
+    [OP_LA]      = { "la",      ITYPE, 0x0F, 0x00, SHAPE_LA   }, /* lui + ori */
+
+    /* arithmetic and logical */
+    [OP_ADDU]    = { "addu",    RTYPE, 0x00, 0x21, SHAPE_RRR  }, /* 100001 */
+    [OP_SUB]     = { "sub",     RTYPE, 0x00, 0x22, SHAPE_RRR  }, /* 100010 */
+    [OP_SUBU]    = { "subu",    RTYPE, 0x00, 0x23, SHAPE_RRR  }, /* 100011 */
+    [OP_AND]     = { "and",     RTYPE, 0x00, 0x24, SHAPE_RRR  }, /* 100100 */
+    [OP_OR]      = { "or",      RTYPE, 0x00, 0x25, SHAPE_RRR  }, /* 100101 */
+    [OP_XOR]     = { "xor",     RTYPE, 0x00, 0x26, SHAPE_RRR  }, /* 100110 */
+    [OP_SLT]     = { "slt",     RTYPE, 0x00, 0x2A, SHAPE_RRR  }, /* 101010 */
+    [OP_SLTU]    = { "sltu",    RTYPE, 0x00, 0x2B, SHAPE_RRR  }, /* 101011 */
+
+    /* shifts */
+    [OP_SRL]     = { "srl",     RTYPE, 0x00, 0x02, SHAPE_RRS  }, /* 000010 */
+    [OP_SRA]     = { "sra",     RTYPE, 0x00, 0x03, SHAPE_RRS  }, /* 000011 */
+    [OP_SLLV]    = { "sllv",    RTYPE, 0x00, 0x04, SHAPE_RRV  }, /* 000100 */
+    [OP_SRLV]    = { "srlv",    RTYPE, 0x00, 0x06, SHAPE_RRV  }, /* 000110 */
+    [OP_SRAV]    = { "srav",    RTYPE, 0x00, 0x07, SHAPE_RRV  }, /* 000111 */
+
+    /* multiply and divide, the result is in hi and lo */
+    [OP_MULT]    = { "mult",    RTYPE, 0x00, 0x18, SHAPE_RR   }, /* 011000 */
+    [OP_MULTU]   = { "multu",   RTYPE, 0x00, 0x19, SHAPE_RR   }, /* 011001 */
+    [OP_DIV]     = { "div",     RTYPE, 0x00, 0x1A, SHAPE_RR   }, /* 011010 */
+    [OP_DIVU]    = { "divu",    RTYPE, 0x00, 0x1B, SHAPE_RR   }, /* 011011 */
+    [OP_MFHI]    = { "mfhi",    RTYPE, 0x00, 0x10, SHAPE_D    }, /* 010000 */
+    [OP_MTHI]    = { "mthi",    RTYPE, 0x00, 0x11, SHAPE_S    }, /* 010001 */
+    [OP_MFLO]    = { "mflo",    RTYPE, 0x00, 0x12, SHAPE_D    }, /* 010010 */
+    [OP_MTLO]    = { "mtlo",    RTYPE, 0x00, 0x13, SHAPE_S    }, /* 010011 */
+
+    /* jumps through a register and traps */
+    [OP_JR]      = { "jr",      RTYPE, 0x00, 0x08, SHAPE_S    }, /* 001000 */
+    [OP_JALR]    = { "jalr",    RTYPE, 0x00, 0x09, SHAPE_JALR }, /* 001001 */
+    [OP_SYSCALL] = { "syscall", RTYPE, 0x00, 0x0C, SHAPE_NONE }, /* 001100 */
+    [OP_BREAK]   = { "break",   RTYPE, 0x00, 0x0D, SHAPE_NONE }, /* 001101 */
+
+    /* branches, bgez and bltz are told apart by their rt field */
+    [OP_BEQ]     = { "beq",     ITYPE, 0x04, 0x00, SHAPE_RRL  }, /* 000100 */
+    [OP_BGEZ]    = { "bgez",    ITYPE, 0x01, 0x01, SHAPE_RL   }, /* 000001 */
+    [OP_BGTZ]    = { "bgtz",    ITYPE, 0x07, 0x00, SHAPE_RL   }, /* 000111 */
+    [OP_BLEZ]    = { "blez",    ITYPE, 0x06, 0x00, SHAPE_RL   }, /* 000110 */
+    [OP_BLTZ]    = { "bltz",    ITYPE, 0x01, 0x00, SHAPE_RL   }, /* 000001 */
+};
+
+/* perfect hash over the mnemonics. the key is the length, the first
+   three characters (0 past the end) and the last character. the
+   multipliers were searched offline so that every mnemonic in optable
+   lands in its own slot. OPHASH is evaluated by the compiler for the
+   slot table below */
+#define OPHASH_SIZE 256
+#define OPHASH(n, a, b, c, z) \
+    (((unsigned)(n)*43u + (unsigned)(a)*20u + (unsigned)(b) + \
+      (unsigned)(c)*10u + (unsigned)(z)*42u) & (OPHASH_SIZE-1))
+
+/* the hash key of every mnemonic in optable, X(op, key) */
+#define OPKEYS(X) \
+    X(OP_ADD,     3, 'a', 'd', 'd', 'd') \
+    X(OP_ADDI,    4, 'a', 'd', 'd', 'i') \
+    X(OP_NOR,     3, 'n', 'o', 'r', 'r') \
+    X(OP_ORI,     3, 'o', 'r', 'i', 'i') \
+    X(OP_SLL,     3, 's', 'l', 'l', 'l') \
+    X(OP_LUI,     3, 'l', 'u', 'i', 'i') \
+    X(OP_SW,      2, 's', 'w',  0,  'w') \
+    X(OP_LW,      2, 'l', 'w',  0,  'w') \
+    X(OP_BNE,     3, 'b', 'n', 'e', 'e') \
+    X(OP_J,       1, 'j',  0,   0,  'j') \
+    X(OP_LA,      2, 'l', 'a',  0,  'a') \
+    X(OP_ADDU,    4, 'a', 'd', 'd', 'u') \
+    X(OP_SUB,     3, 's', 'u', 'b', 'b') \
+    X(OP_SUBU,    4, 's', 'u', 'b', 'u') \
+    X(OP_AND,     3, 'a', 'n', 'd', 'd') \
+    X(OP_OR,      2, 'o', 'r',  0,  'r') \
+    X(OP_XOR,     3, 'x', 'o', 'r', 'r') \
+    X(OP_SLT,     3, 's', 'l', 't', 't') \
+    X(OP_SLTU,    4, 's', 'l', 't', 'u') \
+    X(OP_SRL,     3, 's', 'r', 'l', 'l') \
+    X(OP_SRA,     3, 's', 'r', 'a', 'a') \
+    X(OP_SLLV,    4, 's', 'l', 'l', 'v') \
+    X(OP_SRLV,    4, 's', 'r', 'l', 'v') \
+    X(OP_SRAV,    4, 's', 'r', 'a', 'v') \
+    X(OP_MULT,    4, 'm', 'u', 'l', 't') \
+    X(OP_MULTU,   5, 'm', 'u', 'l', 'u') \
+    X(OP_DIV,     3, 'd', 'i', 'v', 'v') \
+    X(OP_DIVU,    4, 'd', 'i', 'v', 'u') \
+    X(OP_MFHI,    4, 'm', 'f', 'h', 'i') \
+    X(OP_MTHI,    4, 'm', 't', 'h', 'i') \
+    X(OP_MFLO,    4, 'm', 'f', 'l', 'o') \
+    X(OP_MTLO,    4, 'm', 't', 'l', 'o') \
+    X(OP_JR,      2, 'j', 'r',  0,  'r') \
+    X(OP_JALR,    4, 'j', 'a', 'l', 'r') \
+    X(OP_SYSCALL, 7, 's', 'y', 's', 'l') \
+    X(OP_BREAK,   5, 'b', 'r', 'e', 'k') \
+    X(OP_BEQ,     3, 'b', 'e', 'q', 'q') \
+    X(OP_BGEZ,    4, 'b', 'g', 'e', 'z') \
+    X(OP_BGTZ,    4, 'b', 'g', 't', 'z') \
+    X(OP_BLEZ,    4, 'b', 'l', 'e', 'z') \
+    X(OP_BLTZ,    4, 'b', 'l', 't', 'z')
+
+/* slot table, holds descriptor index + 1, 0 marks an empty slot */
+#define OPSLOT(op, n, a, b, c, z) [OPHASH(n, a, b, c, z)] = op + 1,
+static const unsigned char opslots[OPHASH_SIZE] =
+{
+    OPKEYS(OPSLOT)
+};
+
+/* every slot has to be taken once. a switch cannot have two case
+   labels with the same value, so a mnemonic added to OPKEYS that lands
+   in a taken slot fails to compile, whatever warnings are on. the
+   function is never called */
+#define OPCASE(op, n, a, b, c, z) case OPHASH(n, a, b, c, z):
+static __attribute__((unused)) void opslotcheck(unsigned slot)
+{
+    switch (slot)
+    {
+    OPKEYS(OPCASE)
+        break;
+    }
+}
+
+/* fails to compile unless every mnemonic in optable has a key */
+#define OPONE(op, n, a, b, c, z) + 1
+typedef char opkeys_count_check[(0 OPKEYS(OPONE)) == OP_COUNT ? 1 : -1];
+
+/* takes in a mnemonic and returns its index in the descriptor
+   table, or -1 if it is not a known opcode */
+static int lookupOp(strview name)
+{
+    size_t len = name.len;      /* length of mnemonic */
+    unsigned char c[3] = {0};   /* first three characters */
+    int slot;                   /* slot in the hash table */
+
+    /* nothing to look up */
+    if (len == 0)
+    {
+        return -1;
+    }
+
+    /* grab the characters used as hash key */
+    memcpy(c, name.p, len < 3 ? len : 3);
+    slot = opslots[OPHASH(len, c[0], c[1], c[2], (unsigned char)name.p[len-1])];
+
+    /* empty slot or a different mnemonic hashed here */
+    if (slot == 0 || !viewEq(name, optable[slot-1].name))
+    {
+        return -1;
+    }
+
+    return slot - 1;
+}
+
+/* this function takes in a symbol table, the name, address, line and
+   SYM_ flags of a label and defines it, adding an error to the list if
+   it was already defined */
+static void definelabel(symtable *symbols, errlist *errors, arena *mem,
+                        strview name, int address, int line, uint32_t flags)
+{
+    int id;             /* symbol id */
+    errnode *temperr;   /* temporary error node pointer */
+
+    /* check if symbol already exists, if so, generate error */
+    id = findsymbol(symbols, name.p, name.len);
+    if (id >= 0 && symbols->syms[id].address != SYM_UNDEFINED)
+    {
+        /* allocate error node and fill details */
+        temperr = arenaalloc(mem, sizeof(errnode));
+        temperr->errtype = ERR_MULTSYMBOL;
+        temperr->lineno = line;
+        temperr->symbol = arenastrndup(mem, name.p, name.len);
+        add_err(errors, temperr);
+        return;
+    }
+
+    if (id < 0)
+    {
+        /* symbol isnt defined yet, add to symbols table */
+        id = addsymbol(symbols, name.p, name.len, address);
+    }
+    /* symbol was used before or just added, define it now */
+    symbols->syms[id].address = address;
+    symbols->syms[id].line = line;
+    symbols->syms[id].flags |= flags;
+}
+
+/* this function takes in a symbol table, the source, the ntoks tokens
+   of a .globl or .extern line and the index of the first name after
+   the directive, and sets flag on every symbol the line names. the
+   lexer only keeps MAX_TOKS tokens, so once a list fills them the
+   rest of the line is lexed again from the end of the last name */
+static void declaresymbols(symtable *symbols, const srcfile *src, const token *toks,
+                           int ntoks, int first, uint32_t flag)
+{
+    srcfile rest;          /* the line past the tokens kept */
+    token more[MAX_TOKS];  /* tokens of the rest of the line */
+    const token *list;     /* tokens being declared */
+    int count;             /* number of them */
+    int n;                 /* token index */
+    int id;                /* symbol id */
+
+    memset(&rest, 0, sizeof(rest));
+    rest.data     = src->data;
+    rest.size     = src->pos;
+    rest.winpos   = (size_t)-1;
+    rest.classify = src->classify;
+
+    list = toks;
+    count = ntoks;
+    for (n = first;; n = 0)
+    {
+        for (; n < count && (list[n].type == TOK_MNEMONIC || list[n].type == TOK_SYMBOL); n++)
+        {
+            id = refsymbol(symbols, list[n].text.p, list[n].text.len);
+            symbols->syms[id].flags |= flag;
+        }
+        /* the list ended before the tokens did, or the line fitted */
+        if (n < MAX_TOKS)
+        {
+            return;
+        }
+        rest.pos = (size_t)(list[n - 1].text.p + list[n - 1].text.len - rest.data);
+        if (!lexLine(&rest, more, &count))
+        {
+            return;
+        }
+        list = more;
+    }
+}
+
+/* this function takes in the program symbols, the source and the
+   offset of the line after .text and reads the .globl and .extern
+   lines above it. everything else there is skipped */
+static void declarepreamble(symtable *symbols, const srcfile *src, size_t end)
+{
+    srcfile pre;          /* the lines before the text */
+    token toks[MAX_TOKS]; /* tokens of the current line */
+    int ntoks;            /* number of tokens on the line */
+
+    memset(&pre, 0, sizeof(pre));
+    pre.data     = src->data;
+    pre.size     = end;
+    pre.winpos   = (size_t)-1;
+    pre.classify = src->classify;
+
+    while (lexLine(&pre, toks, &ntoks))
+    {
+        if (ntoks > 0 && toks[0].type == TOK_DIRECTIVE && viewEq(toks[0].text, ".globl"))
+        {
+            declaresymbols(symbols, &pre, toks, ntoks, 1, SYM_GLOBAL);
+        }
+        else if (ntoks > 0 && toks[0].type == TOK_DIRECTIVE && viewEq(toks[0].text, ".extern"))
+        {
+            declaresymbols(symbols, &pre, toks, ntoks, 1, SYM_EXTERN);
+        }
+    }
+}
+
+/* this function runs pass one over chunk i of the array at arg. it
+   reads the instructions or data directives of the chunk into the
+   chunk's own lists. label addresses and line numbers are counted
+   from the start of the chunk and symbol ids are the chunk's own,
+   the merge turns them into program addresses, lines and ids. so
+   what pass one makes of a chunk only depends on its text */
+static void passone(void *arg, int i)
+{
+    chunk *c = (chunk *)arg + i;  /* chunk to read */
+    token toks[MAX_TOKS];         /* tokens of the current line */
+    int ntoks;                    /* number of tokens on the line */
+    const token *tok;             /* next token to handle */
+    const token *ops;             /* operands of the instruction */
+    instrec rec;                  /* record being filled in */
+    const instdesc *desc;         /* descriptor of the opcode */
+    errnode *temperr;             /* temporary error node pointer */
+    int counter = 0;              /* line counter within the chunk */
+    int opid;                     /* descriptor index of the opcode */
+    int word;                     /* value of a data word */
+    int repeat;                   /* number of data words */
+    int k;                        /* iterator */
+
+    /* Loop through the chunk, executing commands. each line is
+       lexed once into tokens that point into the file */
+    while (lexLine(&c->src, toks, &ntoks))
+    {
+        /* increment line counter */
+        counter++;
+
+        /* blank and comment lines have no tokens */
+        if (ntoks == 0)
+        {
+            continue;
+        }
+        tok = toks;
+
+        /* check to see if we have a label, if so, insert it into the
+           symbols table at the next address of its section */
+        if (tok->type == TOK_LABEL)
+        {
+            definelabel(&c->symbols, &c->errors, &c->mem, tok->text,
+                        c->section == SECT_TEXT ? (int)c->insts.count : (int)c->data.count,
+                        counter, c->section == SECT_DATA ? SYM_DATA : 0);
+            tok++;
+        }
+
+        /* .globl and .extern may be in either section */
+        if (tok->type == TOK_DIRECTIVE && viewEq(tok->text, ".globl"))
+        {
+            declaresymbols(&c->symbols, &c->src, toks, ntoks, (int)(tok - toks) + 1, SYM_GLOBAL);
+            continue;
+        }
+        if (tok->type == TOK_DIRECTIVE && viewEq(tok->text, ".extern"))
+        {
+            declaresymbols(&c->symbols, &c->src, toks, ntoks, (int)(tok - toks) + 1, SYM_EXTERN);
+            continue;
+        }
+
+        if (c->section == SECT_TEXT)
+        {
+            /* other directives do nothing in the text section, the
+               .data line that ends it was found before the split */
+            if (tok->type == TOK_DIRECTIVE)
+            {
+                continue;
+            }
+
+            /* label on its own, it marks the next instruction */
+            if (tok->type == TOK_END)
+            {
+                continue;
+            }
+
+            /* the rest of the tokens are the operands */
+            ops = tok + 1;
+
+            /* clear out the record and set the line number,
+               the address is the index the record lands at */
+            memset(&rec, 0, sizeof(rec));
+            rec.lineno = counter;
+
+            /* ok, label was handled if there was one, ready to insert instruction.
+               look up the opcode descriptor and read the operands its shape
+               calls for */
+            opid = tok->type == TOK_MNEMONIC ? lookupOp(tok->text) : -1;
+            if (opid < 0)
+            {
+                /* bad opcode given, throw error */
+                temperr = arenaalloc(&c->mem, sizeof(errnode));
+                temperr->errtype = ERR_OPCODE;
+                temperr->lineno = counter;
+                temperr->opcode = arenastrndup(&c->mem, tok->text.p, tok->text.len);
+
+                add_err(&c->errors, temperr);
+
+                if (c->trace->level)
+                {
+                    trace(c->trace, "Line %d: illegal opcode %.*s\n", c->linebase + counter,
+                          (int)tok->text.len, tok->text.p);
+                }
+
+                /* nothing to add to the instruction list */
+                continue;
+            }
+
+            desc = &optable[opid];
+            rec.op = (uint16_t)opid;
+
+            switch (desc->shape)
+            {
+            /* for R type instructions rt is the rd field, rs1 the
+               rs field and rs2 the rt field */
+            case SHAPE_RRR:
+                rec.rt = ops[0].reg;
+                rec.rs1 = ops[1].reg;
+                rec.rs2 = ops[2].reg;
+                break;
+
+            case SHAPE_RRV:
+                /* sllv rd, rt, rs shifts rt by rs */
+                rec.rt = ops[0].reg;
+                rec.rs2 = ops[1].reg;
+                rec.rs1 = ops[2].reg;
+                break;
+
+            case SHAPE_RR:
+                rec.rs1 = ops[0].reg;
+                rec.rs2 = ops[1].reg;
+                break;
+
+            case SHAPE_D:
+                rec.rt = ops[0].reg;
+                break;
+
+            case SHAPE_S:
+                rec.rs1 = ops[0].reg;
+                break;
+
+            case SHAPE_JALR:
+                /* the return address goes to $ra unless one is named */
+                if (ops[1].type == TOK_REG)
+                {
+                    rec.rt = ops[0].reg;
+                    rec.rs1 = ops[1].reg;
+                }
+                else
+                {
+                    rec.rt = 31;
+                    rec.rs1 = ops[0].reg;
+                }
+                break;
+
+            case SHAPE_NONE:
+                break;
+
+            case SHAPE_RRI:
+                rec.rt = ops[0].reg;
+                rec.rs1 = ops[1].reg;
+                rec.imm = ops[2].val & IMM_MASK;
+                break;
+
+            case SHAPE_RRS:
+                /* the shifted register goes in the rt field. the
+                   shift amount is a number, $n is taken as well */
+                rec.rt = ops[0].reg;
+                rec.rs2 = ops[1].reg;
+                rec.sa = (ops[2].type == TOK_REG ? ops[2].reg : ops[2].val) & REG_MASK;
+                break;
+
+            case SHAPE_RI:
+                rec.rt = ops[0].reg;
+                rec.imm = ops[1].val & IMM_MASK;
+                break;
+
+            case SHAPE_RM:
+                /* offset(base) was split up by the lexer */
+                rec.rt = ops[0].reg;
+                rec.imm = ops[1].val & IMM_MASK;
+                rec.rs1 = ops[1].reg;
+                break;
+
+            case SHAPE_RRL:
+                /* beq rs, rt, label. the label is looked up here once,
+                   pass two only indexes the symbols by its id */
+                rec.rs1 = ops[0].reg;
+                rec.rt = ops[1].reg;
+                rec.imm = refsymbol(&c->symbols, ops[2].text.p, ops[2].text.len);
+                rec.flags = REC_SYMBOL;
+                break;
+
+            case SHAPE_RL:
+                rec.rs1 = ops[0].reg;
+                rec.rt = (uint8_t)desc->funct;
+                rec.imm = refsymbol(&c->symbols, ops[1].text.p, ops[1].text.len);
+                rec.flags = REC_SYMBOL;
+                break;
+
+            case SHAPE_L:
+                rec.imm = refsymbol(&c->symbols, ops[0].text.p, ops[0].text.len);
+                rec.flags = REC_SYMBOL;
+                break;
+
+            case SHAPE_LA:
+                /* la loads an address with lui and ori. a symbol is
+                   split into halves in pass two, a number right away */
+                rec.rt = ops[0].reg;
+                if (ops[1].type == TOK_SYMBOL)
+                {
+                    rec.imm = refsymbol(&c->symbols, ops[1].text.p, ops[1].text.len);
+                }
+                else
+                {
+                    rec.imm = ops[1].val;
+                }
+
+                //lui
+                rec.op = OP_LUI;
+                if (ops[1].type == TOK_SYMBOL)
+                {
+                    rec.flags = REC_SYMBOL | REC_HI;
+                    add_inst(&c->mem, &c->insts, &rec);
+                    rec.flags = REC_SYMBOL | REC_LO;
+                }
+                else
+                {
+                    word = rec.imm;
+                    rec.imm = ((uint32_t)word >> 16) & IMM_MASK;
+                    add_inst(&c->mem, &c->insts, &rec);
+                    rec.imm = word & IMM_MASK;
+                }
+
+                //ori
+                rec.op = OP_ORI;
+                rec.rs1 = rec.rt;
+                break;
+            }
+            /* there was no error so add the record to the instruction list */
+            add_inst(&c->mem, &c->insts, &rec);
+
+            /* this is the only check made per line, so tracing
+               costs nothing when it is off */
+            if (c->trace->level)
+            {
+                trace(c->trace, "Line %d: %.*s\n", c->linebase + counter,
+                      (int)(toks[ntoks-1].text.p + toks[ntoks-1].text.len - tok->text.p),
+                      tok->text.p);
+                if (c->trace->level > 1)
+                {
+                    trace(c->trace, "... %s opcode %d funct %d rt %d rs1 %d rs2 %d sa %d imm %d\n",
+                          desc->name, desc->opcode, desc->funct, rec.rt, rec.rs1, rec.rs2,
+                          rec.sa, rec.imm);
+                }
+            }
+        }
+        else
+        {
+            /* we're in the data section, the line should have a
+               label, directive, arguments */
+
+            /* check for .word directive, value:count */
+            if (tok->type == TOK_DIRECTIVE && viewEq(tok->text, ".word"))
+            {
+                word = tok[1].val;
+                repeat = tok[2].type == TOK_COLON ? tok[3].val : 1;
+
+                /* loop through and add data field for X amount of entries */
+                for (k = 0; k < repeat; k++)
+                {
+                    /* add new word to data list */
+                    add_dataword(&c->mem, &c->data, (uint32_t)word);
+                }
+            }
+            /* check for .resw directive */
+            else if (tok->type == TOK_DIRECTIVE && viewEq(tok->text, ".resw"))
+            {
+                /* resw statements zero out the data field */
+                repeat = tok[1].val;
+
+                /* loop through and create field for X amount */
+                for (k = 0; k < repeat; k++)
+                {
+                    /* add new word to data list */
+                    add_dataword(&c->mem, &c->data, 0);
+                }
+            } /* end if .resw */
+        } /* end: else data section */
+    } /* end while lexLine */
+}
+
+/* this function counts the lines of chunk i of the array at arg */
+static void countlines(void *arg, int i)
+{
+    chunk *c = (chunk *)arg + i;            /* chunk to count */
+    const char *p = c->src.data;            /* scan position */
+    const char *end = p + c->src.size;      /* end of the chunk */
+    int lines = 0;                          /* newlines seen */
+
+    while (p < end && (p = memchr(p, '\n', (size_t)(end - p))) != NULL)
+    {
+        lines++;
+        p++;
+    }
+    /* last line of the file without a newline */
+    if (c->src.size > 0 && c->src.data[c->src.size - 1] != '\n')
+    {
+        lines++;
+    }
+    c->lines = lines;
+}
+
+/* this function copies the records and data words of chunk i of the
+   array at arg into the program arrays, turning chunk symbol ids
+   and line numbers into program ones */
+static void placechunk(void *arg, int i)
+{
+    chunk *c = (chunk *)arg + i;             /* chunk to copy */
+    instrec *out = c->instout + c->instbase; /* where its records go */
+    size_t n;                                /* record iterator */
+
+    for (n = 0; n < c->insts.count; n++)
+    {
+        out[n] = c->insts.recs[n];
+        out[n].lineno += (uint32_t)c->linebase;
+        if (out[n].flags & REC_SYMBOL)
+        {
+            out[n].imm = c->symmap[out[n].imm];
+        }
+    }
+    if (c->data.count > 0)
+    {
+        memcpy(c->dataout + c->database, c->data.words, c->data.count * sizeof(uint32_t));
+    }
+}
+
+/* this function merges the symbols of chunk c into the program table,
+   so the first definition of a symbol wins and any later one is an
+   error, just as if the file were read in one go. the chunks have to
+   be merged in file order. ntext is the number of instructions in the
+   program, data addresses follow them. the errors of the chunk are
+   added after any found by the merge */
+static void mergechunk(symtable *symbols, errlist *errors, arena *mem,
+                       chunk *c, size_t ntext)
+{
+    int id;            /* chunk symbol id */
+    int gid;           /* program symbol id */
+    int addr;          /* address of the symbol */
+    const char *name;  /* symbol name */
+    errnode *temperr;  /* temporary error node pointer */
+    errnode *nexterr;  /* error after the one being merged */
+
+    c->symmap = arenaalloc(&c->mem, (c->symbols.count + 1) * sizeof(int));
+    for (id = 0; id < (int)c->symbols.count; id++)
+    {
+        name = c->symbols.names + c->symbols.syms[id].name;
+        gid = refsymbol(symbols, name, strlen(name));
+        c->symmap[id] = gid;
+        symbols->syms[gid].flags |= c->symbols.syms[id].flags;
+
+        addr = c->symbols.syms[id].address;
+        if (addr == SYM_UNDEFINED)
+        {
+            /* only used in this chunk */
+            continue;
+        }
+        addr += c->section == SECT_TEXT ? (int)c->instbase : (int)(ntext + c->database);
+
+        if (symbols->syms[gid].address == SYM_UNDEFINED)
+        {
+            symbols->syms[gid].address = addr;
+            symbols->syms[gid].line = c->linebase + c->symbols.syms[id].line;
+        }
+        else
+        {
+            /* defined in an earlier chunk, allocate error node and fill details */
+            temperr = arenaalloc(mem, sizeof(errnode));
+            temperr->errtype = ERR_MULTSYMBOL;
+            temperr->lineno = c->linebase + c->symbols.syms[id].line;
+            temperr->symbol = symbols->names + symbols->syms[gid].name;
+            add_err(errors, temperr);
+        }
+    }
+
+    /* errors are kept in line order, so the ones from the chunk
+       slot in after any found by the merge */
+    for (temperr = c->errors.head; temperr != NULL; temperr = nexterr)
+    {
+        nexterr = temperr->next;
+        temperr->lineno += c->linebase;
+        add_err(errors, temperr);
+    }
+}
+
+/* this function returns 1 if a record is a branch, whose symbol
+   operand is encoded as an offset from the word after it */
+static int isbranch(const instrec *rec)
+{
+    int shape = optable[rec->op].shape;  /* operand shape of the opcode */
+
+    return shape == SHAPE_RRL || shape == SHAPE_RL;
+}
+
+/* this function takes in the address of a branch target and of the
+   branch and sets offset to the number of words from the word after
+   the branch to the target. returns -1 if it does not fit the signed
+   16 bit field */
+static int branchoffset(int target, size_t pos, int *offset)
+{
+    long words = (long)target - (long)pos - 1;  /* the offset */
+
+    if (words < INT16_MIN || words > INT16_MAX)
+    {
+        return -1;
+    }
+    *offset = (int)words;
+    return 0;
+}
+
+/* this function takes in an error list, the arena its nodes come
+   from, a line and the name of a label and adds an error about a
+   branch on that line that cannot reach the label */
+static void rangeerror(errlist *errors, arena *mem, int lineno, const char *symbol)
+{
+    errnode *temperr;  /* temporary error node pointer */
+
+    temperr = arenaalloc(mem, sizeof(errnode));
+    temperr->errtype = ERR_RANGE;
+    temperr->lineno = lineno;
+    temperr->symbol = symbol;
+    add_err(errors, temperr);
+}
+
+/* this function takes in a record and the address of its symbol
+   operand, if it has one, and assembles it into a word. for a branch
+   the address is already the offset */
+static uint32_t encoderec(const instrec *rec, int addr)
+{
+    const instdesc *desc = &optable[rec->op];  /* descriptor of the opcode */
+
+    /* check for RTYPE instruction and format acoordingly */
+    if (desc->format == RTYPE)
+    {
+        /* pack fields into the instruction word */
+        return encodeRType(desc->opcode, rec->rs1,
+                rec->rs2, rec->rt, rec->sa, desc->funct);
+    }
+    /* check for ITYPE instruction and format acoordingly */
+    else if (desc->format == ITYPE)
+    {
+        /* pack fields into the instruction word */
+        return encodeIType(desc->opcode, rec->rs1,
+                rec->rt, (rec->flags & REC_SYMBOL) ? addr : rec->imm);
+    }
+    /* JTYPE, assemble instruction with the symbol address */
+    return encodeJType(desc->opcode, addr);
+}
+
+/* this function runs pass two over block i of the array at arg. it
+   assembles the records of the block into words, reading the symbol
+   table only, so blocks can be encoded on any thread */
+static void passtwo(void *arg, int i)
+{
+    encodeblock *b = (encodeblock *)arg + i;  /* block to encode */
+    const symtable *symbols = b->symbols;     /* program symbols */
+    uint32_t *words = b->insts->words;        /* assembled words */
+    const instrec *currec;                    /* record being assembled */
+    errnode *temperr;                         /* temporary error node pointer */
+    int addr;                                 /* address of the symbol operand */
+    size_t n;                                 /* record iterator */
+
+    /* loop through and assemble instructions */
+    for (n = b->start; n < b->end; n++)
+    {
+        currec = &b->insts->recs[n];
+
+        /* look up the address of a symbol operand by its id */
+        addr = 0;
+        if (currec->flags & REC_SYMBOL)
+        {
+            /* check and see if symbol is defined in the symbols table.
+               one defined in another object is left 0 for the linker */
+            addr = symbols->syms[currec->imm].address;
+            if (addr == SYM_UNDEFINED && (symbols->syms[currec->imm].flags & (SYM_GLOBAL | SYM_EXTERN)))
+            {
+                words[n] = encoderec(currec, 0);
+                continue;
+            }
+            if (addr == SYM_UNDEFINED)
+            {
+                /* need to generate an error, symbol is invalid. la
+                   makes two records, only the first one reports it */
+                if (!(currec->flags & REC_LO))
+                {
+                    /* allocate error node and fill details */
+                    temperr = arenaalloc(&b->mem, sizeof(errnode));
+                    temperr->errtype = ERR_UNDEFSYMBOL;
+                    temperr->lineno = currec->lineno;
+                    temperr->symbol = symbols->names + symbols->syms[currec->imm].name;
+
+                    /* add error node to the block's error list */
+                    add_err(&b->errors, temperr);
+                }
+                continue;
+            }
+            if (currec->flags & REC_HI)
+            {
+                addr = (int)((uint32_t)addr >> 16);
+            }
+            else if (isbranch(currec) && branchoffset(addr, n, &addr) != 0)
+            {
+                /* a branch counts words from the one after it */
+                rangeerror(&b->errors, &b->mem, (int)currec->lineno,
+                           symbols->names + symbols->syms[currec->imm].name);
+                continue;
+            }
+        }
+
+        words[n] = encoderec(currec, addr);
+    } /* end for */
+}
+
+/* this function takes in the source, the bytes [from, end) to look
+   at, a directive and a flag. it returns the offset of the line after
+   the first line that holds the directive, or NO_SECTION if there is
+   none. with anywhere set the directive can be any token of the line,
+   otherwise it has to follow the label if there is one */
+static size_t searchsection(srcfile *src, size_t from, size_t end, const char *dir, int anywhere)
+{
+    size_t len = strlen(dir);  /* length of directive */
+    const char *hit;           /* candidate match */
+    size_t start;              /* start of its line */
+    token toks[MAX_TOKS];      /* tokens of the line */
+    int ntoks;                 /* number of tokens */
+    int k;                     /* iterator */
+
+    while (from + len <= end &&
+           (hit = memchr(src->data + from, dir[0], end - from)) != NULL)
+    {
+        from = (size_t)(hit - src->data);
+        if (from + len > src->size || memcmp(hit, dir, len) != 0)
+        {
+            from++;
+            continue;
+        }
+
+        /* back up to the start of the line and lex it */
+        start = from;
+        while (start > 0 && src->data[start-1] != '\n')
+        {
+            start--;
+        }
+        src->pos = start;
+        lexLine(src, toks, &ntoks);
+
+        k = (ntoks > 0 && toks[0].type == TOK_LABEL) ? 1 : 0;
+        for (; k < ntoks; k++)
+        {
+            if (toks[k].type == TOK_DIRECTIVE && viewEq(toks[k].text, dir))
+            {
+                return src->pos;
+            }
+            if (!anywhere)
+            {
+                break;
+            }
+        }
+
+        /* not the directive, carry on after this line */
+        from = src->pos;
+    }
+    return NO_SECTION;
+}
+
+/* this function looks for a directive like searchsection, from an
+   offset to the end of the file. it returns the size of the file if
+   the directive is not there */
+static size_t findsection(srcfile *src, size_t from, const char *dir, int anywhere)
+{
+    size_t pos = searchsection(src, from, src->size, dir, anywhere);  /* line after it */
+
+    return pos == NO_SECTION ? src->size : pos;
+}
+
+/* this function sets up a chunk over the bytes [start, stop) of
+   the source */
+static void initchunk(chunk *c, const srcfile *src, size_t start, size_t stop,
+                      int section, tracer *trace)
+{
+    memset(c, 0, sizeof(chunk));
+    c->src.data     = src->data + start;
+    c->src.size     = stop - start;
+    c->src.winpos   = (size_t)-1;
+    c->src.classify = src->classify;
+    c->section      = section;
+    c->trace        = trace;
+    initarena(&c->mem);
+    initsymtable(&c->symbols, &c->mem);
+}
+
+/* this function returns where a chunk of about size bytes that
+   starts at start ends, after the line that crosses the target but
+   not past end */
+static size_t chunkend(const srcfile *src, size_t start, size_t end, size_t size)
+{
+    const char *nl;  /* newline ending the chunk */
+    size_t stop;     /* end of the chunk */
+
+    stop = end - start > size ? start + size : end;
+    if (stop < end)
+    {
+        nl = memchr(src->data + stop, '\n', end - stop);
+        stop = nl ? (size_t)(nl - src->data) + 1 : end;
+    }
+    return stop;
+}
+
+/* this function takes in the source and the bytes [start, end) of
+   one section and splits them into chunks of about size bytes that
+   end on line boundaries. the chunks are set up at chunks and their
+   number is returned */
+static int splitsection(const srcfile *src, size_t start, size_t end, size_t size,
+                        int section, tracer *trace, chunk *chunks)
+{
+    size_t stop;     /* end of the chunk */
+    int n = 0;       /* chunks made */
+
+    while (start < end)
+    {
+        stop = chunkend(src, start, end, size);
+        initchunk(&chunks[n++], src, start, stop, section, trace);
+        start = stop;
+    }
+    return n;
+}
+
+/* this function splits the bytes [start, end) of one section into
+   chunks for the cache. a chunk ends after a line that cutline picks,
+   once it has CACHE_CHUNK_MIN bytes, so the boundaries depend on the
+   lines around them and not on where the section starts. only the
+   lines past the minimum are looked at. the number of chunks set up
+   at chunks is returned */
+static int splitcached(const srcfile *src, size_t start, size_t end, int section,
+                       tracer *trace, const char *cachedir, chunk *chunks)
+{
+    const char *nl;   /* newline ending a line */
+    size_t pos;       /* where the search for a cut goes on */
+    size_t stop;      /* end of the chunk */
+    int n = 0;        /* chunks made */
+
+    while (start < end)
+    {
+        stop = end;
+        pos = start + CACHE_CHUNK_MIN - 1;
+        while (pos < end && pos - start < CACHE_CHUNK_MAX &&
+               (nl = memchr(src->data + pos, '\n', end - pos)) != NULL)
+        {
+            pos = (size_t)(nl - src->data) + 1;
+            if (cutline(nl) || pos - start >= CACHE_CHUNK_MAX)
+            {
+                stop = pos;
+                break;
+            }
+        }
+
+        initchunk(&chunks[n], src, start, stop, section, trace);
+        chunks[n++].cachedir = cachedir;
+        start = stop;
+    }
+    return n;
+}
+
+/* this function runs pass one over chunk i of the array at arg
+   through the cache. a chunk found in the cache is mapped in as it
+   is, anything else is read and then stored for the next run */
+static void cachedpassone(void *arg, int i)
+{
+    chunk *c = (chunk *)arg + i;  /* chunk to read */
+
+    chunkkey(c);
+    if (cacheload(c) == 0)
+    {
+        return;
+    }
+    passone(arg, i);
+    cachestore(c);
+}
+
+/* this function encodes chunk i of the array at arg, which went
+   through the cache. its words are copied into place and only the
+   records that need a symbol are encoded, reading the program symbol
+   table. the data words are copied along */
+static void encodechunk(void *arg, int i)
+{
+    chunk *c = (chunk *)arg + i;                 /* chunk to encode */
+    const symtable *symbols = c->program;        /* program symbols */
+    uint32_t *words = c->wordsout + c->instbase; /* where its words go */
+    const instrec *currec;                       /* record being assembled */
+    errnode *temperr;                            /* temporary error node pointer */
+    int gid;                                     /* program symbol id */
+    int addr;                                    /* address of the symbol operand */
+    uint32_t n;                                  /* fixup iterator */
+
+    if (c->insts.count > 0)
+    {
+        memcpy(words, c->words, c->insts.count * sizeof(uint32_t));
+    }
+    for (n = 0; n < c->nfix; n++)
+    {
+        currec = &c->fixrecs[n];
+        gid = c->symmap[currec->imm];
+        addr = symbols->syms[gid].address;
+        if (addr == SYM_UNDEFINED && (symbols->syms[gid].flags & (SYM_GLOBAL | SYM_EXTERN)))
+        {
+            words[c->fixidx[n]] = encoderec(currec, 0);
+            continue;
+        }
+        if (addr == SYM_UNDEFINED)
+        {
+            /* la makes two records, only the first one reports it */
+            if (!(currec->flags & REC_LO))
+            {
+                temperr = arenaalloc(&c->mem, sizeof(errnode));
+                temperr->errtype = ERR_UNDEFSYMBOL;
+                temperr->lineno = c->linebase + (int)currec->lineno;
+                temperr->symbol = symbols->names + symbols->syms[gid].name;
+                add_err(&c->undefs, temperr);
+            }
+            continue;
+        }
+        if (currec->flags & REC_HI)
+        {
+            addr = (int)((uint32_t)addr >> 16);
+        }
+        else if (isbranch(currec) && branchoffset(addr, c->instbase + c->fixidx[n], &addr) != 0)
+        {
+            /* reported with the undefined symbols, the lists of
+               every chunk are merged the same way */
+            rangeerror(&c->undefs, &c->mem, c->linebase + (int)currec->lineno,
+                       symbols->names + symbols->syms[gid].name);
+            continue;
+        }
+        words[c->fixidx[n]] = encoderec(currec, addr);
+    }
+
+    if (c->data.count > 0)
+    {
+        memcpy(c->dataout + c->database, c->data.words, c->data.count * sizeof(uint32_t));
+    }
+}
+
+
+/* what came out of assembling one source, everything it points to
+   lives in the arena of its context or in the arenas of the pieces */
+struct asm_result
+{
+    asm_ctx *ctx;            /* context that owns the result */
+    srcfile src;             /* the source, kept for the err file */
+    int open;                /* src has to be closed */
+    int status;              /* ASM_OK or ASM_ERRORS */
+
+    uint32_t *words;         /* instructions, then data words */
+    size_t ntext;            /* number of instructions */
+    size_t nwords;           /* number of words */
+
+    const instrec *recs;     /* records of the instructions, NULL when
+                                the cache was used */
+    symtable symbols;        /* program symbols */
+    errlist *errors;         /* errors in line order */
+    errnode **diags;         /* the same errors, indexed */
+
+    /* pieces of the passes, their arenas hold some of the errors */
+    chunk *chunks;           /* pieces of pass one */
+    int nchunks;             /* number of pieces */
+    encodeblock *blocks;     /* pieces of pass two */
+    int nblocks;             /* number of pieces */
+    linkobj *objs;           /* objects of a link */
+    int nobjs;               /* number of them */
+    relblock *relblocks;     /* runs of their relocations */
+    int nrelblocks;          /* number of runs */
+    uint32_t *hiwords;       /* words of a link with the upper half of
+                                an la address, the lower half follows */
+    size_t nhiwords;         /* number of them */
+};
+
+/* a context to assemble with. it keeps the pool, the arena and the
+   trace buffer between calls, and owns the one result it hands out */
+struct asm_ctx
+{
+    threadpool pool;         /* workers for both passes */
+    threadpool serial;       /* pool without workers, for traced runs */
+    arena mem;               /* owns everything of the result */
+    tracer trace;            /* trace buffer */
+    const char *cachedir;    /* cache directory of the current call */
+    asm_result result;       /* the current result */
+};
+
+/* this function hands the errors of a run to its result along with
+   an index of them and sets the status */
+static void finishresult(asm_result *res, errlist *errors)
+{
+    errnode *temperr;  /* error being indexed */
+    int k = 0;         /* its index */
+
+    res->errors = errors;
+    res->status = errors->count > 0 ? ASM_ERRORS : ASM_OK;
+
+    res->diags = arenaalloc(&res->ctx->mem, (errors->count + 1) * sizeof(errnode *));
+    for (temperr = errors->head; temperr != NULL; temperr = temperr->next)
+    {
+        res->diags[k++] = temperr;
+    }
+}
+
+/* this function takes in a result whose source is open and runs
+   both passes over it on the pool, filling in the words, symbols
+   and errors of the result. everything is allocated from the arena
+   of the context */
+static void assemble(asm_result *res, threadpool *pool)
+{
+    arena *mem = &res->ctx->mem;   /* owns everything */
+    tracer *trace = &res->ctx->trace;  /* trace of the assembly */
+    srcfile *src = &res->src;      /* the asm file */
+    const char *cachedir = res->ctx->cachedir;  /* cache directory, NULL for none */
+
+    /* section bounds */
+    size_t textpos;         /* offset of the line after .text */
+    size_t datapos;         /* offset of the line after .data */
+
+    int counter = 0;        /* line counter */
+    int k;                  /* chunk iterator */
+    size_t n;               /* record iterator */
+
+    /* threads */
+    chunk *chunks;          /* pieces of the source */
+    int nchunks;            /* number of pieces */
+    size_t chunksize;       /* target size of a piece */
+    errnode *nexterr;       /* error after the one being merged */
+    encodeblock *blocks;    /* pieces of pass two */
+    int nblocks;            /* number of pieces */
+
+
+    /* list stuff */
+    instlist *instructions;  /* instruction list */
+
+    errlist *errors;         /* error list */
+    errnode *temperr;        /* temporary error node pointer */
+
+    datalist *data;          /* data list */
+
+    symtable *symbols = &res->symbols;  /* symbols table */
+
+
+    /* allocate list stuff then start reading file */
+
+    /* allocate instructions list */
+    instructions = arenaalloc(mem, sizeof(instlist));
+
+    /* initialize instructions variables */
+    instructions->recs  = NULL;
+    instructions->count = 0;
+    instructions->cap   = 0;
+    instructions->words = NULL;
+
+    /* allocate errors list */
+    errors = arenaalloc(mem, sizeof(errlist));
+
+    /* initialize instructions variables */
+    errors->head  = NULL;
+    errors->tail  = NULL;
+    errors->cur   = NULL;
+    errors->count = 0;
+
+    /* allocate data list */
+    data = arenaalloc(mem, sizeof(datalist));
+
+    /* initialize data variables */
+    data->words = NULL;
+    data->count = 0;
+    data->cap   = 0;
+
+    /* set up the symbols table */
+    initsymtable(symbols, mem);
+
+
+    /* find the sections. lines before .text are skipped, so only
+       what follows it is read */
+    textpos = findsection(src, 0, ".text", 1);
+    datapos = findsection(src, textpos, ".data", 0);
+
+    /* the result holds the chunks before they are cut, so their
+       arenas are freed if memory runs out part way. the array is
+       zeroed, a chunk not cut yet has nothing to free */
+    if (cachedir != NULL)
+    {
+        /* split the sections where their text says so. the
+           directory is made on first use */
+        mkdir(cachedir, 0777);
+        nchunks = (int)((src->size - textpos) / CACHE_CHUNK_MIN + 4);
+        chunks = arenaalloc(mem, (size_t)nchunks * sizeof(chunk));
+        res->chunks = chunks;
+        res->nchunks = nchunks;
+        nchunks = splitcached(src, textpos, datapos, SECT_TEXT, trace, cachedir, chunks);
+        nchunks += splitcached(src, datapos, src->size, SECT_DATA, trace, cachedir, chunks + nchunks);
+        res->nchunks = nchunks;
+
+        /* pass one comes first here, every chunk counts its lines
+           as it is hashed and is then found in the cache or read.
+           nothing is traced, so the lines are not needed before */
+        parallelfor(pool, nchunks, cachedpassone, chunks);
+    }
+    else
+    {
+        /* split the sections into chunks of whole lines, a few per
+           thread so threads that finish early can pick up more */
+        chunksize = (src->size - textpos) / ((size_t)(pool->nthreads + 1) * CHUNKS_PER_THREAD);
+        chunksize = chunksize < CHUNK_MIN ? CHUNK_MIN : chunksize;
+        nchunks = (int)((src->size - textpos) / chunksize + 2);
+        chunks = arenaalloc(mem, (size_t)nchunks * sizeof(chunk));
+        res->chunks = chunks;
+        res->nchunks = nchunks;
+        nchunks = splitsection(src, textpos, datapos, chunksize, SECT_TEXT, trace, chunks);
+        nchunks += splitsection(src, datapos, src->size, chunksize, SECT_DATA, trace, chunks + nchunks);
+        res->nchunks = nchunks;
+
+        /* every chunk counts its own lines */
+        parallelfor(pool, nchunks, countlines, chunks);
+    }
+
+    /* number the lines, the counts of the chunks are added up in order */
+    for (n = 0; n < textpos; n++)
+    {
+        counter += src->data[n] == '\n';
+    }
+    for (k = 0; k < nchunks; k++)
+    {
+        chunks[k].linebase = counter;
+        counter += chunks[k].lines;
+    }
+
+    /* pass one, every chunk is read on its own */
+    if (cachedir == NULL)
+    {
+        parallelfor(pool, nchunks, passone, chunks);
+    }
+
+    /* work out where each chunk lands in the program. data
+       addresses follow the instructions */
+    for (k = 0; k < nchunks; k++)
+    {
+        chunks[k].instbase = instructions->count;
+        chunks[k].database = data->count;
+        instructions->count += chunks[k].insts.count;
+        data->count += chunks[k].data.count;
+    }
+
+    /* size the program table once for every chunk symbol */
+    n = 0;
+    for (k = 0; k < nchunks; k++)
+    {
+        n += chunks[k].symbols.count;
+    }
+    reservesymtable(symbols, n);
+
+    /* symbols can be declared global above the text too */
+    declarepreamble(symbols, src, textpos);
+
+    /* merge the chunk symbols and errors into the program in file order */
+    for (k = 0; k < nchunks; k++)
+    {
+        mergechunk(symbols, errors, mem, &chunks[k], instructions->count);
+    }
+
+    /* the data words go straight after the instruction words, so
+       the result is one array */
+    instructions->words = arenarealloc(mem, NULL, (instructions->count + data->count + 1) * sizeof(uint32_t));
+    data->words = instructions->words + instructions->count;
+
+    if (cachedir != NULL)
+    {
+        /* chunks that went through the cache come with their words,
+           they are copied into place and the symbols are filled in */
+        for (k = 0; k < nchunks; k++)
+        {
+            chunks[k].wordsout = instructions->words;
+            chunks[k].dataout = data->words;
+            chunks[k].program = symbols;
+        }
+        parallelfor(pool, nchunks, encodechunk, chunks);
+
+        /* merge the undefined symbols and branches out of reach
+           in chunk order */
+        for (k = 0; k < nchunks; k++)
+        {
+            for (temperr = chunks[k].undefs.head; temperr != NULL; temperr = nexterr)
+            {
+                nexterr = temperr->next;
+                add_err(errors, temperr);
+            }
+        }
+    }
+    else
+    {
+        /* copy the records into place */
+        instructions->recs = arenarealloc(mem, NULL, (instructions->count + 1) * sizeof(instrec));
+        for (k = 0; k < nchunks; k++)
+        {
+            chunks[k].instout = instructions->recs;
+            chunks[k].dataout = data->words;
+        }
+        parallelfor(pool, nchunks, placechunk, chunks);
+
+        /* alright file has been processed at this point.
+           instructions and data directives are in their respective lists.
+           we must now go through the instruction records in order and
+           assemble them into words. symbols were given ids in pass one,
+           so each one is resolved by indexing the symbol array and errors
+           generated if they were never defined */
+
+        /* split the records into blocks. the pool hands the blocks out
+           one at a time, so threads that finish early take more of them */
+        nblocks = (int)((instructions->count + ENCODE_BLOCK - 1) / ENCODE_BLOCK);
+        blocks = arenaalloc(mem, (nblocks + 1) * sizeof(encodeblock));
+        for (k = 0; k < nblocks; k++)
+        {
+            blocks[k].start   = (size_t)k * ENCODE_BLOCK;
+            blocks[k].end     = blocks[k].start + ENCODE_BLOCK;
+            blocks[k].end     = blocks[k].end > instructions->count ? instructions->count : blocks[k].end;
+            blocks[k].insts   = instructions;
+            blocks[k].symbols = symbols;
+            initarena(&blocks[k].mem);
+        }
+        res->blocks = blocks;
+        res->nblocks = nblocks;
+        parallelfor(pool, nblocks, passtwo, blocks);
+
+        /* merge the undefined symbols in block order */
+        for (k = 0; k < nblocks; k++)
+        {
+            for (temperr = blocks[k].errors.head; temperr != NULL; temperr = nexterr)
+            {
+                nexterr = temperr->next;
+                add_err(errors, temperr);
+            }
+        }
+    }
+
+    /* instructions are now assembled, hand them to the result along
+       with an index of the errors */
+    res->words  = instructions->words;
+    res->recs   = instructions->recs;
+    res->ntext  = instructions->count;
+    res->nwords = instructions->count + data->count;
+    finishresult(res, errors);
+}
+
+/* this function takes in a result whose source is open, the pool
+   and an obj writer and assembles the source in a single pass that
+   writes every word as soon as its chunk is read. a word whose symbol
+   is not defined yet goes out as 0 and waits as a fixup until the
+   symbol turns up, then it is patched in place. only the symbols and
+   the waiting fixups are kept, not the program, so memory does not
+   grow with the size of the source. the source is read a window of
+   chunks at a time, pass one runs over the window on the pool and the
+   chunks are then merged and written in file order */
+static void streamsource(asm_result *res, threadpool *pool, objwriter *out)
+{
+    arena *mem = &res->ctx->mem;        /* owns everything that is kept */
+    tracer *trace = &res->ctx->trace;   /* trace of the assembly */
+    srcfile *src = &res->src;           /* the asm file */
+    symtable *symbols = &res->symbols;  /* program symbols */
+    errlist *errors;                    /* error list */
+    backpatch bp;                       /* words waiting for a symbol */
+
+    /* section bounds */
+    size_t textpos;         /* offset of the line after .text */
+    size_t datapos;         /* offset of the line after .data */
+    size_t textend;         /* end of the text found so far */
+
+    chunk *chunks;          /* the window */
+    int window;             /* most chunks in a window */
+    int nchunks;            /* chunks in this window */
+    chunk *c;               /* chunk being written */
+    size_t start;           /* start of the next chunk */
+    size_t stop;            /* end of a chunk */
+    size_t dropped = 0;     /* bytes of a mapped source let go of */
+    size_t page;            /* page size */
+    instrec rec;            /* record with program line and symbol id */
+    size_t ntext = 0;       /* instructions written */
+    size_t ndata = 0;       /* data words written */
+    int counter = 0;        /* line counter */
+    int addr;               /* address of the symbol operand */
+    int id;                 /* chunk symbol id */
+    int k;                  /* chunk iterator */
+    size_t n;               /* record iterator */
+
+    errors = arenaalloc(mem, sizeof(errlist));
+    initsymtable(symbols, mem);
+    initbackpatch(&bp, mem);
+
+    /* find the text, lines before .text are skipped. the .data line
+       is looked for one window at a time, so the source is not read
+       ahead of the window */
+    textpos = findsection(src, 0, ".text", 1);
+    datapos = NO_SECTION;
+    textend = textpos;
+    for (n = 0; n < textpos; n++)
+    {
+        counter += src->data[n] == '\n';
+    }
+
+    /* symbols can be declared global above the text too */
+    declarepreamble(symbols, src, textpos);
+
+    window = (pool->nthreads + 1) * CHUNKS_PER_THREAD;
+    chunks = arenaalloc(mem, (size_t)window * sizeof(chunk));
+
+    /* the result holds the window until the end, so the arenas of its
+       chunks are freed if memory runs out part way through */
+    res->chunks = chunks;
+    res->nchunks = window;
+
+    start = textpos;
+    while (start < src->size)
+    {
+        /* see if .data is in the text the window would cover */
+        if (datapos == NO_SECTION)
+        {
+            textend = chunkend(src, start, src->size, (size_t)window * STREAM_CHUNK);
+            datapos = searchsection(src, start, textend, ".data", 0);
+            textend = datapos == NO_SECTION ? textend : datapos;
+        }
+
+        /* cut the next window, a chunk never runs into .data */
+        for (nchunks = 0; nchunks < window && start < src->size; nchunks++)
+        {
+            if (start < textend)
+            {
+                stop = chunkend(src, start, textend, STREAM_CHUNK);
+                initchunk(&chunks[nchunks], src, start, stop, SECT_TEXT, trace);
+            }
+            else if (datapos != NO_SECTION)
+            {
+                stop = chunkend(src, start, src->size, STREAM_CHUNK);
+                initchunk(&chunks[nchunks], src, start, stop, SECT_DATA, trace);
+            }
+            else
+            {
+                break;
+            }
+            start = stop;
+        }
+
+        /* number the lines and read the window */
+        parallelfor(pool, nchunks, countlines, chunks);
+        for (k = 0; k < nchunks; k++)
+        {
+            chunks[k].linebase = counter;
+            counter += chunks[k].lines;
+        }
+        parallelfor(pool, nchunks, passone, chunks);
+
+        for (k = 0; k < nchunks; k++)
+        {
+            c = &chunks[k];
+            c->instbase = ntext;
+            c->database = ndata;
+
+            /* the chunk arena goes away below, its errors are kept */
+            keeperrors(&c->errors, mem);
+            mergechunk(symbols, errors, mem, c, ntext);
+
+            /* words written before that wait for a symbol the chunk
+               defines can be patched now */
+            for (id = 0; id < (int)c->symbols.count; id++)
+            {
+                if (c->symbols.syms[id].address != SYM_UNDEFINED)
+                {
+                    resolvefixups(&bp, symbols, c->symmap[id], out, errors, mem);
+                }
+            }
+
+            /* write the instructions. the chunk is merged, so only
+               symbols further down the file are still undefined */
+            for (n = 0; n < c->insts.count; n++)
+            {
+                rec = c->insts.recs[n];
+                rec.lineno += (uint32_t)c->linebase;
+
+                addr = 0;
+                if (rec.flags & REC_SYMBOL)
+                {
+                    rec.imm = c->symmap[rec.imm];
+                    addr = symbols->syms[rec.imm].address;
+                    if (addr == SYM_UNDEFINED)
+                    {
+                        addfixup(&bp, &rec, (uint32_t)(ntext + n));
+                        emitword(out, (uint32_t)(ntext + n), 0);
+                        continue;
+                    }
+                    if (rec.flags & REC_HI)
+                    {
+                        addr = (int)((uint32_t)addr >> 16);
+                    }
+                    else if (isbranch(&rec) && branchoffset(addr, ntext + n, &addr) != 0)
+                    {
+                        rangeerror(errors, mem, (int)rec.lineno,
+                                   symbols->names + symbols->syms[rec.imm].name);
+                        emitword(out, (uint32_t)(ntext + n), 0);
+                        continue;
+                    }
+                }
+                emitword(out, (uint32_t)(ntext + n), encoderec(&rec, addr));
+            }
+
+            /* data words follow every instruction, all of which
+               were written by the time a data chunk comes up */
+            for (n = 0; n < c->data.count; n++)
+            {
+                emitword(out, (uint32_t)(ntext + ndata + n), c->data.words[n]);
+            }
+
+            ntext += c->insts.count;
+            ndata += c->data.count;
+            freearena(&c->mem);
+        }
+
+        /* the pages of a mapped source that were read are let go of,
+           they come back from the file if the err file lists them */
+        if (src->storage == SRC_MAPPED)
+        {
+            page = (size_t)sysconf(_SC_PAGESIZE);
+            stop = start / page * page;
+            if (stop > dropped)
+            {
+                madvise((char *)src->data + dropped, stop - dropped, MADV_DONTNEED);
+                dropped = stop;
+            }
+        }
+    }
+
+    /* anything still waiting uses a symbol that was never defined */
+    undefinedfixups(&bp, symbols, errors, mem, out);
+
+    res->ntext  = ntext;
+    res->nwords = ntext + ndata;
+    res->nchunks = 0;
+    finishresult(res, errors);
+}
+
+/* this function releases what a result holds besides the arena of
+   its context: the source and the arenas of the pieces */
+static void releaseresult(asm_result *res)
+{
+    int k;  /* iterator */
+
+    for (k = 0; k < res->nchunks; k++)
+    {
+        freearena(&res->chunks[k].mem);
+        if (res->chunks[k].cachemap != NULL)
+        {
+            munmap(res->chunks[k].cachemap, res->chunks[k].cachelen);
+        }
+    }
+    for (k = 0; k < res->nblocks; k++)
+    {
+        freearena(&res->blocks[k].mem);
+    }
+    res->nchunks = 0;
+    res->nblocks = 0;
+    releaselink(res);
+
+    if (res->open)
+    {
+        closesource(&res->src);
+        res->open = 0;
+    }
+}
+
+/* this function writes the err file of a result to errfp, a listing
+   of the source with line numbers followed by the errors */
+static void writeerr(const asm_result *res, FILE *errfp)
+{
+    srcfile src = res->src;        /* the asm file, read from the top */
+    errlist *errors = res->errors; /* error list */
+    strview line;                  /* line of the asm file */
+    int counter = 0;               /* line counter */
+
+    /* loop through asm file and write all lines to error file with
+       prefixed line numbers, starting over at the top of the file */
+    src.pos = 0;
+
+    while (nextLine(&src, &line))
+    {
+        /* increment line counter */
+        counter++;
+        fprintf(errfp,"%2d   %.*s", counter, (int)line.len, line.p);
+    }
+
+    /* clear some lines in error file */
+    fprintf(errfp, "\n");
+
+    fprintf(errfp, "Errors detected:\n\n");
+
+    /* loop through errors and generate error report */
+    errors->cur = errors->head;
+    while (errors->cur != NULL)
+    {
+        /* if error i opcode, show proper message */
+        if (errors->cur->errtype == ERR_OPCODE)
+        {
+            fprintf(errfp,"  line %2d:  Illegal opcode.\n", errors->cur->lineno);
+
+        }
+        /* else show message for undefined symbol */
+        else if (errors->cur->errtype == ERR_UNDEFSYMBOL)
+        {
+            fprintf(errfp,"  line %2d:  Undefined symbol used.\n", errors->cur->lineno);
+        }
+        else if (errors->cur->errtype == ERR_RANGE)
+        {
+            fprintf(errfp,"  line %2d:  Branch target out of range.\n", errors->cur->lineno);
+        }
+        else if (errors->cur->errtype == ERR_BADOBJECT)
+        {
+            fprintf(errfp,"  line %2d:  Not a relocatable object.\n", errors->cur->lineno);
+        }
+
+        /* traverse to next error */
+        errors->cur = errors->cur->next;
+    }
+
+    /* clear a line */
+    fprintf(errfp, "\n");
+
+    /* check for multiply defined symbols */
+    /* loop through errors */
+    errors->cur = errors->head;
+    while (errors->cur != NULL)
+    {
+        /* check for multiple symbol errors */
+        if (errors->cur->errtype == ERR_MULTSYMBOL)
+        {
+            /* print title */
+            fprintf(errfp,"Multiply defined symbol(s):\n\n");
+
+            /* loop through and print all multiple symbol errors */
+            errors->cur = errors->head;
+            while (errors->cur != NULL)
+            {
+                if (errors->cur->errtype == ERR_MULTSYMBOL)
+                {
+                    fprintf(errfp, "  %s\n", errors->cur->symbol);
+                }
+                errors->cur = errors->cur->next;
+            }
+            break;
+        }
+        /* traverse to next error node */
+        errors->cur = errors->cur->next;
+    } /* end while */
+
+    /* clear a line */
+    fprintf(errfp, "\n");
+
+    /* check for undefined  symbols */
+    /* loop through errors */
+    errors->cur = errors->head;
+    while (errors->cur != NULL)
+    {
+        if (errors->cur->errtype == ERR_UNDEFSYMBOL)
+        {
+            /* print title */
+            fprintf(errfp,"Undefined symbol(s):\n\n");
+
+            /* loop through and print all undefined symbol errors */
+            errors->cur = errors->head;
+            while (errors->cur != NULL)
+            {
+                if (errors->cur->errtype == ERR_UNDEFSYMBOL)
+                {
+                    fprintf(errfp, "  %s\n", errors->cur->symbol);
+                }
+                /* traverse to next node */
+                errors->cur = errors->cur->next;
+            }
+            break;
+        }
+        /* traverse to next node */
+        errors->cur = errors->cur->next;
+    } /* end while */
+}
+
+/* this function writes every word of a result to the obj writer,
+   the address of a word is its index */
+static int writeobj(const asm_result *res, objwriter *obj)
+{
+    size_t n;      /* word iterator */
+    size_t count;  /* words packed into the buffer */
+    size_t k;      /* iterator */
+
+    if (obj->format == ASM_FORMAT_IHEX_LE || obj->format == ASM_FORMAT_IHEX_BE)
+    {
+        writeihex(obj, res->words, res->nwords);
+        return closeobj(obj);
+    }
+    if (obj->format == ASM_FORMAT_SREC_LE || obj->format == ASM_FORMAT_SREC_BE)
+    {
+        writesrec(obj, res->words, res->nwords);
+        return closeobj(obj);
+    }
+
+    /* words packed in the byte order of the host are the word array
+       itself, it goes out in one write */
+    if (obj->format == HOST_FORMAT && obj->fd >= 0)
+    {
+        if (writeall(obj->fd, (const char *)res->words, res->nwords * sizeof(uint32_t)) != 0)
+        {
+            obj->failed = 1;
+        }
+        return closeobj(obj);
+    }
+
+    /* the other byte order is packed a buffer at a time */
+    if (obj->format != ASM_FORMAT_OBJ && obj->fd >= 0)
+    {
+        for (n = 0; n < res->nwords; n += count)
+        {
+            count = obj->cap / sizeof(uint32_t);
+            count = count < res->nwords - n ? count : res->nwords - n;
+            for (k = 0; k < count; k++)
+            {
+                packword(obj->buf + k * sizeof(uint32_t), res->words[n + k], obj->format);
+            }
+            if (writeall(obj->fd, obj->buf, count * sizeof(uint32_t)) != 0)
+            {
+                obj->failed = 1;
+            }
+        }
+        return closeobj(obj);
+    }
+
+    for (n = 0; n < res->nwords; n++)
+    {
+        /* print word in hex: address - word */
+        emitword(obj, (uint32_t)n, res->words[n]);
+    }
+    return closeobj(obj);
+}
+
+/* this function returns 1 if format is one of the ELF formats, which
+   are laid out whole instead of going through the obj writer, and
+   the only ones that keep the symbols */
+static int iself(int format)
+{
+    return format == ASM_FORMAT_ELF_LE || format == ASM_FORMAT_ELF_BE ||
+           format == ASM_FORMAT_REL_LE || format == ASM_FORMAT_REL_BE;
+}
+
+/* this function returns 1 if format can be written while the source
+   is read. a word is patched in place later, which in a record format
+   would also change a checksum that may have gone out already */
+static int canstream(int format)
+{
+    return format == ASM_FORMAT_OBJ || format == ASM_FORMAT_BIN_LE ||
+           format == ASM_FORMAT_BIN_BE;
+}
+
+/* this function returns 1 if format is one of the ASM_FORMAT_ constants */
+static int isformat(int format)
+{
+    return format >= ASM_FORMAT_OBJ && format <= ASM_FORMAT_REL_BE;
+}
+
+/* this function returns 1 if a result can be written in format. a
+   word that uses a symbol of another object is only complete with
+   the relocation of a relocatable object */
+static int canwrite(const asm_result *res, int format)
+{
+    return res->status == ASM_OK && res->words != NULL && isformat(format) &&
+           (format == ASM_FORMAT_REL_LE || format == ASM_FORMAT_REL_BE || !hasimports(res));
+}
+
+/* this function takes in a context, an open source, the options and
+   an obj writer to stream to, or NULL, and assembles the source into
+   the result of the context. the caller sets nomemjump */
+static int assemblectx(asm_ctx *ctx, const asm_options *opts, objwriter *out,
+                       asm_result **result)
+{
+    asm_result *res = &ctx->result;  /* result being filled in */
+
+    /* a traced run reads the chunks one after another, so the
+       trace comes out in line order */
+    ctx->trace.level = opts ? opts->trace : 0;
+    ctx->trace.fd = opts ? opts->tracefd : STDERR_FILENO;
+
+    /* a chunk found in the cache is not read, so there would be
+       nothing to trace. traced runs read everything */
+    ctx->cachedir = opts && !ctx->trace.level ? opts->cachedir : NULL;
+
+    if (out != NULL)
+    {
+        streamsource(res, ctx->trace.level ? &ctx->serial : &ctx->pool, out);
+    }
+    else
+    {
+        assemble(res, ctx->trace.level ? &ctx->serial : &ctx->pool);
+    }
+
+    if (ctx->trace.level)
+    {
+        flushtrace(&ctx->trace);
+    }
+    *result = res;
+    return res->status;
+}
+
+/* this function starts a new result on a context, letting go of the
+   one before */
+static asm_result *newresult(asm_ctx *ctx)
+{
+    asm_result *res = &ctx->result;  /* the one result */
+
+    releaseresult(res);
+    resetarena(&ctx->mem);
+    memset(res, 0, sizeof(asm_result));
+    res->ctx = ctx;
+    return res;
+}
+
+/* this function lets go of a result that ran out of memory part way
+   and of everything the context allocated for it. what was traced
+   so far still goes out. returns ASM_ENOMEM */
+static int dropresult(asm_ctx *ctx, asm_result **result)
+{
+    nomemjump = NULL;
+    if (ctx->trace.level)
+    {
+        flushtrace(&ctx->trace);
+    }
+    releaseresult(&ctx->result);
+    resetarena(&ctx->mem);
+    *result = NULL;
+    return ASM_ENOMEM;
+}
+
+/* libasm.c - this file contains the functions of the public
+   interface, see libasm.h
+*/
+
+/***************** Functions  ***************/
+
+/* sets the options to the defaults */
+void asm_options_init(asm_options *opts)
+{
+    opts->trace = 0;
+    opts->tracefd = STDERR_FILENO;
+    opts->cachedir = NULL;
+}
+
+/* creates a context with threads threads, 0 is one per cpu */
+asm_ctx *asm_ctx_create(int threads)
+{
+    asm_ctx *ctx;  /* new context */
+
+    if (threads <= 0)
+    {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        threads = threads < 1 ? 1 : threads;
+    }
+    threads = threads > MAX_THREADS ? MAX_THREADS : threads;
+
+    if ((ctx = calloc(1, sizeof(asm_ctx))) == NULL)
+    {
+        return NULL;
+    }
+    initarena(&ctx->mem);
+    initpool(&ctx->pool, threads - 1);
+    initpool(&ctx->serial, 0);
+    ctx->result.ctx = ctx;
+    return ctx;
+}
+
+/* releases a context, its pool and its memory */
+void asm_ctx_destroy(asm_ctx *ctx)
+{
+    if (ctx == NULL)
+    {
+        return;
+    }
+    releaseresult(&ctx->result);
+    freepool(&ctx->pool);
+    freepool(&ctx->serial);
+    freearena(&ctx->mem);
+    free(ctx);
+}
+
+/* assembles source held in a buffer the caller keeps alive */
+int asm_assemble_buffer(asm_ctx *ctx, const char *src, size_t len,
+                        const asm_options *opts, asm_result **result)
+{
+    asm_result *res;  /* result being filled in */
+    jmp_buf jump;     /* where running out of memory lands */
+    int rc;           /* result of the assembly */
+
+    *result = NULL;
+    if (ctx == NULL || (src == NULL && len > 0))
+    {
+        return ASM_EINVAL;
+    }
+
+    res = newresult(ctx);
+    opensourcebuf(&res->src, src ? src : "", len);
+    res->open = 1;
+    if (setjmp(jump) != 0)
+    {
+        return dropresult(ctx, result);
+    }
+    nomemjump = &jump;
+    rc = assemblectx(ctx, opts, NULL, result);
+    nomemjump = NULL;
+    return rc;
+}
+
+/* assembles the file at path */
+int asm_assemble_file(asm_ctx *ctx, const char *path,
+                      const asm_options *opts, asm_result **result)
+{
+    asm_result *res;  /* result being filled in */
+    jmp_buf jump;     /* where running out of memory lands */
+    int rc;           /* result of the assembly */
+
+    *result = NULL;
+    if (ctx == NULL || path == NULL)
+    {
+        return ASM_EINVAL;
+    }
+
+    res = newresult(ctx);
+    if (opensource(&res->src, path) != 0)
+    {
+        return ASM_ENOENT;
+    }
+    res->open = 1;
+    if (setjmp(jump) != 0)
+    {
+        return dropresult(ctx, result);
+    }
+    nomemjump = &jump;
+    rc = assemblectx(ctx, opts, NULL, result);
+    nomemjump = NULL;
+    return rc;
+}
+
+/* assembles the file at path, writing the obj file to fd as it goes */
+int asm_stream_file(asm_ctx *ctx, const char *path, int fd, int format,
+                    const asm_options *opts, asm_result **result)
+{
+    asm_result *res;  /* result being filled in */
+    objwriter obj;    /* writer the words are streamed to */
+    jmp_buf jump;     /* where running out of memory lands */
+    int rc;           /* result of the assembly */
+
+    *result = NULL;
+    if (ctx == NULL || path == NULL || fd < 0 || !canstream(format))
+    {
+        return ASM_EINVAL;
+    }
+
+    res = newresult(ctx);
+    if (opensource(&res->src, path) != 0)
+    {
+        return ASM_ENOENT;
+    }
+    res->open = 1;
+    if (setjmp(jump) != 0)
+    {
+        return dropresult(ctx, result);
+    }
+    nomemjump = &jump;
+
+    /* words are patched in place, so the file has to allow it */
+    openobj(&obj, &ctx->mem, fd, format);
+    if (obj.base < 0)
+    {
+        nomemjump = NULL;
+        return ASM_EINVAL;
+    }
+    rc = assemblectx(ctx, opts, &obj, result);
+    nomemjump = NULL;
+    if (closeobj(&obj) != 0)
+    {
+        *result = NULL;
+        return ASM_EIO;
+    }
+    return rc;
+}
+
+/* links the objects at paths into one program */
+int asm_link_files(asm_ctx *ctx, const char *const *paths, size_t npaths,
+                   asm_result **result)
+{
+    asm_result *res;  /* result being filled in */
+    jmp_buf jump;     /* where running out of memory lands */
+    int rc;           /* result of the link */
+
+    *result = NULL;
+    if (ctx == NULL || (paths == NULL && npaths > 0) || npaths > (size_t)INT32_MAX)
+    {
+        return ASM_EINVAL;
+    }
+
+    /* there is no source, the err file only lists the errors */
+    res = newresult(ctx);
+    opensourcebuf(&res->src, "", 0);
+    res->open = 1;
+    if (setjmp(jump) != 0)
+    {
+        return dropresult(ctx, result);
+    }
+    nomemjump = &jump;
+    rc = linkobjects(res, &ctx->pool, paths, (int)npaths);
+    nomemjump = NULL;
+    if (rc == ASM_ENOENT)
+    {
+        return rc;
+    }
+    *result = res;
+    return rc;
+}
+
+/* releases a result, its memory goes back to the context */
+void asm_result_free(asm_result *result)
+{
+    if (result != NULL)
+    {
+        releaseresult(result);
+        resetarena(&result->ctx->mem);
+        result->nwords = 0;
+        result->ntext = 0;
+    }
+}
+
+/* ASM_OK or ASM_ERRORS */
+int asm_result_status(const asm_result *result)
+{
+    return result->status;
+}
+
+/* the assembled words */
+const uint32_t *asm_result_words(const asm_result *result)
+{
+    return result->words;
+}
+
+/* number of assembled words */
+size_t asm_result_word_count(const asm_result *result)
+{
+    return result->nwords;
+}
+
+/* number of words that are instructions */
+size_t asm_result_text_count(const asm_result *result)
+{
+    return result->ntext;
+}
+
+/* number of symbols */
+size_t asm_result_symbol_count(const asm_result *result)
+{
+    return result->symbols.count;
+}
+
+/* name of symbol i */
+const char *asm_result_symbol_name(const asm_result *result, size_t i)
+{
+    return result->symbols.names + result->symbols.syms[i].name;
+}
+
+/* address of symbol i, ASM_UNDEFINED if it was never defined */
+int asm_result_symbol_address(const asm_result *result, size_t i)
+{
+    return result->symbols.syms[i].address;
+}
+
+/* binding of symbol i, one of the ASM_SYM_ constants. a symbol named
+   by .globl or .extern is left to another object if it is not defined */
+int asm_result_symbol_binding(const asm_result *result, size_t i)
+{
+    const symbol *sym = &result->symbols.syms[i];  /* the symbol */
+
+    if (!(sym->flags & (SYM_GLOBAL | SYM_EXTERN)))
+    {
+        return ASM_SYM_LOCAL;
+    }
+    return sym->address == SYM_UNDEFINED ? ASM_SYM_EXTERN : ASM_SYM_GLOBAL;
+}
+
+/* number of chunks and how many of them came from the cache */
+void asm_result_cache_stats(const asm_result *result, size_t *chunks, size_t *reused)
+{
+    int k;  /* chunk iterator */
+
+    *chunks = (size_t)result->nchunks;
+    *reused = 0;
+    for (k = 0; k < result->nchunks; k++)
+    {
+        *reused += result->chunks[k].cachemap != NULL;
+    }
+}
+
+/* number of diagnostics */
+size_t asm_result_diag_count(const asm_result *result)
+{
+    return (size_t)result->errors->count;
+}
+
+/* kind of diagnostic i, one of the ASM_DIAG_ constants */
+int asm_result_diag_kind(const asm_result *result, size_t i)
+{
+    switch (result->diags[i]->errtype)
+    {
+    case ERR_OPCODE:
+        return ASM_DIAG_OPCODE;
+    case ERR_UNDEFSYMBOL:
+        return ASM_DIAG_UNDEFINED;
+    case ERR_BADOBJECT:
+        return ASM_DIAG_BADOBJECT;
+    case ERR_RANGE:
+        return ASM_DIAG_RANGE;
+    default:
+        return ASM_DIAG_MULTIPLE;
+    }
+}
+
+/* line of diagnostic i */
+int asm_result_diag_line(const asm_result *result, size_t i)
+{
+    return result->diags[i]->lineno;
+}
+
+/* the opcode or symbol diagnostic i is about */
+const char *asm_result_diag_text(const asm_result *result, size_t i)
+{
+    return result->diags[i]->errtype == ERR_OPCODE ?
+           result->diags[i]->opcode : result->diags[i]->symbol;
+}
+
+/* writes the obj file to fd */
+int asm_result_write_obj(const asm_result *result, int fd)
+{
+    return asm_result_write_format(result, fd, ASM_FORMAT_OBJ);
+}
+
+/* writes the obj file to fd in a format */
+int asm_result_write_format(const asm_result *result, int fd, int format)
+{
+    objwriter obj;  /* buffered writer for the obj file */
+    char *elf;      /* ELF file laid out in memory */
+    size_t len;     /* its size */
+    jmp_buf jump;   /* where running out of memory lands */
+    int rc;         /* result of writing it */
+
+    if (!canwrite(result, format))
+    {
+        return -1;
+    }
+
+    /* what was allocated stays with the context until it is reset */
+    if (setjmp(jump) != 0)
+    {
+        nomemjump = NULL;
+        return -1;
+    }
+    nomemjump = &jump;
+
+    /* an ELF file is laid out whole and goes out in one write */
+    if (iself(format))
+    {
+        elf = layoutelf(result, &result->ctx->mem, format, &len);
+        rc = writeall(fd, elf, len);
+        arenarealloc(&result->ctx->mem, elf, 0);
+    }
+    else
+    {
+        openobj(&obj, &result->ctx->mem, fd, format);
+        rc = writeobj(result, &obj);
+    }
+    nomemjump = NULL;
+    return rc;
+}
+
+/* writes the err file to fd */
+int asm_result_write_err(const asm_result *result, int fd)
+{
+    FILE *errfp;  /* stream on a copy of fd */
+    int copy;     /* the copy, closed with the stream */
+
+    if (result->status != ASM_ERRORS || (copy = dup(fd)) < 0)
+    {
+        return -1;
+    }
+    if ((errfp = fdopen(copy, "w")) == NULL)
+    {
+        close(copy);
+        return -1;
+    }
+    writeerr(result, errfp);
+    return fclose(errfp) == 0 ? 0 : -1;
+}
+
+/* formats the obj file into the arena of the context */
+const char *asm_result_obj_text(asm_result *result, size_t *len)
+{
+    return asm_result_format_data(result, ASM_FORMAT_OBJ, len);
+}
+
+/* formats the obj file in a format into the arena of the context */
+const char *asm_result_format_data(asm_result *result, int format, size_t *len)
+{
+    objwriter obj;  /* writer kept in memory */
+    char *data;     /* the formatted file */
+    jmp_buf jump;   /* where running out of memory lands */
+
+    if (!canwrite(result, format))
+    {
+        return NULL;
+    }
+
+    /* packed words in the byte order of the host need no copy */
+    if (format == HOST_FORMAT)
+    {
+        *len = result->nwords * sizeof(uint32_t);
+        return (const char *)result->words;
+    }
+
+    if (setjmp(jump) != 0)
+    {
+        nomemjump = NULL;
+        return NULL;
+    }
+    nomemjump = &jump;
+    if (iself(format))
+    {
+        data = layoutelf(result, &result->ctx->mem, format, len);
+    }
+    else
+    {
+        openobjmem(&obj, &result->ctx->mem, format);
+        writeobj(result, &obj);
+        *len = obj.len;
+        data = obj.buf;
+    }
+    nomemjump = NULL;
+    return data;
+}
+
+/* formats the err file into the arena of the context */
+const char *asm_result_err_text(asm_result *result, size_t *len)
+{
+    FILE *errfp;          /* stream into memory */
+    char *errtext = NULL; /* what was written */
+    size_t errlen = 0;    /* bytes in errtext */
+    char *copy;           /* the same in the arena */
+    jmp_buf jump;         /* where running out of memory lands */
+
+    if (result->status != ASM_ERRORS ||
+        (errfp = open_memstream(&errtext, &errlen)) == NULL)
+    {
+        return NULL;
+    }
+    writeerr(result, errfp);
+    fclose(errfp);
+
+    /* errtext is malloced, it goes either way */
+    if (setjmp(jump) != 0)
+    {
+        nomemjump = NULL;
+        free(errtext);
+        return NULL;
+    }
+    nomemjump = &jump;
+    copy = arenastrndup(&result->ctx->mem, errtext, errlen);
+    nomemjump = NULL;
+    free(errtext);
+    *len = errlen;
+    return copy;
+}
+
+/******************* Functions ******************/
+
+/* hashes a symbol name with 64 bit FNV-1a followed by a
+   murmur style finalizer, folded down to 32 bits. the full
+   mixing keeps probe sequences short even for generated label
+   names that only differ in their last digits */
+static uint32_t symhash(const char *s, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;  /* FNV offset basis */
+    const char *end = s + len;           /* end of the name */
+
+    for (; s < end; s++)
+    {
+        h ^= (unsigned char)*s;
+        h *= 0x100000001b3ULL;           /* FNV prime */
+    }
+
+    /* finalize so every input bit reaches the low bits we mask with */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return (uint32_t)h;
+}
+
+/* sets up an empty symbol table with SYM_SLOTS slots. all of its
+   storage comes from the arena and is released along with it */
+static void initsymtable(symtable *table, arena *mem)
+{
+    table->mem   = mem;
+    table->slots = arenarealloc(mem, NULL, SYM_SLOTS * sizeof(symslot));
+    memset(table->slots, 0, SYM_SLOTS * sizeof(symslot));
+    table->mask  = SYM_SLOTS - 1;
+
+    table->syms  = NULL;
+    table->count = 0;
+    table->cap   = 0;
+
+    table->names    = NULL;
+    table->nameslen = 0;
+    table->namescap = 0;
+}
+
+/* resizes the index to newmask + 1 slots and reinserts every
+   symbol, using the cached hashes so no name is hashed again */
+static void growsymtable(symtable *table, uint32_t newmask)
+{
+    symslot *newslots = arenarealloc(table->mem, NULL, (newmask + 1) * sizeof(symslot));
+    uint32_t i, j;                                  /* iterators */
+
+    memset(newslots, 0, (newmask + 1) * sizeof(symslot));
+    for (i = 0; i <= table->mask; i++)
+    {
+        if (table->slots[i].id != 0)
+        {
+            /* linear probe for a free slot in the new index */
+            j = table->slots[i].hash & newmask;
+            while (newslots[j].id != 0)
+            {
+                j = (j + 1) & newmask;
+            }
+            newslots[j] = table->slots[i];
+        }
+    }
+
+    arenarealloc(table->mem, table->slots, 0);
+    table->slots = newslots;
+    table->mask  = newmask;
+}
+
+/* this function makes room in the table for count symbols in all,
+   so that adding them never has to grow the index */
+static void reservesymtable(symtable *table, size_t count)
+{
+    uint32_t newmask = table->mask;  /* new slot mask */
+
+    while (count * 2 > (size_t)newmask + 1)
+    {
+        newmask = newmask * 2 + 1;
+    }
+    if (newmask != table->mask)
+    {
+        growsymtable(table, newmask);
+    }
+
+    if (count > table->cap)
+    {
+        table->cap = count;
+        table->syms = arenarealloc(table->mem, table->syms, table->cap * sizeof(symbol));
+    }
+}
+
+/* this function takes in a table, a name of len characters and an
+   address and adds the symbol to the table. the caller checks for
+   duplicates first with findsymbol. returns the id of the new symbol */
+static int addsymbol(symtable *table, const char *name, size_t len, int address)
+{
+    uint32_t hash = symhash(name, len);  /* hash of the name */
+    uint32_t i;                          /* slot iterator */
+
+    /* keep the load factor at or below one half */
+    if ((table->count + 1) * 2 > table->mask + 1)
+    {
+        growsymtable(table, table->mask * 2 + 1);
+    }
+
+    /* make room for the symbol and its name */
+    if (table->count == table->cap)
+    {
+        table->cap = table->cap ? table->cap * 2 : SYM_SLOTS;
+        table->syms = arenarealloc(table->mem, table->syms, table->cap * sizeof(symbol));
+    }
+    if (table->nameslen + len + 1 > table->namescap)
+    {
+        while (table->nameslen + len + 1 > table->namescap)
+        {
+            table->namescap = table->namescap ? table->namescap * 2 : 1024;
+        }
+        table->names = arenarealloc(table->mem, table->names, table->namescap);
+    }
+
+    /* intern the name and fill in the symbol */
+    memcpy(table->names + table->nameslen, name, len);
+    table->names[table->nameslen + len] = '\0';
+    table->syms[table->count].name    = (uint32_t)table->nameslen;
+    table->syms[table->count].address = address;
+    table->syms[table->count].line    = 0;
+    table->syms[table->count].flags   = 0;
+    table->nameslen += len + 1;
+
+    /* linear probe for a free slot */
+    i = hash & table->mask;
+    while (table->slots[i].id != 0)
+    {
+        i = (i + 1) & table->mask;
+    }
+    table->slots[i].hash = hash;
+    table->slots[i].id   = table->count + 1;
+
+    return (int)table->count++;
+}
+
+/* this function takes in a table and a name of len characters and
+   returns the id of the symbol with that name, or -1 if there is none */
+static int findsymbol(const symtable *table, const char *name, size_t len)
+{
+    uint32_t hash = symhash(name, len);  /* hash of the name */
+    uint32_t i = hash & table->mask;     /* slot iterator */
+    uint32_t id;                         /* candidate symbol id */
+    const char *cand;                    /* name of the candidate */
+
+    /* probe until we hit an empty slot */
+    while (table->slots[i].id != 0)
+    {
+        if (table->slots[i].hash == hash)
+        {
+            id = table->slots[i].id - 1;
+            cand = table->names + table->syms[id].name;
+            if (memcmp(cand, name, len) == 0 && cand[len] == '\0')
+            {
+                /* found matching symbol */
+                return (int)id;
+            }
+        }
+        i = (i + 1) & table->mask;
+    }
+
+    /* matching symbol was not found */
+    return -1;
+}
+
+/* this function takes in a table and the name of a symbol used as an
+   operand. it returns the id of the symbol, adding it as undefined if
+   it has not been seen yet, so pass two resolves it without a lookup */
+static int refsymbol(symtable *table, const char *name, size_t len)
+{
+    int id = findsymbol(table, name, len);  /* id of the symbol */
+
+    if (id < 0)
+    {
+        id = addsymbol(table, name, len, SYM_UNDEFINED);
+    }
+    return id;
+}
+
+/* instructions.c 
+
+   this file contains the functions used to facilitate
+   the arrays that will hold all the assembly instructions
+   and data words
+*/
+
+
+/*************** functions ***********************/
+
+/* this function takes in an arena, a list pointer and a record,
+   and will then copy the record to the end of the list */
+static void add_inst(arena *mem, instlist *list, const instrec *rec)
+{
+    /* double the array when it is full */
+    if (list->count == list->cap)
+    {
+        list->cap = list->cap ? list->cap * 2 : 1024;
+        list->recs = arenarealloc(mem, list->recs, list->cap * sizeof(instrec));
+    }
+    list->recs[list->count++] = *rec;
+}
+
+
+/***************** Functions ******************/
+
+/* this function takes in an arena, a list pointer and a word,
+   and will then add the word to the end of the list */
+static void add_dataword(arena *mem, datalist *list, uint32_t word)
+{
+    /* double the array when it is full */
+    if (list->count == list->cap)
+    {
+        list->cap = list->cap ? list->cap * 2 : 1024;
+        list->words = arenarealloc(mem, list->words, list->cap * sizeof(uint32_t));
+    }
+    list->words[list->count++] = word;
+}
+/* errorlist.c -   this file contains functions for use with the
+   error list.
+*/
+
+/***************** Functions  ***************/
+
+/* this function takes in a list pointer and a node pointer,
+   and will then add the node to the list in order of line number.
+   errors mostly arrive in line order, so the tail and the last
+   insertion point are tried before walking from the head */
+static void add_err(errlist *list, errnode *node)
+{
+    node->next = NULL;
+
+    /* if head is null, make new node the head of the list */
+    if (list->head == NULL)
+    {
+        list->head = node;
+        list->tail = node;
+    }
+    /* at or past the last line, append to the tail */
+    else if (node->lineno >= list->tail->lineno)
+    {
+        list->tail->next = node;
+        list->tail = node;
+    }
+    /* is lineno before head? replace */
+    else if (node->lineno < list->head->lineno)
+    {
+        node->next = list->head;
+        list->head = node;
+    }
+    else
+    {
+        /* resume from the last insertion point if it is not past
+           our line, otherwise start over at the head */
+        if (list->cur == NULL || list->cur->lineno > node->lineno)
+        {
+            list->cur = list->head;
+        }
+
+        /* loop through list looking for insertion point, the tail
+           check above guarantees one is found before the end */
+        while (node->lineno >= list->cur->next->lineno)
+        {
+            list->cur = list->cur->next;
+        }
+
+        /* found insertion point, add node in */
+        node->next = list->cur->next;
+        list->cur->next = node;
+    }
+    list->count++;
+
+    /* remember where we inserted */
+    list->cur = node;
+}
+
+/* this function takes in a list and an arena and copies every node
+   of the list and its opcode or symbol name into the arena, so the
+   list outlives the arena its nodes came from */
+static void keeperrors(errlist *list, arena *mem)
+{
+    errnode *node;  /* node being copied */
+    errnode *copy;  /* its copy */
+    errnode *prev;  /* copy before it */
+
+    prev = NULL;
+    for (node = list->head; node != NULL; node = node->next)
+    {
+        copy = arenaalloc(mem, sizeof(errnode));
+        *copy = *node;
+        if (node->symbol != NULL)
+        {
+            copy->symbol = arenastrndup(mem, node->symbol, strlen(node->symbol));
+        }
+        if (node->opcode != NULL)
+        {
+            copy->opcode = arenastrndup(mem, node->opcode, strlen(node->opcode));
+        }
+
+        if (prev == NULL)
+        {
+            list->head = copy;
+        }
+        else
+        {
+            prev->next = copy;
+        }
+        prev = copy;
+    }
+    list->tail = prev;
+    list->cur = NULL;
+}
+
+/* arena.c - this file contains the bump allocator that owns
+   every object created while assembling a file
+*/
+
+/***************** Functions  ***************/
+
+/* this function jumps out of the allocation that failed to the
+   thread's nomemjump. everything taken from an arena so far is still
+   owned by the arena, so the call that set the jump frees it */
+static void nomemory(void)
+{
+    longjmp(*nomemjump, 1);
+}
+
+/* allocates a new block with room for at least size bytes */
+static arenablock *newarenablock(size_t size)
+{
+    arenablock *block;  /* new block */
+
+    /* small requests share a default sized block */
+    if (size < ARENA_BLOCK)
+    {
+        size = ARENA_BLOCK;
+    }
+
+    block = malloc(sizeof(arenablock) + size);
+    if (block == NULL)
+    {
+        nomemory();
+    }
+    block->next = NULL;
+    block->used = 0;
+    block->size = size;
+
+    return block;
+}
+
+/* sets up an arena with no blocks, the first allocation adds one */
+static void initarena(arena *mem)
+{
+    mem->first = NULL;
+    mem->cur   = NULL;
+    mem->big   = NULL;
+}
+
+/* this function takes in an arena and a size and returns a pointer
+   to size bytes of zeroed memory, aligned to ARENA_ALIGN */
+static void *arenaalloc(arena *mem, size_t size)
+{
+    arenablock *block;  /* block to allocate from */
+    void *ptr;          /* memory handed out */
+
+    /* round up so the next allocation stays aligned */
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    block = mem->cur;
+    if (block == NULL || block->used + size > block->size)
+    {
+        /* move on through blocks left over from a reset until one
+           is big enough, otherwise chain a fresh block in after the
+           current one */
+        while (block != NULL && block->next != NULL)
+        {
+            block = block->next;
+            block->used = 0;
+            if (size <= block->size)
+            {
+                break;
+            }
+        }
+        if (block == NULL || block->used + size > block->size)
+        {
+            arenablock *fresh = newarenablock(size);
+
+            if (block == NULL)
+            {
+                mem->first = fresh;
+            }
+            else
+            {
+                fresh->next = block->next;
+                block->next = fresh;
+            }
+            block = fresh;
+        }
+        mem->cur = block;
+    }
+
+    /* bump the pointer */
+    ptr = (char *)(block + 1) + block->used;
+    block->used += size;
+    memset(ptr, 0, size);
+
+    return ptr;
+}
+
+/* copies len characters into the arena, the copy is null
+   terminated since arena memory starts out zeroed */
+static char *arenastrndup(arena *mem, const char *str, size_t len)
+{
+    char *copy = arenaalloc(mem, len + 1);  /* new string */
+
+    return memcpy(copy, str, len);
+}
+
+/* this function takes in an arena, a buffer from an earlier call (or
+   NULL) and a size. it resizes the buffer with realloc so large arrays
+   such as the instruction records grow in place instead of leaving
+   copies behind in the blocks. like realloc, new memory is not
+   cleared. a size of 0 releases the buffer. the arena keeps track
+   of the buffer and frees it with everything else */
+static void *arenarealloc(arena *mem, void *ptr, size_t size)
+{
+    arenabig *big = ptr ? (arenabig *)ptr - 1 : NULL;  /* buffer header */
+    arenabig *grown;                                   /* after realloc */
+
+    if (size == 0)
+    {
+        /* unlink the buffer and let it go */
+        if (big != NULL)
+        {
+            if (big->prev != NULL)
+            {
+                big->prev->next = big->next;
+            }
+            else
+            {
+                mem->big = big->next;
+            }
+            if (big->next != NULL)
+            {
+                big->next->prev = big->prev;
+            }
+        }
+        free(big);
+        return NULL;
+    }
+
+    /* a buffer that cannot grow stays linked in, the arena frees it */
+    grown = realloc(big, sizeof(arenabig) + size);
+    if (grown == NULL)
+    {
+        nomemory();
+    }
+
+    if (big == NULL)
+    {
+        /* a new buffer goes in at the head */
+        grown->prev = NULL;
+        grown->next = mem->big;
+        if (mem->big != NULL)
+        {
+            mem->big->prev = grown;
+        }
+        mem->big = grown;
+    }
+    else
+    {
+        /* realloc may have moved it, its neighbours follow */
+        if (grown->prev != NULL)
+        {
+            grown->prev->next = grown;
+        }
+        else
+        {
+            mem->big = grown;
+        }
+        if (grown->next != NULL)
+        {
+            grown->next->prev = grown;
+        }
+    }
+
+    return grown + 1;
+}
+
+/* this function takes in an arena and rewinds it to the first block.
+   the blocks are kept, so assembling another file reuses the same
+   memory instead of going back to malloc */
+static void resetarena(arena *mem)
+{
+    /* growable buffers are not reused */
+    while (mem->big != NULL)
+    {
+        arenarealloc(mem, mem->big + 1, 0);
+    }
+
+    if (mem->first != NULL)
+    {
+        mem->first->used = 0;
+    }
+    mem->cur = mem->first;
+}
+
+/* this function takes in an arena and frees every block in it */
+static void freearena(arena *mem)
+{
+    arenablock *block = mem->first;  /* block to free */
+    arenablock *next;                /* block after it */
+
+    while (block != NULL)
+    {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+    mem->first = NULL;
+    mem->cur   = NULL;
+
+    /* and every growable buffer */
+    while (mem->big != NULL)
+    {
+        arenarealloc(mem, mem->big + 1, 0);
+    }
+}
+
+/* trace.c - this file contains the trace logger. messages are
+   collected in the buffer of the context and written out in large
+   blocks
+*/
+
+/***************** Functions  ***************/
+
+/* this function writes everything in the trace buffer to its file */
+static void flushtrace(tracer *t)
+{
+    size_t done = 0;  /* bytes written so far */
+    ssize_t n;        /* bytes written by one call */
+
+    while (done < t->len)
+    {
+        n = write(t->fd, t->buf + done, t->len - done);
+        if (n <= 0)
+        {
+            break;
+        }
+        done += (size_t)n;
+    }
+    t->len = 0;
+}
+
+/* this function takes in a printf style format and appends the
+   message to the trace buffer, flushing it first if it is too full */
+static void trace(tracer *t, const char *fmt, ...)
+{
+    va_list args;  /* format arguments */
+    int len;       /* length of the message */
+
+    /* make sure a reasonable message fits */
+    if (t->len > TRACE_LEN - 1024)
+    {
+        flushtrace(t);
+    }
+
+    va_start(args, fmt);
+    len = vsnprintf(t->buf + t->len, TRACE_LEN - t->len, fmt, args);
+    va_end(args);
+
+    if (len < 0)
+    {
+        return;
+    }
+    /* message was cut short, keep what fit */
+    if ((size_t)len >= TRACE_LEN - t->len)
+    {
+        len = (int)(TRACE_LEN - t->len - 1);
+    }
+    t->len += (size_t)len;
+}
+
+/* objwriter.c - this file contains the obj file writer. lines are
+   formatted straight into a large buffer with a hex lookup table,
+   or words are packed into it in the byte order asked for, and the
+   buffer goes out with one write call each time it fills
+*/
+
+/************* Variables ***************/
+
+/* two hex digits for every byte value */
+static const char hexpairs[513] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+/***************** Functions  ***************/
+
+/* this function writes len bytes from buf to fd, retrying
+   short writes. returns 0 on success */
+static int writeall(int fd, const char *buf, size_t len)
+{
+    ssize_t n;  /* bytes written by one call */
+
+    while (len > 0)
+    {
+        n = write(fd, buf, len);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* this function starts an obj file written to an open file and
+   takes its buffer from the arena */
+static void openobj(objwriter *out, arena *mem, int fd, int format)
+{
+    out->format = format;
+    out->fd = fd;
+    out->buf = arenaalloc(mem, OBJ_BUF_LEN);
+    out->len = 0;
+    out->cap = OBJ_BUF_LEN;
+    out->mem = mem;
+    out->failed = 0;
+    out->done = 0;
+    out->base = lseek(fd, 0, SEEK_CUR);
+}
+
+/* this function starts an obj file that stays in memory. the buffer
+   grows instead of being written out, and holds the whole file once
+   closeobj is called */
+static void openobjmem(objwriter *out, arena *mem, int format)
+{
+    out->format = format;
+    out->fd = -1;
+    out->buf = arenarealloc(mem, NULL, OBJ_BUF_LEN);
+    out->len = 0;
+    out->cap = OBJ_BUF_LEN;
+    out->mem = mem;
+    out->failed = 0;
+    out->done = 0;
+    out->base = 0;
+}
+
+/* this function formats a word as eight hex digits at p */
+static void putword(char *p, uint32_t word)
+{
+    memcpy(p,     hexpairs + (word >> 24) * 2, 2);
+    memcpy(p + 2, hexpairs + ((word >> 16) & 0xFF) * 2, 2);
+    memcpy(p + 4, hexpairs + ((word >> 8) & 0xFF) * 2, 2);
+    memcpy(p + 6, hexpairs + (word & 0xFF) * 2, 2);
+}
+
+/* this function stores a word at p as four bytes, most significant
+   first for ASM_FORMAT_BIN_BE and least significant first otherwise */
+static void packword(char *p, uint32_t word, int format)
+{
+    unsigned char *b = (unsigned char *)p;  /* bytes of the word */
+
+    if (format == ASM_FORMAT_BIN_BE)
+    {
+        b[0] = (unsigned char)(word >> 24);
+        b[1] = (unsigned char)(word >> 16);
+        b[2] = (unsigned char)(word >> 8);
+        b[3] = (unsigned char)word;
+    }
+    else
+    {
+        b[0] = (unsigned char)word;
+        b[1] = (unsigned char)(word >> 8);
+        b[2] = (unsigned char)(word >> 16);
+        b[3] = (unsigned char)(word >> 24);
+    }
+}
+
+/* this function makes room for len more bytes in the buffer, by
+   writing it out or by growing it when it is kept in memory, and
+   returns where they go */
+static char *reserveobj(objwriter *out, size_t len)
+{
+    if (out->len > out->cap - len)
+    {
+        if (out->fd < 0)
+        {
+            out->cap *= 2;
+            out->buf = arenarealloc(out->mem, out->buf, out->cap);
+        }
+        else
+        {
+            if (writeall(out->fd, out->buf, out->len) != 0)
+            {
+                out->failed = 1;
+            }
+            out->done += out->len;
+            out->len = 0;
+        }
+    }
+    return out->buf + out->len;
+}
+
+/* this function takes in an address and a word and appends the line
+   0x0000AAAA:\t0xWWWWWWWW\n to the buffer. only the low 16 bits of
+   the address are printed. packed formats append the word alone */
+static void emitword(objwriter *out, uint32_t addr, uint32_t word)
+{
+    char *p = reserveobj(out, OBJ_LINE_LEN);  /* where the line goes */
+
+    if (out->format != ASM_FORMAT_OBJ)
+    {
+        packword(p, word, out->format);
+        out->len += sizeof(uint32_t);
+        return;
+    }
+
+    memcpy(p, "0x0000", 6);
+    memcpy(p + 6,  hexpairs + ((addr >> 8) & 0xFF) * 2, 2);
+    memcpy(p + 8,  hexpairs + (addr & 0xFF) * 2, 2);
+    memcpy(p + 10, ":\t0x", 4);
+    putword(p + OBJ_WORD_POS, word);
+    p[22] = '\n';
+
+    out->len += OBJ_LINE_LEN;
+}
+
+/* this function takes in an address and a word and rewrites the word
+   emitted for that address. every line is as long as the next, so
+   the line is found by its address. a word still in the buffer is
+   changed there, one that went out is written over in the file,
+   which then has to be a regular file */
+static void patchword(objwriter *out, uint32_t addr, uint32_t word)
+{
+    size_t pos;     /* offset of the word */
+    size_t len;     /* bytes of the word */
+    char text[8];   /* word to write over the file */
+    char *p;        /* where the word is formatted */
+
+    if (out->format == ASM_FORMAT_OBJ)
+    {
+        pos = (size_t)addr * OBJ_LINE_LEN + OBJ_WORD_POS;
+        len = sizeof(text);
+    }
+    else
+    {
+        pos = (size_t)addr * sizeof(uint32_t);
+        len = sizeof(uint32_t);
+    }
+
+    p = pos >= out->done ? out->buf + (pos - out->done) : text;
+    if (out->format == ASM_FORMAT_OBJ)
+    {
+        putword(p, word);
+    }
+    else
+    {
+        packword(p, word, out->format);
+    }
+
+    if (p == text &&
+        (out->base < 0 || pwrite(out->fd, text, len, out->base + (off_t)pos) != (ssize_t)len))
+    {
+        out->failed = 1;
+    }
+}
+
+/* this function flushes the buffer, the file stays open. an obj
+   file in memory is left in the buffer */
+static int closeobj(objwriter *out)
+{
+    if (out->fd < 0)
+    {
+        return 0;
+    }
+    if (out->len > 0 && writeall(out->fd, out->buf, out->len) != 0)
+    {
+        out->failed = 1;
+    }
+    out->done += out->len;
+    out->len = 0;
+    return out->failed ? -1 : 0;
+}
+
+/* this function returns the packed format whose byte order a format
+   stores its words in, ASM_FORMAT_BIN_BE or ASM_FORMAT_BIN_LE */
+static int packorder(int format)
+{
+    return format == ASM_FORMAT_BIN_BE || format == ASM_FORMAT_ELF_BE ||
+           format == ASM_FORMAT_IHEX_BE || format == ASM_FORMAT_SREC_BE ||
+           format == ASM_FORMAT_REL_BE ?
+           ASM_FORMAT_BIN_BE : ASM_FORMAT_BIN_LE;
+}
+
+/* this function copies len bytes of the words, packed in the byte
+   order of a packed format, from byte address pos on to bytes. pos
+   need not be on a word boundary */
+static void imagebytes(const uint32_t *words, int order, size_t pos, size_t len,
+                       unsigned char *bytes)
+{
+    unsigned shift;  /* bit position of the byte in its word */
+    size_t k;        /* byte iterator */
+
+    for (k = 0; k < len; k++, pos++)
+    {
+        shift = (unsigned)(pos & 3) * 8;
+        shift = order == ASM_FORMAT_BIN_BE ? 24 - shift : shift;
+        bytes[k] = (unsigned char)(words[pos >> 2] >> shift);
+    }
+}
+
+/* this function takes in a start mark, such as ":" or "S3", and the
+   len bytes of a record and appends the record line: the mark, the
+   bytes in hex and their checksum. Intel HEX checks with the two's
+   complement of the byte sum, S-records with the ones' complement */
+static void putrecord(objwriter *out, const char *mark, const unsigned char *rec,
+                      size_t len, int srec)
+{
+    char *p = reserveobj(out, RECORD_LINE_LEN);  /* where the line goes */
+    size_t marklen = strlen(mark);               /* characters of the mark */
+    unsigned sum = 0;                            /* sum of the bytes */
+    size_t k;                                    /* byte iterator */
+
+    memcpy(p, mark, marklen);
+    p += marklen;
+    for (k = 0; k < len; k++)
+    {
+        memcpy(p, hexpairs + rec[k] * 2, 2);
+        p += 2;
+        sum += rec[k];
+    }
+    sum = (srec ? ~sum : 0U - sum) & 0xFF;
+    memcpy(p, hexpairs + sum * 2, 2);
+    p[2] = '\n';
+
+    out->len += marklen + len * 2 + 3;
+}
+
+/* this function takes in the words of a program and writes them as
+   Intel HEX records, each as long as the format allows. a record does
+   not cross a 64K boundary, an extended linear address record in
+   front of every 64K past the first sets the upper address bits */
+static void writeihex(objwriter *out, const uint32_t *words, size_t nwords)
+{
+    unsigned char rec[HEX_RECORD_DATA + 4];  /* bytes of a record */
+    size_t size = nwords * sizeof(uint32_t); /* bytes of the image */
+    int order = packorder(out->format);      /* byte order of the words */
+    size_t pos;                              /* address of the record */
+    size_t len;                              /* data bytes in it */
+
+    for (pos = 0; pos < size; pos += len)
+    {
+        if (pos > 0 && (pos & 0xFFFF) == 0)
+        {
+            rec[0] = 2;
+            rec[1] = 0;
+            rec[2] = 0;
+            rec[3] = HEX_EXTADDR;
+            rec[4] = (unsigned char)(pos >> 24);
+            rec[5] = (unsigned char)(pos >> 16);
+            putrecord(out, ":", rec, 6, 0);
+        }
+
+        len = 0x10000 - (pos & 0xFFFF);
+        len = len < HEX_RECORD_DATA ? len : HEX_RECORD_DATA;
+        len = len < size - pos ? len : size - pos;
+        rec[0] = (unsigned char)len;
+        rec[1] = (unsigned char)(pos >> 8);
+        rec[2] = (unsigned char)pos;
+        rec[3] = HEX_DATA;
+        imagebytes(words, order, pos, len, rec + 4);
+        putrecord(out, ":", rec, len + 4, 0);
+    }
+
+    rec[0] = 0;
+    rec[1] = 0;
+    rec[2] = 0;
+    rec[3] = HEX_EOF;
+    putrecord(out, ":", rec, 4, 0);
+}
+
+/* this function takes in the words of a program and writes them as
+   Motorola S-records. the shortest address that reaches the end of the
+   program is used, S1, S2 or S3 records with the matching S9, S8 or S7
+   at the end, and each record is as long as its count byte allows */
+static void writesrec(objwriter *out, const uint32_t *words, size_t nwords)
+{
+    static const char *const datamarks[] = { "S1", "S2", "S3" };  /* by address bytes - 2 */
+    static const char *const endmarks[] = { "S9", "S8", "S7" };   /* the same */
+    unsigned char rec[SREC_RECORD_COUNT + 1]; /* bytes of a record */
+    size_t size = nwords * sizeof(uint32_t);  /* bytes of the image */
+    int order = packorder(out->format);       /* byte order of the words */
+    int addrlen;                              /* bytes of an address */
+    size_t pos;                               /* address of the record */
+    size_t len;                               /* data bytes in it */
+    size_t most;                              /* most data bytes in a record */
+    int k;                                    /* address byte iterator */
+
+    addrlen = size <= 0x10000 ? 2 : (size <= 0x1000000 ? 3 : 4);
+    most = SREC_RECORD_COUNT - (size_t)addrlen - 1;
+
+    /* header record, no name */
+    rec[0] = 3;
+    rec[1] = 0;
+    rec[2] = 0;
+    putrecord(out, "S0", rec, 3, 1);
+
+    for (pos = 0; pos < size; pos += len)
+    {
+        len = most < size - pos ? most : size - pos;
+        rec[0] = (unsigned char)(addrlen + len + 1);
+        for (k = 0; k < addrlen; k++)
+        {
+            rec[1 + k] = (unsigned char)(pos >> ((addrlen - 1 - k) * 8));
+        }
+        imagebytes(words, order, pos, len, rec + 1 + addrlen);
+        putrecord(out, datamarks[addrlen - 2], rec, 1 + (size_t)addrlen + len, 1);
+    }
+
+    /* the program starts at address 0 */
+    memset(rec, 0, (size_t)addrlen + 1);
+    rec[0] = (unsigned char)(addrlen + 1);
+    putrecord(out, endmarks[addrlen - 2], rec, 1 + (size_t)addrlen, 1);
+}
+
+/* elf.c - this file lays out the ELF file of a result. an executable
+   is a MIPS32 program with the text at address 0 and the data straight
+   after it, as the words were encoded. a relocatable object has the
+   same sections at address 0 and a .rel.text section that tells the
+   linker which words to fill in once it knows where everything goes.
+   the size of every part is known from the result, so the headers,
+   the words, the symbols and the names all go straight into one
+   buffer in the byte order asked for
+*/
+
+/************* Variables ***************/
+
+/* names of the sections, in section header order */
+static const char *const elfnames[ELF_SECTIONS] =
+{
+    "", ".text", ".data", ".symtab", ".strtab", ".shstrtab", ".rel.text"
+};
+
+/***************** Functions  ***************/
+
+/* this function stores a half word at p in the byte order of a
+   packed format */
+static void packhalf(char *p, uint16_t half, int format)
+{
+    unsigned char *b = (unsigned char *)p;  /* bytes of the half word */
+
+    if (format == ASM_FORMAT_BIN_BE)
+    {
+        b[0] = (unsigned char)(half >> 8);
+        b[1] = (unsigned char)half;
+    }
+    else
+    {
+        b[0] = (unsigned char)half;
+        b[1] = (unsigned char)(half >> 8);
+    }
+}
+
+/* this function stores a header made only of 32 bit fields, such as
+   a program or section header, at p in the byte order of a packed
+   format */
+static void packheader(char *p, const void *header, size_t size, int format)
+{
+    const uint32_t *fields = header;  /* fields of the header */
+    size_t k;                         /* field iterator */
+
+    for (k = 0; k < size / sizeof(uint32_t); k++)
+    {
+        packword(p + k * sizeof(uint32_t), fields[k], format);
+    }
+}
+
+/* this function returns 1 if a result uses symbols that another
+   object has to define, which only a relocatable object can hold */
+static int hasimports(const asm_result *res)
+{
+    uint32_t id;  /* symbol iterator */
+
+    for (id = 0; id < res->symbols.count; id++)
+    {
+        if (res->symbols.syms[id].address == SYM_UNDEFINED &&
+            (res->symbols.syms[id].flags & (SYM_GLOBAL | SYM_EXTERN)))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* this function returns 1 if a symbol goes into the ELF symbol table
+   as a global one. a label that is not defined can only be found in
+   another object, so it is global too */
+static int elfglobal(const symbol *sym)
+{
+    return (sym->flags & (SYM_GLOBAL | SYM_EXTERN)) || sym->address == SYM_UNDEFINED;
+}
+
+/* this function takes in a record that uses a symbol and the symbol
+   and returns the relocation the word needs in a relocatable object.
+   a branch to a label of the same text stays right wherever the text
+   goes, so it only needs one when the label is in another object or
+   in the data, which the linker moves past the text of every object */
+static uint32_t reloctype(const instrec *rec, const symbol *sym)
+{
+    if (rec->flags & REC_HI)
+    {
+        return R_MIPS_HI16;
+    }
+    if (rec->flags & REC_LO)
+    {
+        return R_MIPS_LO16;
+    }
+    if (optable[rec->op].shape == SHAPE_L)
+    {
+        return R_MIPS_26;
+    }
+    return sym->address == SYM_UNDEFINED || (sym->flags & SYM_DATA) ? R_MIPS_PC16 : R_MIPS_NONE;
+}
+
+/* this function takes in a list of relocations, an arena, the address
+   of a word, a program symbol id and a relocation type and appends
+   the relocation, growing the list as needed */
+static void addreloc(reloclist *list, arena *mem, uint32_t addr, uint32_t sym, uint32_t type)
+{
+    if (type == R_MIPS_NONE)
+    {
+        return;
+    }
+    if (list->count == list->cap)
+    {
+        list->cap = list->cap ? list->cap * 2 : 1024;
+        list->relocs = arenarealloc(mem, list->relocs, list->cap * sizeof(reloc));
+    }
+    list->relocs[list->count].addr = addr;
+    list->relocs[list->count].sym = sym;
+    list->relocs[list->count].type = type;
+    list->count++;
+}
+
+/* this function takes in a result, an arena and an empty list and
+   fills the list with the relocations of the words, in address
+   order. they come from the program records, or when the cache was
+   used from the records each chunk kept of its words with a symbol */
+static void collectrelocs(const asm_result *res, arena *mem, reloclist *list)
+{
+    const symtable *symbols = &res->symbols;  /* program symbols */
+    const chunk *c;                           /* chunk of the cache */
+    const instrec *rec;                       /* record with a symbol */
+    uint32_t gid;                             /* program symbol id */
+    size_t n;                                 /* record iterator */
+    int k;                                    /* chunk iterator */
+
+    if (res->recs != NULL)
+    {
+        for (n = 0; n < res->ntext; n++)
+        {
+            rec = &res->recs[n];
+            if (rec->flags & REC_SYMBOL)
+            {
+                gid = (uint32_t)rec->imm;
+                addreloc(list, mem, (uint32_t)n, gid, reloctype(rec, &symbols->syms[gid]));
+            }
+        }
+        return;
+    }
+    for (k = 0; k < res->nchunks; k++)
+    {
+        c = &res->chunks[k];
+        for (n = 0; n < c->nfix; n++)
+        {
+            rec = &c->fixrecs[n];
+            gid = (uint32_t)c->symmap[rec->imm];
+            addreloc(list, mem, (uint32_t)(c->instbase + c->fixidx[n]), gid,
+                     reloctype(rec, &symbols->syms[gid]));
+        }
+    }
+}
+
+/* this function takes in a result, its text as laid out in an ELF
+   executable, the byte order of the file and the word with the upper
+   half of an la. it gives the lui and the ori after it the byte
+   address of the label in place of the word address */
+static void bytepair(const asm_result *res, char *text, int order, size_t hi)
+{
+    uint32_t addr;  /* address the la loads */
+
+    if (hi + 1 >= res->ntext)
+    {
+        return;
+    }
+    addr = (res->words[hi] & IMM_MASK) << 16 | (res->words[hi + 1] & IMM_MASK);
+    addr *= sizeof(uint32_t);
+    packword(text + hi * sizeof(uint32_t), (res->words[hi] & ~IMM_MASK) | addr >> 16, order);
+    packword(text + (hi + 1) * sizeof(uint32_t),
+             (res->words[hi + 1] & ~IMM_MASK) | (addr & IMM_MASK), order);
+}
+
+/* this function takes in a result, its text as laid out in an ELF
+   executable and the byte order of the file. an executable is byte
+   addressed like any MIPS program, its symbols are, so every la has
+   to load a byte address too. the words of a result hold word
+   addresses, the la words are found the way collectrelocs finds the
+   words with a symbol, or for a link in hiwords. a relocatable object
+   needs nothing, the linker fills its la words in from the symbols */
+static void elfaddresses(const asm_result *res, char *text, int order)
+{
+    const chunk *c;  /* chunk of the cache */
+    size_t n;        /* record iterator */
+    int k;           /* chunk iterator */
+
+    if (res->recs != NULL)
+    {
+        for (n = 0; n < res->ntext; n++)
+        {
+            if (res->recs[n].flags & REC_HI)
+            {
+                bytepair(res, text, order, n);
+            }
+        }
+        return;
+    }
+    for (n = 0; n < res->nhiwords; n++)
+    {
+        bytepair(res, text, order, res->hiwords[n]);
+    }
+    for (k = 0; k < res->nchunks; k++)
+    {
+        c = &res->chunks[k];
+        for (n = 0; n < c->nfix; n++)
+        {
+            if (c->fixrecs[n].flags & REC_HI)
+            {
+                bytepair(res, text, order, c->instbase + c->fixidx[n]);
+            }
+        }
+    }
+}
+
+/* this function takes in a result, an arena, one of the ASM_FORMAT_ELF
+   or ASM_FORMAT_REL formats and a length. it works out where every
+   section goes, lays the whole file out in one buffer from the arena
+   and sets len to its size. local labels come first in the symbol
+   table as ELF wants, then the global ones */
+static char *layoutelf(const asm_result *res, arena *mem, int format, size_t *len)
+{
+    const symtable *symbols = &res->symbols;  /* the labels */
+    Elf32_Shdr sh[ELF_SECTIONS];  /* section headers */
+    Elf32_Phdr ph[ELF_SEGMENTS];  /* program headers */
+    reloclist relocs;     /* words the linker fills in */
+    uint32_t *elfids;     /* symbol table index of every program symbol */
+    int rel;              /* writing a relocatable object */
+    int nsections;        /* section headers written */
+    int order;            /* byte order as a packed format */
+    size_t textlen;       /* bytes of instructions */
+    size_t pos;           /* end of the file laid out so far */
+    size_t shoff;         /* offset of the section headers */
+    char *buf;            /* the file */
+    char *p;              /* part being filled in */
+    char *q;              /* relocation being filled in */
+    const symbol *sym;    /* label being written */
+    uint32_t value;       /* its value */
+    uint32_t mask;        /* field of a word a relocation fills in */
+    uint32_t nlocal;      /* local symbols */
+    uint32_t next;        /* next symbol table index */
+    uint32_t id;          /* symbol iterator */
+    size_t n;             /* word and relocation iterator */
+    int global;           /* pass over the symbols, locals then globals */
+    int k;                /* section iterator */
+
+    rel = format == ASM_FORMAT_REL_LE || format == ASM_FORMAT_REL_BE;
+    nsections = rel ? ELF_SECTIONS : ELF_RELTEXT;
+    order = packorder(format);
+    textlen = res->ntext * sizeof(uint32_t);
+
+    memset(&relocs, 0, sizeof(relocs));
+    if (rel)
+    {
+        collectrelocs(res, mem, &relocs);
+    }
+
+    /* symbol table indexes, the null symbol is 0 and locals come first */
+    elfids = arenarealloc(mem, NULL, (symbols->count + 1) * sizeof(uint32_t));
+    next = 1;
+    nlocal = 1;
+    for (global = 0; global < 2; global++)
+    {
+        for (id = 0; id < symbols->count; id++)
+        {
+            if (elfglobal(&symbols->syms[id]) == global)
+            {
+                elfids[id] = next++;
+            }
+        }
+        if (!global)
+        {
+            nlocal = next;
+        }
+    }
+
+    /* describe the sections. in an executable the text and the data
+       load at the addresses their words were encoded for */
+    memset(sh, 0, sizeof(sh));
+    sh[ELF_TEXT].sh_type = SHT_PROGBITS;
+    sh[ELF_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    sh[ELF_TEXT].sh_size = (Elf32_Word)textlen;
+    sh[ELF_TEXT].sh_addralign = sizeof(uint32_t);
+
+    sh[ELF_DATA].sh_type = SHT_PROGBITS;
+    sh[ELF_DATA].sh_flags = SHF_ALLOC | SHF_WRITE;
+    sh[ELF_DATA].sh_addr = rel ? 0 : (Elf32_Addr)textlen;
+    sh[ELF_DATA].sh_size = (Elf32_Word)((res->nwords - res->ntext) * sizeof(uint32_t));
+    sh[ELF_DATA].sh_addralign = sizeof(uint32_t);
+
+    sh[ELF_SYMTAB].sh_type = SHT_SYMTAB;
+    sh[ELF_SYMTAB].sh_size = (symbols->count + 1) * sizeof(Elf32_Sym);
+    sh[ELF_SYMTAB].sh_link = ELF_STRTAB;
+    sh[ELF_SYMTAB].sh_info = nlocal;
+    sh[ELF_SYMTAB].sh_addralign = sizeof(uint32_t);
+    sh[ELF_SYMTAB].sh_entsize = sizeof(Elf32_Sym);
+
+    /* the names of the table are null terminated back to back
+       already, they only need the empty name in front */
+    sh[ELF_STRTAB].sh_type = SHT_STRTAB;
+    sh[ELF_STRTAB].sh_size = (Elf32_Word)(symbols->nameslen + 1);
+    sh[ELF_STRTAB].sh_addralign = 1;
+
+    sh[ELF_SHSTRTAB].sh_type = SHT_STRTAB;
+    sh[ELF_SHSTRTAB].sh_addralign = 1;
+    for (k = 0; k < nsections; k++)
+    {
+        sh[k].sh_name = sh[ELF_SHSTRTAB].sh_size;
+        sh[ELF_SHSTRTAB].sh_size += (Elf32_Word)strlen(elfnames[k]) + 1;
+    }
+
+    sh[ELF_RELTEXT].sh_type = SHT_REL;
+    sh[ELF_RELTEXT].sh_size = (Elf32_Word)(relocs.count * sizeof(Elf32_Rel));
+    sh[ELF_RELTEXT].sh_link = ELF_SYMTAB;
+    sh[ELF_RELTEXT].sh_info = ELF_TEXT;
+    sh[ELF_RELTEXT].sh_addralign = sizeof(uint32_t);
+    sh[ELF_RELTEXT].sh_entsize = sizeof(Elf32_Rel);
+
+    /* the text of an executable starts a page in, so a segment's file
+       offset and address agree modulo the page size. an object has
+       no segments and starts right after the file header */
+    pos = rel ? sizeof(Elf32_Ehdr) : ELF_PAGE;
+    for (k = ELF_TEXT; k < nsections; k++)
+    {
+        pos = (pos + sh[k].sh_addralign - 1) & ~(size_t)(sh[k].sh_addralign - 1);
+        sh[k].sh_offset = (Elf32_Off)pos;
+        pos += sh[k].sh_size;
+    }
+    shoff = (pos + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+    *len = shoff + (size_t)nsections * sizeof(Elf32_Shdr);
+
+    memset(ph, 0, sizeof(ph));
+    for (k = 0; k < ELF_SEGMENTS; k++)
+    {
+        ph[k].p_type = PT_LOAD;
+        ph[k].p_offset = sh[ELF_TEXT + k].sh_offset;
+        ph[k].p_vaddr = sh[ELF_TEXT + k].sh_addr;
+        ph[k].p_paddr = sh[ELF_TEXT + k].sh_addr;
+        ph[k].p_filesz = sh[ELF_TEXT + k].sh_size;
+        ph[k].p_memsz = sh[ELF_TEXT + k].sh_size;
+        ph[k].p_align = ELF_PAGE;
+    }
+    ph[0].p_flags = PF_R | PF_X;
+    ph[1].p_flags = PF_R | PF_W;
+
+    buf = arenarealloc(mem, NULL, *len);
+    memset(buf, 0, sh[ELF_TEXT].sh_offset);
+    memset(buf + pos, 0, *len - pos);
+
+    /* file header */
+    memcpy(buf, ELFMAG, SELFMAG);
+    buf[EI_CLASS] = ELFCLASS32;
+    buf[EI_DATA] = order == ASM_FORMAT_BIN_BE ? ELFDATA2MSB : ELFDATA2LSB;
+    buf[EI_VERSION] = EV_CURRENT;
+    packhalf(buf + offsetof(Elf32_Ehdr, e_type), rel ? ET_REL : ET_EXEC, order);
+    packhalf(buf + offsetof(Elf32_Ehdr, e_machine), EM_MIPS, order);
+    packword(buf + offsetof(Elf32_Ehdr, e_version), EV_CURRENT, order);
+    packword(buf + offsetof(Elf32_Ehdr, e_entry), 0, order);
+    packword(buf + offsetof(Elf32_Ehdr, e_phoff), rel ? 0 : sizeof(Elf32_Ehdr), order);
+    packword(buf + offsetof(Elf32_Ehdr, e_shoff), (uint32_t)shoff, order);
+    packword(buf + offsetof(Elf32_Ehdr, e_flags), EF_MIPS_ARCH_32 | EF_MIPS_NOREORDER, order);
+    packhalf(buf + offsetof(Elf32_Ehdr, e_ehsize), sizeof(Elf32_Ehdr), order);
+    packhalf(buf + offsetof(Elf32_Ehdr, e_phentsize), rel ? 0 : sizeof(Elf32_Phdr), order);
+    packhalf(buf + offsetof(Elf32_Ehdr, e_phnum), rel ? 0 : ELF_SEGMENTS, order);
+    packhalf(buf + offsetof(Elf32_Ehdr, e_shentsize), sizeof(Elf32_Shdr), order);
+    packhalf(buf + offsetof(Elf32_Ehdr, e_shnum), (uint16_t)nsections, order);
+    packhalf(buf + offsetof(Elf32_Ehdr, e_shstrndx), ELF_SHSTRTAB, order);
+
+    for (k = 0; k < ELF_SEGMENTS && !rel; k++)
+    {
+        packheader(buf + sizeof(Elf32_Ehdr) + k * sizeof(Elf32_Phdr), &ph[k], sizeof(Elf32_Phdr), order);
+    }
+
+    /* the text and the data are the words in address order, in the
+       byte order of the host that is the word array as it is */
+    p = buf + sh[ELF_TEXT].sh_offset;
+    if (order == HOST_FORMAT)
+    {
+        memcpy(p, res->words, res->nwords * sizeof(uint32_t));
+    }
+    else
+    {
+        for (n = 0; n < res->nwords; n++)
+        {
+            packword(p + n * sizeof(uint32_t), res->words[n], order);
+        }
+    }
+    if (!rel)
+    {
+        elfaddresses(res, p, order);
+    }
+
+    /* a word the linker fills in holds 0 in that field, and the
+       relocation says what goes there */
+    for (n = 0; n < relocs.count; n++)
+    {
+        mask = relocs.relocs[n].type == R_MIPS_26 ? TARGET_MASK : IMM_MASK;
+        packword(p + relocs.relocs[n].addr * sizeof(uint32_t),
+                 res->words[relocs.relocs[n].addr] & ~mask, order);
+
+        q = buf + sh[ELF_RELTEXT].sh_offset + n * sizeof(Elf32_Rel);
+        packword(q + offsetof(Elf32_Rel, r_offset), relocs.relocs[n].addr * sizeof(uint32_t), order);
+        packword(q + offsetof(Elf32_Rel, r_info),
+                 ELF32_R_INFO(elfids[relocs.relocs[n].sym], relocs.relocs[n].type), order);
+    }
+
+    /* symbols, after the null one. in an object a value is the
+       offset in its section, in an executable the address */
+    memset(buf + sh[ELF_SYMTAB].sh_offset, 0, sizeof(Elf32_Sym));
+    for (id = 0; id < symbols->count; id++)
+    {
+        sym = &symbols->syms[id];
+        p = buf + sh[ELF_SYMTAB].sh_offset + elfids[id] * sizeof(Elf32_Sym);
+        value = (uint32_t)sym->address;
+        if (rel && (sym->flags & SYM_DATA))
+        {
+            value -= (uint32_t)res->ntext;
+        }
+        packword(p + offsetof(Elf32_Sym, st_name), sym->name + 1, order);
+        packword(p + offsetof(Elf32_Sym, st_value),
+                 sym->address == SYM_UNDEFINED ? 0 : value * sizeof(uint32_t), order);
+        packword(p + offsetof(Elf32_Sym, st_size), 0, order);
+        p[offsetof(Elf32_Sym, st_info)] = (char)ELF32_ST_INFO(
+            elfglobal(sym) ? STB_GLOBAL : STB_LOCAL,
+            sym->flags & SYM_DATA ? STT_OBJECT : STT_NOTYPE);
+        p[offsetof(Elf32_Sym, st_other)] = STV_DEFAULT;
+        packhalf(p + offsetof(Elf32_Sym, st_shndx),
+                 sym->address == SYM_UNDEFINED ? SHN_UNDEF :
+                 (sym->flags & SYM_DATA ? ELF_DATA : ELF_TEXT), order);
+    }
+
+    p = buf + sh[ELF_STRTAB].sh_offset;
+    p[0] = '\0';
+    if (symbols->nameslen > 0)
+    {
+        memcpy(p + 1, symbols->names, symbols->nameslen);
+    }
+
+    p = buf + sh[ELF_SHSTRTAB].sh_offset;
+    for (k = 0; k < nsections; k++)
+    {
+        memcpy(p + sh[k].sh_name, elfnames[k], strlen(elfnames[k]) + 1);
+    }
+
+    for (k = 0; k < nsections; k++)
+    {
+        packheader(buf + shoff + k * sizeof(Elf32_Shdr), &sh[k], sizeof(Elf32_Shdr), order);
+    }
+
+    arenarealloc(mem, elfids, 0);
+    arenarealloc(mem, relocs.relocs, 0);
+    return buf;
+}
+
+/* link.c - this file links relocatable objects into one program.
+   every object is mapped and checked on a thread of its own. then
+   the sections are laid out, the text of every object first and the
+   data after it, and the global symbols of all the objects go into
+   one table in object order. after that each object is on its own
+   again: its symbols are looked up in the global table once, into
+   one array indexed by object and symbol, and its words are copied
+   into the program. last the relocations are applied in runs of
+   RELOC_BLOCK, grouped by the section they patch, each one a lookup
+   in that array and a call through the table of handlers
+*/
+
+/***************** Functions  ***************/
+
+/* this function returns the word stored at p in the byte order of
+   a packed format */
+static uint32_t unpackword(const char *p, int order)
+{
+    const unsigned char *b = (const unsigned char *)p;  /* bytes of the word */
+
+    if (order == ASM_FORMAT_BIN_BE)
+    {
+        return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8 | b[3];
+    }
+    return (uint32_t)b[3] << 24 | (uint32_t)b[2] << 16 | (uint32_t)b[1] << 8 | b[0];
+}
+
+/* this function returns the half word stored at p in the byte order
+   of a packed format */
+static uint16_t unpackhalf(const char *p, int order)
+{
+    const unsigned char *b = (const unsigned char *)p;  /* bytes of the half word */
+
+    if (order == ASM_FORMAT_BIN_BE)
+    {
+        return (uint16_t)(b[0] << 8 | b[1]);
+    }
+    return (uint16_t)(b[1] << 8 | b[0]);
+}
+
+/* this function takes in an object and the offset of a section header
+   and reads the header. it returns 0 if the section lies inside the
+   file and holds whole entries of entsize bytes */
+static int readsection(const linkobj *o, size_t off, Elf32_Shdr *sh, size_t entsize)
+{
+    uint32_t *fields = (uint32_t *)sh;  /* fields of the header */
+    size_t k;                           /* field iterator */
+
+    for (k = 0; k < sizeof(Elf32_Shdr) / sizeof(uint32_t); k++)
+    {
+        fields[k] = unpackword(o->src.data + off + k * sizeof(uint32_t), o->order);
+    }
+    if (sh->sh_type == SHT_NOBITS)
+    {
+        return 0;
+    }
+    return sh->sh_offset <= o->src.size && sh->sh_size <= o->src.size - sh->sh_offset &&
+           sh->sh_size % entsize == 0 ? 0 : -1;
+}
+
+/* R_MIPS_26, the word address of a j target in the low 26 bits */
+static int reloc26(uint32_t *word, int32_t value, int32_t pos)
+{
+    (void)pos;
+    value += (int32_t)(*word & TARGET_MASK);
+    *word = (*word & ~TARGET_MASK) | ((uint32_t)value & TARGET_MASK);
+    return 0;
+}
+
+/* R_MIPS_HI16, the upper half of the address. la pairs it with ori,
+   so there is no carry out of the lower half to undo */
+static int relochi16(uint32_t *word, int32_t value, int32_t pos)
+{
+    (void)pos;
+    value += (int32_t)((*word & IMM_MASK) << 16);
+    *word = (*word & ~IMM_MASK) | (((uint32_t)value >> 16) & IMM_MASK);
+    return 0;
+}
+
+/* R_MIPS_LO16, the lower half of the address */
+static int reloclo16(uint32_t *word, int32_t value, int32_t pos)
+{
+    (void)pos;
+    value += (int16_t)(*word & IMM_MASK);
+    *word = (*word & ~IMM_MASK) | ((uint32_t)value & IMM_MASK);
+    return 0;
+}
+
+/* R_MIPS_PC16, a branch offset in words from the word after it */
+static int relocpc16(uint32_t *word, int32_t value, int32_t pos)
+{
+    value += (int16_t)(*word & IMM_MASK) - (pos + 1);
+    if (value < INT16_MIN || value > INT16_MAX)
+    {
+        return -1;
+    }
+    *word = (*word & ~IMM_MASK) | ((uint32_t)value & IMM_MASK);
+    return 0;
+}
+
+/* handlers by ELF relocation type, built by the compiler. a type
+   without one is not a relocation the assembler writes */
+static const relocfn relocfns[R_MIPS_PC16 + 1] =
+{
+    [R_MIPS_26]   = reloc26,
+    [R_MIPS_HI16] = relochi16,
+    [R_MIPS_LO16] = reloclo16,
+    [R_MIPS_PC16] = relocpc16,
+};
+
+/* this function takes in an object whose file is mapped and checks
+   that it is a relocatable MIPS object of the kind the assembler
+   writes: one text and one data section, symbols and relocations of
+   the text that all point inside the file. it fills in where the
+   sections are and returns 0, or -1 if the object cannot be linked */
+static int checkobject(linkobj *o)
+{
+    const char *p = o->src.data;  /* the file */
+    Elf32_Shdr sh;        /* section header being read */
+    Elf32_Shdr strsh;     /* header of the symbol names */
+    size_t shoff;         /* offset of the section headers */
+    uint32_t shnum;       /* number of sections */
+    uint32_t symsec = 0;  /* index of the symbol table */
+    uint32_t relsec = 0;  /* index of the relocations */
+    uint32_t k;           /* section, symbol and relocation iterator */
+    const char *q;        /* entry being checked */
+    uint32_t value;       /* its value */
+    uint32_t shndx;       /* its section */
+    uint32_t type;        /* type of a relocation */
+
+    if (o->src.size < sizeof(Elf32_Ehdr) || memcmp(p, ELFMAG, SELFMAG) != 0 ||
+        p[EI_CLASS] != ELFCLASS32 || (p[EI_DATA] != ELFDATA2LSB && p[EI_DATA] != ELFDATA2MSB))
+    {
+        return -1;
+    }
+    memset(&strsh, 0, sizeof(strsh));
+    o->order = p[EI_DATA] == ELFDATA2MSB ? ASM_FORMAT_BIN_BE : ASM_FORMAT_BIN_LE;
+    shoff = unpackword(p + offsetof(Elf32_Ehdr, e_shoff), o->order);
+    shnum = unpackhalf(p + offsetof(Elf32_Ehdr, e_shnum), o->order);
+    if (unpackhalf(p + offsetof(Elf32_Ehdr, e_type), o->order) != ET_REL ||
+        unpackhalf(p + offsetof(Elf32_Ehdr, e_machine), o->order) != EM_MIPS ||
+        unpackhalf(p + offsetof(Elf32_Ehdr, e_shentsize), o->order) != sizeof(Elf32_Shdr) ||
+        shoff > o->src.size || shnum > (o->src.size - shoff) / sizeof(Elf32_Shdr))
+    {
+        return -1;
+    }
+
+    /* find the sections, anything else that would be loaded or
+       relocated is more than the linker knows how to place */
+    for (k = 1; k < shnum; k++)
+    {
+        if (readsection(o, shoff + k * sizeof(Elf32_Shdr), &sh, 1) != 0)
+        {
+            return -1;
+        }
+        if (sh.sh_type == SHT_PROGBITS && (sh.sh_flags & SHF_EXECINSTR) && o->textsec == 0 &&
+            sh.sh_size % sizeof(uint32_t) == 0)
+        {
+            o->textsec = k;
+            o->text = p + sh.sh_offset;
+            o->ntext = sh.sh_size / sizeof(uint32_t);
+        }
+        else if (sh.sh_type == SHT_PROGBITS && !(sh.sh_flags & SHF_EXECINSTR) &&
+                 o->datasec == 0 && sh.sh_size % sizeof(uint32_t) == 0)
+        {
+            o->datasec = k;
+            o->data = p + sh.sh_offset;
+            o->ndata = sh.sh_size / sizeof(uint32_t);
+        }
+        else if (sh.sh_type == SHT_SYMTAB && symsec == 0)
+        {
+            symsec = k;
+        }
+        else if (sh.sh_type == SHT_REL && relsec == 0)
+        {
+            relsec = k;
+        }
+        else if (((sh.sh_flags & SHF_ALLOC) && sh.sh_size > 0) ||
+                 sh.sh_type == SHT_REL || sh.sh_type == SHT_RELA || sh.sh_type == SHT_SYMTAB)
+        {
+            return -1;
+        }
+    }
+
+    /* the symbols and their names */
+    if (symsec != 0)
+    {
+        if (readsection(o, shoff + symsec * sizeof(Elf32_Shdr), &sh, sizeof(Elf32_Sym)) != 0 ||
+            sh.sh_link == 0 || sh.sh_link >= shnum ||
+            readsection(o, shoff + sh.sh_link * sizeof(Elf32_Shdr), &strsh, 1) != 0 ||
+            strsh.sh_type != SHT_STRTAB || strsh.sh_size == 0 ||
+            p[strsh.sh_offset + strsh.sh_size - 1] != '\0')
+        {
+            return -1;
+        }
+        o->syms = p + sh.sh_offset;
+        o->nsyms = sh.sh_size / sizeof(Elf32_Sym);
+        o->strtab = p + strsh.sh_offset;
+    }
+    for (k = 1; k < o->nsyms; k++)
+    {
+        q = o->syms + k * sizeof(Elf32_Sym);
+        value = unpackword(q + offsetof(Elf32_Sym, st_value), o->order);
+        shndx = unpackhalf(q + offsetof(Elf32_Sym, st_shndx), o->order);
+        if (unpackword(q + offsetof(Elf32_Sym, st_name), o->order) >= strsh.sh_size ||
+            value % sizeof(uint32_t) != 0)
+        {
+            return -1;
+        }
+        if (shndx == SHN_UNDEF)
+        {
+            /* only a global symbol can come from another object */
+            if (ELF32_ST_BIND((unsigned char)q[offsetof(Elf32_Sym, st_info)]) == STB_LOCAL)
+            {
+                return -1;
+            }
+        }
+        else if (!(shndx == o->textsec && value / sizeof(uint32_t) <= o->ntext) &&
+                 !(shndx == o->datasec && value / sizeof(uint32_t) <= o->ndata))
+        {
+            return -1;
+        }
+    }
+
+    /* relocations of the text, naming symbols of the table */
+    if (relsec != 0)
+    {
+        if (readsection(o, shoff + relsec * sizeof(Elf32_Shdr), &sh, sizeof(Elf32_Rel)) != 0 ||
+            sh.sh_info != o->textsec || o->textsec == 0 || sh.sh_link != symsec)
+        {
+            return -1;
+        }
+        o->rels = p + sh.sh_offset;
+        o->nrels = sh.sh_size / sizeof(Elf32_Rel);
+    }
+    for (k = 0; k < o->nrels; k++)
+    {
+        q = o->rels + k * sizeof(Elf32_Rel);
+        value = unpackword(q + offsetof(Elf32_Rel, r_offset), o->order);
+        shndx = ELF32_R_SYM(unpackword(q + offsetof(Elf32_Rel, r_info), o->order));
+        type = ELF32_R_TYPE(unpackword(q + offsetof(Elf32_Rel, r_info), o->order));
+        if (type > R_MIPS_PC16 || relocfns[type] == NULL ||
+            value % sizeof(uint32_t) != 0 || value / sizeof(uint32_t) >= o->ntext ||
+            shndx == 0 || shndx >= o->nsyms)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* this function maps object i of the array at arg and checks it */
+static void loadobject(void *arg, int i)
+{
+    linkobj *o = (linkobj *)arg + i;  /* object to load */
+
+    if (opensource(&o->src, o->path) != 0)
+    {
+        o->state = LINK_MISSING;
+        return;
+    }
+    o->state = checkobject(o) == 0 ? LINK_OK : LINK_BAD;
+}
+
+/* this function takes in an error list and the arena its nodes come
+   from, an object, a symbol index and a kind of error and adds an
+   error about the symbol to the list. the line of a link error is
+   the index of the object + 1 */
+static void linkerror(errlist *errors, arena *mem, const linkobj *o, uint32_t k, int errtype)
+{
+    errnode *temperr;  /* temporary error node pointer */
+
+    temperr = arenaalloc(mem, sizeof(errnode));
+    temperr->errtype = errtype;
+    temperr->lineno = o->index + 1;
+    temperr->symbol = o->strtab +
+        unpackword(o->syms + k * sizeof(Elf32_Sym) + offsetof(Elf32_Sym, st_name), o->order);
+    temperr->opcode = NULL;
+    add_err(errors, temperr);
+}
+
+/* this function places object i of the array at arg in the program.
+   it works out the word address of every symbol of the object, a
+   hash join against the global table for the ones defined elsewhere,
+   and copies the words into their place. it only reads the global
+   table, so every object can be placed on any thread */
+static void resolveobject(void *arg, int i)
+{
+    linkobj *o = (linkobj *)arg + i;       /* object to place */
+    const symtable *globals = o->globals;  /* global symbols */
+    uint32_t *words = o->wordsout;         /* program words */
+    int *addrs = o->addrsout + o->symbase; /* addresses of its symbols */
+    const char *q;        /* symbol being read */
+    const char *name;     /* its name */
+    uint32_t shndx;       /* its section */
+    uint32_t k;           /* symbol iterator */
+    size_t pos;           /* word iterator */
+    int id;               /* global symbol id */
+
+    addrs[0] = SYM_UNDEFINED;
+    for (k = 1; k < o->nsyms; k++)
+    {
+        q = o->syms + k * sizeof(Elf32_Sym);
+        shndx = unpackhalf(q + offsetof(Elf32_Sym, st_shndx), o->order);
+        if (shndx == SHN_UNDEF)
+        {
+            /* every symbol an object takes from another has to be
+               defined by one */
+            name = o->strtab + unpackword(q + offsetof(Elf32_Sym, st_name), o->order);
+            id = findsymbol(globals, name, strlen(name));
+            addrs[k] = id < 0 ? SYM_UNDEFINED : globals->syms[id].address;
+            if (id < 0)
+            {
+                linkerror(&o->errors, &o->mem, o, k, ERR_UNDEFSYMBOL);
+            }
+            continue;
+        }
+        addrs[k] = (int)((shndx == o->textsec ? o->textbase : o->database) +
+                   unpackword(q + offsetof(Elf32_Sym, st_value), o->order) / sizeof(uint32_t));
+    }
+
+    /* the words, as they are when the byte order is the host's */
+    if (o->order == HOST_FORMAT && o->ntext > 0)
+    {
+        memcpy(words + o->textbase, o->text, o->ntext * sizeof(uint32_t));
+    }
+    if (o->order == HOST_FORMAT && o->ndata > 0)
+    {
+        memcpy(words + o->database, o->data, o->ndata * sizeof(uint32_t));
+    }
+    if (o->order != HOST_FORMAT)
+    {
+        for (pos = 0; pos < o->ntext; pos++)
+        {
+            words[o->textbase + pos] = unpackword(o->text + pos * sizeof(uint32_t), o->order);
+        }
+        for (pos = 0; pos < o->ndata; pos++)
+        {
+            words[o->database + pos] = unpackword(o->data + pos * sizeof(uint32_t), o->order);
+        }
+    }
+}
+
+/* this function applies run i of the relocation runs at arg. values
+   are word addresses, as the assembler encodes them, and the field of
+   a word holds the addend. every run patches its own words, so the
+   runs can be applied on any thread */
+static void applyrelocs(void *arg, int i)
+{
+    relblock *b = (relblock *)arg + i;  /* run to apply */
+    const linkobj *o = b->obj;          /* object of the run */
+    const int *addrs = b->addrs;        /* addresses of its symbols */
+    uint32_t *section = b->section;     /* words the run patches */
+    const char *q;        /* relocation being applied */
+    uint32_t info;        /* its symbol and type */
+    uint32_t pos;         /* offset of its word in the section */
+    int value;            /* address of its symbol */
+    uint32_t n;           /* relocation iterator */
+
+    for (n = b->start; n < b->end; n++)
+    {
+        q = o->rels + n * sizeof(Elf32_Rel);
+        info = unpackword(q + offsetof(Elf32_Rel, r_info), o->order);
+        pos = unpackword(q + offsetof(Elf32_Rel, r_offset), o->order) / sizeof(uint32_t);
+
+        /* a symbol nobody defines was reported with the object */
+        value = addrs[ELF32_R_SYM(info)];
+        if (value < 0)
+        {
+            continue;
+        }
+        if (relocfns[ELF32_R_TYPE(info)](&section[pos], value, (int32_t)(o->textbase + pos)) != 0)
+        {
+            linkerror(&b->errors, &b->mem, o, ELF32_R_SYM(info), ERR_RANGE);
+        }
+
+        /* an ELF file of the program needs the la words again */
+        if (ELF32_R_TYPE(info) == R_MIPS_HI16)
+        {
+            if (b->his == NULL)
+            {
+                b->his = arenaalloc(&b->mem, (b->end - n) * sizeof(uint32_t));
+            }
+            b->his[b->nhis++] = (uint32_t)(o->textbase + pos);
+        }
+    }
+}
+
+/* this function takes in a result and the paths of the objects and
+   links them into the words, symbols and errors of the result.
+   everything the result keeps is allocated from the arena of the
+   context. returns ASM_ENOENT if an object cannot be read */
+static int linkobjects(asm_result *res, threadpool *pool, const char *const *paths, int nobjs)
+{
+    arena *mem = &res->ctx->mem;  /* owns everything */
+    errlist *errors;      /* errors of the link */
+    errnode *temperr;     /* temporary error node pointer */
+    errnode *nexterr;     /* error after the one being merged */
+    linkobj *objs;        /* the objects */
+    linkobj *o;           /* object being laid out */
+    relblock *blocks = NULL;  /* runs of relocations */
+    int nblocks = 0;      /* number of runs */
+    int *addrs;           /* address of every symbol of every object */
+    const char *q;        /* symbol being merged */
+    const char *name;     /* its name */
+    uint32_t shndx;       /* its section */
+    uint32_t k;           /* symbol and relocation iterator */
+    size_t pos;           /* next free word address */
+    size_t nsyms;         /* symbols of every object */
+    int missing = 0;      /* an object could not be read */
+    int id;               /* global symbol id */
+    int i;                /* object and run iterator */
+
+    errors = arenaalloc(mem, sizeof(errlist));
+    memset(errors, 0, sizeof(errlist));
+    initsymtable(&res->symbols, mem);
+
+    objs = arenaalloc(mem, (size_t)(nobjs + 1) * sizeof(linkobj));
+    memset(objs, 0, (size_t)(nobjs + 1) * sizeof(linkobj));
+    res->objs = objs;
+    res->nobjs = nobjs;
+    for (i = 0; i < nobjs; i++)
+    {
+        objs[i].path = paths[i];
+        objs[i].index = i;
+        objs[i].globals = &res->symbols;
+        initarena(&objs[i].mem);
+    }
+    parallelfor(pool, nobjs, loadobject, objs);
+
+    for (i = 0; i < nobjs; i++)
+    {
+        missing |= objs[i].state == LINK_MISSING;
+        if (objs[i].state == LINK_BAD)
+        {
+            temperr = arenaalloc(mem, sizeof(errnode));
+            temperr->errtype = ERR_BADOBJECT;
+            temperr->lineno = i + 1;
+            temperr->symbol = paths[i];
+            temperr->opcode = NULL;
+            add_err(errors, temperr);
+        }
+    }
+
+    /* lay the sections out and merge the global symbols, in object
+       order so the first definition of a name is the one kept */
+    if (!missing && errors->count == 0)
+    {
+        pos = 0;
+        nsyms = 0;
+        for (i = 0; i < nobjs; i++)
+        {
+            objs[i].textbase = pos;
+            objs[i].symbase = nsyms;
+            pos += objs[i].ntext;
+            nsyms += objs[i].nsyms;
+            nblocks += (int)((objs[i].nrels + RELOC_BLOCK - 1) / RELOC_BLOCK);
+        }
+        res->ntext = pos;
+        for (i = 0; i < nobjs; i++)
+        {
+            objs[i].database = pos;
+            pos += objs[i].ndata;
+        }
+        res->nwords = pos;
+        res->words = arenaalloc(mem, (res->nwords + 1) * sizeof(uint32_t));
+        addrs = arenarealloc(mem, NULL, (nsyms + 1) * sizeof(int));
+
+        for (i = 0; i < nobjs; i++)
+        {
+            o = &objs[i];
+            o->wordsout = res->words;
+            o->addrsout = addrs;
+            for (k = 1; k < o->nsyms; k++)
+            {
+                q = o->syms + k * sizeof(Elf32_Sym);
+                shndx = unpackhalf(q + offsetof(Elf32_Sym, st_shndx), o->order);
+                if (ELF32_ST_BIND((unsigned char)q[offsetof(Elf32_Sym, st_info)]) == STB_LOCAL ||
+                    shndx == SHN_UNDEF)
+                {
+                    continue;
+                }
+                name = o->strtab + unpackword(q + offsetof(Elf32_Sym, st_name), o->order);
+                id = findsymbol(&res->symbols, name, strlen(name));
+                if (id >= 0)
+                {
+                    /* defined in an earlier object */
+                    linkerror(&o->errors, &o->mem, o, k, ERR_MULTSYMBOL);
+                    continue;
+                }
+                id = addsymbol(&res->symbols, name, strlen(name),
+                               (int)((shndx == o->textsec ? o->textbase : o->database) +
+                               unpackword(q + offsetof(Elf32_Sym, st_value), o->order) /
+                               sizeof(uint32_t)));
+                res->symbols.syms[id].line = i + 1;
+                res->symbols.syms[id].flags = SYM_GLOBAL | (shndx == o->textsec ? 0 : SYM_DATA);
+            }
+        }
+
+        parallelfor(pool, nobjs, resolveobject, objs);
+
+        /* cut the relocations into runs. the assembler only relocates
+           text, so every run patches the text of its object */
+        blocks = arenaalloc(mem, (size_t)(nblocks + 1) * sizeof(relblock));
+        nblocks = 0;
+        for (i = 0; i < nobjs; i++)
+        {
+            for (k = 0; k < objs[i].nrels; k += RELOC_BLOCK)
+            {
+                memset(&blocks[nblocks], 0, sizeof(relblock));
+                blocks[nblocks].obj = &objs[i];
+                blocks[nblocks].start = k;
+                blocks[nblocks].end = objs[i].nrels - k < RELOC_BLOCK ? objs[i].nrels : k + RELOC_BLOCK;
+                blocks[nblocks].section = res->words + objs[i].textbase;
+                blocks[nblocks].addrs = addrs + objs[i].symbase;
+                initarena(&blocks[nblocks].mem);
+                nblocks++;
+            }
+        }
+        res->relblocks = blocks;
+        res->nrelblocks = nblocks;
+        parallelfor(pool, nblocks, applyrelocs, blocks);
+        arenarealloc(mem, addrs, 0);
+
+        /* the la words of every run, before the runs go */
+        for (i = 0; i < nblocks; i++)
+        {
+            res->nhiwords += blocks[i].nhis;
+        }
+        res->hiwords = arenaalloc(mem, (res->nhiwords + 1) * sizeof(uint32_t));
+        pos = 0;
+        for (i = 0; i < nblocks; i++)
+        {
+            if (blocks[i].nhis > 0)
+            {
+                memcpy(res->hiwords + pos, blocks[i].his, blocks[i].nhis * sizeof(uint32_t));
+                pos += blocks[i].nhis;
+            }
+        }
+    }
+
+    /* the errors of the objects and then of the runs go into the list
+       in object order and are copied out of them, they are let go */
+    for (i = 0; i < nobjs; i++)
+    {
+        for (temperr = objs[i].errors.head; temperr != NULL; temperr = nexterr)
+        {
+            nexterr = temperr->next;
+            add_err(errors, temperr);
+        }
+    }
+    for (i = 0; i < nblocks; i++)
+    {
+        for (temperr = blocks[i].errors.head; temperr != NULL; temperr = nexterr)
+        {
+            nexterr = temperr->next;
+            add_err(errors, temperr);
+        }
+    }
+    keeperrors(errors, mem);
+    releaselink(res);
+
+    finishresult(res, errors);
+    return missing ? ASM_ENOENT : res->status;
+}
+
+/* this function takes in a result and lets go of the objects of its
+   link and the arenas of the runs */
+static void releaselink(asm_result *res)
+{
+    int i;  /* object and run iterator */
+
+    for (i = 0; i < res->nrelblocks; i++)
+    {
+        freearena(&res->relblocks[i].mem);
+    }
+    for (i = 0; i < res->nobjs; i++)
+    {
+        if (res->objs[i].state != LINK_MISSING)
+        {
+            closesource(&res->objs[i].src);
+        }
+        freearena(&res->objs[i].mem);
+    }
+    res->nrelblocks = 0;
+    res->nobjs = 0;
+}
+
+/* source.c - this file reads the assembly source. a regular file
+   is mapped into memory and handed out as line views, so the
+   lines are never copied and can be any length
+*/
+
+/***************** Functions  ***************/
+
+/* this function takes in a file name and maps the file. files
+   that cannot be mapped, such as pipes, are read into a buffer */
+static int opensource(srcfile *src, const char *name)
+{
+    int fd;           /* source file descriptor */
+    struct stat st;   /* size and type of the file */
+    char *buf;        /* mapping or read buffer */
+    size_t cap = 0;   /* size of the read buffer */
+    ssize_t n;        /* bytes read by one call */
+
+    src->data   = NULL;
+    src->size   = 0;
+    src->pos    = 0;
+    src->storage = SRC_HEAP;
+
+    /* nothing indexed yet */
+    src->winpos = (size_t)-1;
+    src->classify = pickClassifier();
+
+    if ((fd = open(name, O_RDONLY)) < 0)
+    {
+        return -1;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        buf = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (buf != MAP_FAILED)
+        {
+            /* the file is read front to back once per pass */
+            madvise(buf, (size_t)st.st_size, MADV_SEQUENTIAL);
+            src->data   = buf;
+            src->size   = (size_t)st.st_size;
+            src->storage = SRC_MAPPED;
+            close(fd);
+            return 0;
+        }
+    }
+
+    /* read the whole file, doubling the buffer as it fills */
+    buf = NULL;
+    for (;;)
+    {
+        if (src->size == cap)
+        {
+            cap = cap ? cap * 2 : ARENA_BLOCK;
+            if ((src->data = realloc(buf, cap)) == NULL)
+            {
+                free(buf);
+                close(fd);
+                return -1;
+            }
+            buf = (char *)src->data;
+        }
+        n = read(fd, buf + src->size, cap - src->size);
+        if (n < 0)
+        {
+            free(buf);
+            close(fd);
+            return -1;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        src->size += (size_t)n;
+    }
+
+    src->data = buf;
+    close(fd);
+    return 0;
+}
+
+/* this function takes in a buffer and its size and sets up the
+   source to read from it. the buffer is not copied or freed */
+static void opensourcebuf(srcfile *src, const char *data, size_t size)
+{
+    src->data    = data;
+    src->size    = size;
+    src->pos     = 0;
+    src->storage = SRC_BORROWED;
+
+    /* nothing indexed yet */
+    src->winpos = (size_t)-1;
+    src->classify = pickClassifier();
+}
+
+/* this function sets line to the next line of the source, including
+   its newline, and returns 1. returns 0 once the file is used up */
+static int nextLine(srcfile *src, strview *line)
+{
+    const char *nl;  /* end of the line */
+
+    if (src->pos >= src->size)
+    {
+        return 0;
+    }
+
+    line->p = src->data + src->pos;
+    nl = memchr(line->p, '\n', src->size - src->pos);
+    line->len = nl ? (size_t)(nl - line->p) + 1 : src->size - src->pos;
+    src->pos += line->len;
+
+    return 1;
+}
+
+/* this function unmaps or frees the source */
+static void closesource(srcfile *src)
+{
+    if (src->storage == SRC_MAPPED)
+    {
+        munmap((void *)src->data, src->size);
+    }
+    else if (src->storage == SRC_HEAP)
+    {
+        free((void *)src->data);
+    }
+    src->data = NULL;
+    src->size = 0;
+}
+
+/* lexer.c - this file splits source lines into typed tokens. every
+   character is classified once through a lookup table while walking
+   forward, so a line is read a single time and there is no hidden
+   state like strtok keeps, any number of files can be lexed at once
+*/
+
+/************* Constants **************/
+
+/* character classes */
+#define OT 0   /* anything else     */
+#define SP 1   /* blank             */
+#define NL 2   /* newline           */
+#define AL 3   /* letter or _       */
+#define DG 4   /* digit             */
+#define DT 5   /* .                 */
+#define DL 6   /* $                 */
+#define SG 7   /* + or -            */
+#define CM 8   /* ,                 */
+#define CL 9   /* :                 */
+#define LP 10  /* (                 */
+#define RP 11  /* )                 */
+#define HS 12  /* #                 */
+
+/************* Variables ***************/
+
+/* class of every character, bytes above 127 are OT */
+static const unsigned char cclass[256] =
+{
+    OT, OT, OT, OT, OT, OT, OT, OT, OT, SP, NL, SP, SP, SP, OT, OT,
+    OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+    SP, OT, OT, HS, DL, OT, OT, OT, LP, RP, OT, SG, CM, SG, DT, OT,
+    DG, DG, DG, DG, DG, DG, DG, DG, DG, DG, CL, OT, OT, OT, OT, OT,
+    OT, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, OT, OT, OT, OT, AL,
+    OT, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, OT, OT, OT, OT, OT,
+};
+
+/***************** Functions  ***************/
+
+/* this function classifies nblocks blocks of 64 bytes one byte at a
+   time through the class table. it is the fallback for cpus without
+   a vector kernel and defines what the vector kernels compute */
+static void classifyScalar(const unsigned char *p, size_t nblocks,
+                           uint64_t (*masks)[MASK_COUNT])
+{
+    uint64_t blank, delim, nl;  /* masks being built */
+    uint64_t bit;               /* bit of the byte */
+    size_t b;                   /* block iterator */
+    int i;                      /* byte iterator */
+
+    for (b = 0; b < nblocks; b++, p += 64)
+    {
+        blank = delim = nl = 0;
+        for (i = 0; i < 64; i++)
+        {
+            bit = (uint64_t)1 << i;
+            switch (cclass[p[i]])
+            {
+            case SP:
+            case CM:
+                blank |= bit;
+                delim |= bit;
+                break;
+            case NL:
+                nl |= bit;
+                delim |= bit;
+                break;
+            case HS:
+            case CL:
+            case LP:
+            case RP:
+                delim |= bit;
+                break;
+            }
+        }
+
+        masks[b][MASK_SOLID] = ~blank;
+        masks[b][MASK_DELIM] = delim;
+        masks[b][MASK_NL]    = nl;
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+
+/* this function classifies nblocks blocks of 64 bytes, 16 bytes
+   at a time with SSE2. \t \n \v \f \r are the bytes 9 to 13, so
+   blanks are found with one range compare and the newline taken
+   back out */
+__attribute__((target("sse2")))
+static void classifySSE2(const unsigned char *p, size_t nblocks,
+                         uint64_t (*masks)[MASK_COUNT])
+{
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i four = _mm_set1_epi8(4);
+    __m128i v, t, nl, blank, delim;  /* bytes and their classes */
+    uint64_t mb, md, mn;             /* masks being built */
+    size_t b;                        /* block iterator */
+    int i;                           /* iterator */
+
+    for (b = 0; b < nblocks; b++, p += 64)
+    {
+        mb = md = mn = 0;
+        for (i = 0; i < 64; i += 16)
+        {
+            v = _mm_loadu_si128((const __m128i *)(p + i));
+
+            t = _mm_sub_epi8(v, nine);
+            nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+            blank = _mm_andnot_si128(nl, _mm_cmpeq_epi8(_mm_min_epu8(t, four), t));
+            blank = _mm_or_si128(blank, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+            blank = _mm_or_si128(blank, _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+
+            delim = _mm_or_si128(blank, nl);
+            delim = _mm_or_si128(delim, _mm_cmpeq_epi8(v, _mm_set1_epi8('#')));
+            delim = _mm_or_si128(delim, _mm_cmpeq_epi8(v, _mm_set1_epi8(':')));
+            delim = _mm_or_si128(delim, _mm_cmpeq_epi8(v, _mm_set1_epi8('(')));
+            delim = _mm_or_si128(delim, _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+
+            mb |= (uint64_t)(uint16_t)_mm_movemask_epi8(blank) << i;
+            md |= (uint64_t)(uint16_t)_mm_movemask_epi8(delim) << i;
+            mn |= (uint64_t)(uint16_t)_mm_movemask_epi8(nl) << i;
+        }
+
+        masks[b][MASK_SOLID] = ~mb;
+        masks[b][MASK_DELIM] = md;
+        masks[b][MASK_NL]    = mn;
+    }
+}
+
+/* this function is classifySSE2 with 32 byte vectors */
+__attribute__((target("avx2")))
+static void classifyAVX2(const unsigned char *p, size_t nblocks,
+                         uint64_t (*masks)[MASK_COUNT])
+{
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i four = _mm256_set1_epi8(4);
+    __m256i v, t, nl, blank, delim;  /* bytes and their classes */
+    uint64_t mb, md, mn;             /* masks being built */
+    size_t b;                        /* block iterator */
+    int i;                           /* iterator */
+
+    for (b = 0; b < nblocks; b++, p += 64)
+    {
+        mb = md = mn = 0;
+        for (i = 0; i < 64; i += 32)
+        {
+            v = _mm256_loadu_si256((const __m256i *)(p + i));
+
+            t = _mm256_sub_epi8(v, nine);
+            nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+            blank = _mm256_andnot_si256(nl, _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t));
+            blank = _mm256_or_si256(blank, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+            blank = _mm256_or_si256(blank, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')));
+
+            delim = _mm256_or_si256(blank, nl);
+            delim = _mm256_or_si256(delim, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('#')));
+            delim = _mm256_or_si256(delim, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')));
+            delim = _mm256_or_si256(delim, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('(')));
+            delim = _mm256_or_si256(delim, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')));
+
+            mb |= (uint64_t)(uint32_t)_mm256_movemask_epi8(blank) << i;
+            md |= (uint64_t)(uint32_t)_mm256_movemask_epi8(delim) << i;
+            mn |= (uint64_t)(uint32_t)_mm256_movemask_epi8(nl) << i;
+        }
+
+        masks[b][MASK_SOLID] = ~mb;
+        masks[b][MASK_DELIM] = md;
+        masks[b][MASK_NL]    = mn;
+    }
+}
+
+#endif /* HAVE_X86_SIMD */
+
+/* this function returns the widest kernel the cpu can run */
+static void (*pickClassifier(void))(const unsigned char *p, size_t nblocks,
+                             uint64_t (*masks)[MASK_COUNT])
+{
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return classifyAVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return classifySSE2;
+    }
+#endif
+    return classifyScalar;
+}
+
+/* this function builds the masks for the INDEX_BLOCKS blocks of
+   source around pos. bytes past the end of the file read as
+   delimiters and newlines so tokens and lines stop there */
+static void indexWindow(srcfile *src, size_t pos)
+{
+    unsigned char tail[64];  /* last partial block, zero padded */
+    uint64_t over;           /* bits past the end of the file */
+    size_t base;             /* start of the window */
+    size_t full;             /* whole blocks in the window */
+
+    base = pos & ~(size_t)(INDEX_BLOCKS * 64 - 1);
+    full = (src->size - base) / 64;
+    if (full > INDEX_BLOCKS)
+    {
+        full = INDEX_BLOCKS;
+    }
+    if (full > 0)
+    {
+        src->classify((const unsigned char *)src->data + base, full, src->masks);
+    }
+
+    if (full < INDEX_BLOCKS && base + full * 64 < src->size)
+    {
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, src->data + base + full * 64, src->size - base - full * 64);
+        src->classify(tail, 1, &src->masks[full]);
+        over = ~(uint64_t)0 << (src->size - base - full * 64);
+        src->masks[full][MASK_SOLID] |= over;
+        src->masks[full][MASK_DELIM] |= over;
+        src->masks[full][MASK_NL]    |= over;
+    }
+    src->winpos = base;
+}
+
+/* this function is the slow path of findClass, it moves on to the
+   following blocks, indexing new windows as needed */
+static size_t findClassSlow(srcfile *src, size_t pos, int mask)
+{
+    uint64_t bits;  /* candidates in the block */
+
+    while (pos < src->size)
+    {
+        if ((pos & ~(size_t)(INDEX_BLOCKS * 64 - 1)) != src->winpos)
+        {
+            indexWindow(src, pos);
+        }
+
+        bits = src->masks[(pos - src->winpos) >> 6][mask] >> (pos & 63);
+        if (bits != 0)
+        {
+            pos += (size_t)__builtin_ctzll(bits);
+            return pos < src->size ? pos : src->size;
+        }
+        pos = (pos & ~(size_t)63) + 64;
+    }
+    return src->size;
+}
+
+/* this function takes in the source and a position and returns the
+   first position at or after it whose byte is in the class of mask.
+   returns the size of the file if there is no such byte. the lexer
+   calls it for every token, so the common case of a hit in the same
+   block is kept small enough to inline */
+static inline __attribute__((always_inline))
+size_t findClass(srcfile *src, size_t pos, int mask)
+{
+    size_t off = pos - src->winpos;  /* offset into the window */
+    uint64_t bits;                   /* candidates in the block */
+
+    if (pos < src->size && (pos & ~(size_t)(INDEX_BLOCKS * 64 - 1)) == src->winpos)
+    {
+        bits = src->masks[off >> 6][mask] >> (off & 63);
+        if (bits != 0)
+        {
+            pos += (size_t)__builtin_ctzll(bits);
+            return pos < src->size ? pos : src->size;
+        }
+    }
+    return findClassSlow(src, pos, mask);
+}
+
+/* this function reads a number at p the way strtol with base 0
+   does, decimal or 0x hex with an optional sign. it returns the
+   position after the number */
+static const char *lexNumber(const char *p, const char *end, int32_t *val)
+{
+    uint32_t num = 0;  /* magnitude read so far */
+    int neg = 0;       /* was there a minus sign */
+
+    if (p < end && cclass[(unsigned char)*p] == SG)
+    {
+        neg = (*p == '-');
+        p++;
+    }
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && isxdigit((unsigned char)p[2]))
+    {
+        for (p += 2; p < end && isxdigit((unsigned char)*p); p++)
+        {
+            num = num * 16 + (uint32_t)(*p <= '9' ? *p - '0' : (*p | 0x20) - 'a' + 10);
+        }
+    }
+    else
+    {
+        for (; p < end && cclass[(unsigned char)*p] == DG; p++)
+        {
+            num = num * 10 + (uint32_t)(*p - '0');
+        }
+    }
+
+    *val = (int32_t)(neg ? 0u - num : num);
+    return p;
+}
+
+/* this function reads the base register of an offset(base) operand.
+   pos is just past the (, the position after the ) is returned */
+static size_t lexBase(srcfile *src, size_t pos, int *reg)
+{
+    size_t end;  /* end of the register name */
+
+    pos = findClass(src, pos, MASK_SOLID);
+    if (pos < src->size && src->data[pos] == '$')
+    {
+        end = findClass(src, pos, MASK_DELIM);
+        *reg = regToNum(src->data + pos + 1, end - pos - 1);
+        pos = findClass(src, end, MASK_SOLID);
+    }
+    if (pos < src->size && src->data[pos] == ')')
+    {
+        pos++;
+    }
+    return pos;
+}
+
+/* this function takes in the source and splits its next line into
+   at most MAX_TOKS tokens. if there are any, the unused entries are
+   filled with TOK_END.
+   a token runs from its first character to the next delimiter, and
+   both are found through the block masks, so the bytes of a line are
+   only looked at one by one when a number is read. comments are
+   skipped and commas only separate operands. returns 0 once the file
+   is used up */
+static int lexLine(srcfile *src, token *toks, int *ntoks)
+{
+    const char *data = src->data;  /* contents of the file */
+    size_t pos = src->pos;         /* scan position */
+    size_t start, end;             /* bounds of the token being read */
+    token spare;                   /* token past MAX_TOKS, dropped */
+    token *tok;                    /* token being read */
+    int n = 0;                     /* tokens on the line */
+    int names = 0;                 /* names seen so far on the line */
+
+    if (pos >= src->size)
+    {
+        return 0;
+    }
+
+    for (;;)
+    {
+        /* skip blanks and commas */
+        pos = findClass(src, pos, MASK_SOLID);
+        if (pos >= src->size)
+        {
+            break;
+        }
+
+        tok = n < MAX_TOKS ? &toks[n] : &spare;
+        memset(tok, 0, sizeof(*tok));
+        start = pos;
+
+        switch (cclass[(unsigned char)data[pos]])
+        {
+        case NL:
+            pos++;
+            goto done;
+
+        case HS:
+            /* comment runs to the end of the line */
+            pos = findClass(src, pos, MASK_NL);
+            if (pos < src->size)
+            {
+                pos++;
+            }
+            goto done;
+
+        case AL:
+        case DT:
+            end = findClass(src, pos, MASK_DELIM);
+            tok->text.p = data + start;
+            tok->text.len = end - start;
+            pos = end;
+
+            if (end < src->size && data[end] == ':')
+            {
+                /* the colon belongs to the label */
+                tok->type = TOK_LABEL;
+                pos++;
+            }
+            else if (data[start] == '.')
+            {
+                tok->type = TOK_DIRECTIVE;
+            }
+            else
+            {
+                tok->type = names++ == 0 ? TOK_MNEMONIC : TOK_SYMBOL;
+            }
+            break;
+
+        case DL:
+            end = findClass(src, pos, MASK_DELIM);
+            tok->type = TOK_REG;
+            tok->reg = regToNum(data + start + 1, end - start - 1);
+            tok->text.p = data + start;
+            tok->text.len = end - start;
+            pos = end;
+            break;
+
+        case DG:
+        case SG:
+            end = findClass(src, pos, MASK_DELIM);
+            tok->type = TOK_IMM;
+            lexNumber(data + start, data + end, &tok->val);
+            pos = end;
+            if (end < src->size && data[end] == '(')
+            {
+                /* offset(base) */
+                tok->type = TOK_MEM;
+                pos = lexBase(src, end + 1, &tok->reg);
+            }
+            tok->text.p = data + start;
+            tok->text.len = pos - start;
+            break;
+
+        case LP:
+            /* (base) with no offset */
+            tok->type = TOK_MEM;
+            pos = lexBase(src, pos + 1, &tok->reg);
+            tok->text.p = data + start;
+            tok->text.len = pos - start;
+            break;
+
+        case CL:
+            tok->type = TOK_COLON;
+            tok->text.p = data + start;
+            tok->text.len = 1;
+            pos++;
+            break;
+
+        case RP:
+            /* stray ) */
+            pos++;
+            continue;
+
+        default:
+            /* stray characters up to the next delimiter */
+            pos = findClass(src, pos, MASK_DELIM);
+            continue;
+        }
+
+        if (n < MAX_TOKS)
+        {
+            n++;
+        }
+    }
+
+done:
+    src->pos = pos;
+    *ntoks = n;
+
+    /* unused entries read as empty operands. lines without tokens
+       are skipped by the callers, so they are left alone */
+    for (; n > 0 && n < MAX_TOKS; n++)
+    {
+        memset(&toks[n], 0, sizeof(token));
+        toks[n].text.p = data + pos;
+    }
+    return 1;
+}
+
+#undef OT
+#undef SP
+#undef NL
+#undef AL
+#undef DG
+#undef DT
+#undef DL
+#undef SG
+#undef CM
+#undef CL
+#undef LP
+#undef RP
+#undef HS
+
+/* threadpool.c - this file contains a small pool of worker threads.
+   tasks go into one queue guarded by a mutex, the caller of poolwait
+   works through the queue too, so a pool without workers simply runs
+   every task on the calling thread
+*/
+
+/***************** Functions  ***************/
+
+/* this function takes the next task off the queue, the lock must be
+   held and the queue must not be empty */
+static pooltask poolnext(threadpool *pool)
+{
+    pooltask task = pool->tasks[pool->head];  /* task to run */
+
+    pool->head = (pool->head + 1) % pool->cap;
+    pool->count--;
+    return task;
+}
+
+/* this function runs one task with a jump of its own for running out
+   of memory, so the other tasks still finish and poolwait can give up
+   on all of them together. returns -1 if it ran out */
+static int poolcall(pooltask task)
+{
+    jmp_buf jump;                 /* where running out lands */
+    jmp_buf *outer = nomemjump;   /* jump of the caller */
+    int rc = -1;                  /* how the task went */
+
+    if (setjmp(jump) == 0)
+    {
+        nomemjump = &jump;
+        task.fn(task.arg, task.i);
+        rc = 0;
+    }
+    nomemjump = outer;
+    return rc;
+}
+
+/* this function runs one task with the lock released and marks it
+   done, waking the waiters if it was the last one */
+static void poolrun(threadpool *pool, pooltask task)
+{
+    int rc;  /* how the task went */
+
+    pthread_mutex_unlock(&pool->lock);
+    rc = poolcall(task);
+    pthread_mutex_lock(&pool->lock);
+
+    pool->nomem |= rc != 0;
+    if (--pool->pending == 0)
+    {
+        pthread_cond_broadcast(&pool->idle);
+    }
+}
+
+/* this is the body of every worker thread */
+static void *poolworker(void *arg)
+{
+    threadpool *pool = arg;  /* pool the thread belongs to */
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (pool->count == 0 && !pool->stop)
+        {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->count == 0)
+        {
+            break;
+        }
+        poolrun(pool, poolnext(pool));
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/* this function sets up the pool and starts its workers. if a thread
+   cannot be started the pool carries on with the ones it has */
+static void initpool(threadpool *pool, int nthreads)
+{
+    int i;  /* iterator */
+
+    memset(pool, 0, sizeof(threadpool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    if (nthreads > 0 && (pool->threads = malloc(nthreads * sizeof(pthread_t))) != NULL)
+    {
+        for (i = 0; i < nthreads; i++)
+        {
+            if (pthread_create(&pool->threads[i], NULL, poolworker, pool) != 0)
+            {
+                break;
+            }
+            pool->nthreads++;
+        }
+    }
+}
+
+/* this function queues a task, growing the ring when it is full */
+static void poolsubmit(threadpool *pool, void (*fn)(void *arg, int i), void *arg, int i)
+{
+    pooltask *tasks;  /* bigger ring */
+    pooltask task;    /* task run right away */
+    int cap;          /* its size */
+    int k;            /* iterator */
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count == pool->cap)
+    {
+        cap = pool->cap ? pool->cap * 2 : 64;
+        if ((tasks = malloc(cap * sizeof(pooltask))) == NULL)
+        {
+            /* no room to queue it, run it right here instead */
+            task.fn = fn;
+            task.arg = arg;
+            task.i = i;
+            pool->pending++;
+            poolrun(pool, task);
+            pthread_mutex_unlock(&pool->lock);
+            return;
+        }
+        /* unwrap the ring into the new one */
+        for (k = 0; k < pool->count; k++)
+        {
+            tasks[k] = pool->tasks[(pool->head + k) % pool->cap];
+        }
+        free(pool->tasks);
+        pool->tasks = tasks;
+        pool->head = 0;
+        pool->cap = cap;
+    }
+
+    pool->tasks[(pool->head + pool->count) % pool->cap].fn = fn;
+    pool->tasks[(pool->head + pool->count) % pool->cap].arg = arg;
+    pool->tasks[(pool->head + pool->count) % pool->cap].i = i;
+    pool->count++;
+    pool->pending++;
+
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* this function runs queued tasks on the calling thread until the
+   queue is empty, then waits for the workers to finish theirs. if a
+   task ran out of memory the caller does too, once all are done */
+static void poolwait(threadpool *pool)
+{
+    int nomem;  /* a task ran out of memory */
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count > 0)
+    {
+        poolrun(pool, poolnext(pool));
+    }
+    while (pool->pending > 0)
+    {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    nomem = pool->nomem;
+    pool->nomem = 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (nomem)
+    {
+        nomemory();
+    }
+}
+
+/* this function runs fn over 0 to n - 1 on the pool */
+static void parallelfor(threadpool *pool, int n, void (*fn)(void *arg, int i), void *arg)
+{
+    int i;  /* iterator */
+
+    for (i = 0; i < n; i++)
+    {
+        poolsubmit(pool, fn, arg, i);
+    }
+    poolwait(pool);
+}
+
+/* this function stops the workers once the queue is drained */
+static void freepool(threadpool *pool)
+{
+    int i;  /* iterator */
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nthreads; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    free(pool->threads);
+    free(pool->tasks);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->idle);
+}
+
+/* cache.c - this file keeps what pass one made of each chunk in a
+   cache directory, with the instructions already encoded as far as
+   they can be without the symbols. a cache file is named after the
+   key of its chunk, which hashes the section and the text, and holds
+   the lists of the chunk as they are in memory. line numbers,
+   addresses and symbol ids in them count from the start of the chunk,
+   so a chunk that moves around in the file is still found. files are
+   written under a temporary name and renamed, so a file is either
+   whole or missing
+*/
+
+/***************** Functions  ***************/
+
+/* this function takes in the newline ending a line, with at least
+   CACHE_TAIL bytes before it, and says if a chunk may end there. it
+   only looks at the end of the line, so the same lines are picked
+   wherever they are in the file */
+static int cutline(const char *nl)
+{
+    uint64_t w0, w1;  /* last bytes of the line */
+    uint64_t h;       /* their hash */
+
+    memcpy(&w0, nl + 1 - CACHE_TAIL, 8);
+    memcpy(&w1, nl + 1 - CACHE_TAIL + 8, 8);
+    h = (w0 ^ (w1 * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+    return ((h >> 40) & CACHE_CUT_MASK) == 0;
+}
+
+/* this function counts the newlines in a word. a byte of y has its
+   high bit clear only if the byte is a newline */
+static uint64_t countnl(uint64_t w)
+{
+    const uint64_t low = 0x7f7f7f7f7f7f7f7fULL;  /* low bits of every byte */
+    uint64_t t = w ^ 0x0a0a0a0a0a0a0a0aULL;      /* zero bytes are newlines */
+    uint64_t y = (((t & low) + low) | t) | low;  /* high bits of other bytes */
+
+    return ((~y) >> 7) * 0x0101010101010101ULL >> 56;
+}
+
+/* this function hashes the text of a chunk into its key and counts
+   its lines on the way. four words are hashed side by side into four
+   lanes, so the multiplies do not wait on each other, and the lanes
+   are folded into the two halves of the key at the end */
+static void chunkkey(chunk *c)
+{
+    const char *p = c->src.data;     /* next word */
+    size_t len = c->src.size;        /* bytes left */
+    uint64_t lane[4];                /* hash lanes */
+    uint64_t w[4];                   /* words of text */
+    uint64_t lines = 0;              /* newlines seen */
+    int k;                           /* lane iterator */
+
+    lane[0] = ((uint64_t)CACHE_VERSION << 32 | (uint64_t)c->section) ^ 0x9e3779b97f4a7c15ULL;
+    lane[1] = lane[0] ^ 0xc2b2ae3d27d4eb4fULL;
+    lane[2] = lane[0] ^ 0x165667b19e3779f9ULL;
+    lane[3] = lane[0] ^ 0x27d4eb2f165667c5ULL;
+    while (len > 0)
+    {
+        /* the last words are padded with zeros, which are not
+           newlines */
+        if (len >= sizeof(w))
+        {
+            memcpy(w, p, sizeof(w));
+            p += sizeof(w);
+            len -= sizeof(w);
+        }
+        else
+        {
+            memset(w, 0, sizeof(w));
+            memcpy(w, p, len);
+            len = 0;
+        }
+
+        for (k = 0; k < 4; k++)
+        {
+            lines += countnl(w[k]);
+            lane[k] = (lane[k] ^ w[k]) * 0xff51afd7ed558ccdULL;
+            lane[k] ^= lane[k] >> 32;
+        }
+    }
+
+    /* last line of the file without a newline */
+    if (c->src.size > 0 && c->src.data[c->src.size - 1] != '\n')
+    {
+        lines++;
+    }
+    c->lines = (int)lines;
+    c->key[0] = (lane[0] ^ (lane[2] << 29 | lane[2] >> 35) ^ c->src.size) * 0x9e3779b97f4a7c15ULL;
+    c->key[1] = (lane[1] ^ (lane[3] << 29 | lane[3] >> 35) ^ lines) * 0xc4ceb9fe1a85ec53ULL;
+}
+
+/* this function writes the name of the cache file of a chunk into
+   path, returns -1 if it does not fit */
+static int cachepath(char *path, const chunk *c)
+{
+    int n;  /* length of the name */
+
+    n = snprintf(path, CACHE_PATH_LEN, "%s/%016llx%016llx.chunk", c->cachedir,
+                 (unsigned long long)c->key[0], (unsigned long long)c->key[1]);
+    return n > 0 && n < CACHE_PATH_LEN ? 0 : -1;
+}
+
+/* this function takes in the sum so far and len bytes at p and
+   returns the sum with them added. the lists of a cache file are
+   summed one after another, so a file changed anywhere after its
+   header is a miss */
+static uint64_t sumbytes(uint64_t sum, const void *p, size_t len)
+{
+    const char *b = p;  /* next word */
+    uint64_t w;         /* word of the bytes */
+
+    sum ^= len;
+    while (len > 0)
+    {
+        /* the last word is padded with zeros */
+        w = 0;
+        memcpy(&w, b, len < sizeof(w) ? len : sizeof(w));
+        b += sizeof(w);
+        len -= len < sizeof(w) ? len : sizeof(w);
+        sum = (sum ^ w) * 0xff51afd7ed558ccdULL;
+        sum ^= sum >> 32;
+    }
+    return sum;
+}
+
+/* this function takes in the header of a cache file that is as long
+   as the header says and checks the lists after it against its sum. the cache
+   directory can be shared, so a file that was cut short, garbled or
+   made up must not get an offset, id or index out of its lists or
+   a string without its end. returns 0 if it can be used, -1 if it
+   has to be treated as a miss */
+static int cachevalid(const cachehead *head)
+{
+    const char *map = (const char *)(head + 1);  /* the lists */
+    const uint32_t *data;        /* data words */
+    const uint32_t *fixidx;      /* index of the records with a symbol */
+    const instrec *fixrecs;      /* and the records */
+    const symbol *syms;          /* symbols of the chunk */
+    const cacheerr *errs;        /* its errors */
+    const char *names;           /* symbol names */
+    const char *text;            /* text of the errors */
+    uint64_t sum = 0;            /* sum of the lists */
+    uint32_t limit;              /* one past the last address of the section */
+    uint32_t k;                  /* iterator */
+
+    fixidx = (const uint32_t *)(map + (size_t)head->ninsts * sizeof(uint32_t));
+    fixrecs = (const instrec *)(fixidx + head->nfix);
+    data = (const uint32_t *)(fixrecs + head->nfix);
+    syms = (const symbol *)(data + head->ndata);
+    errs = (const cacheerr *)(syms + head->nsyms);
+    names = (const char *)(errs + head->nerrs);
+    text = names + head->nameslen;
+
+    /* summed the way cachestore writes them */
+    sum = sumbytes(sum, map, (size_t)head->ninsts * sizeof(uint32_t));
+    sum = sumbytes(sum, fixidx, (size_t)head->nfix * sizeof(uint32_t));
+    sum = sumbytes(sum, fixrecs, (size_t)head->nfix * sizeof(instrec));
+    sum = sumbytes(sum, data, (size_t)head->ndata * sizeof(uint32_t));
+    sum = sumbytes(sum, syms, (size_t)head->nsyms * sizeof(symbol));
+    sum = sumbytes(sum, errs, (size_t)head->nerrs * sizeof(cacheerr));
+    sum = sumbytes(sum, names, head->nameslen);
+    sum = sumbytes(sum, text, head->textlen);
+    if (sum != head->sum)
+    {
+        return -1;
+    }
+
+    /* the strings are looked up with strlen, so both blobs have to
+       end in a NUL and every offset has to be inside them */
+    if ((head->nameslen > 0 && names[head->nameslen - 1] != '\0') ||
+        (head->textlen > 0 && text[head->textlen - 1] != '\0') ||
+        head->nfix > head->ninsts)
+    {
+        return -1;
+    }
+
+    /* records that need a symbol, in word order */
+    for (k = 0; k < head->nfix; k++)
+    {
+        if (fixidx[k] >= head->ninsts || (k > 0 && fixidx[k] <= fixidx[k - 1]) ||
+            fixrecs[k].op >= OP_COUNT || !(fixrecs[k].flags & REC_SYMBOL) ||
+            fixrecs[k].imm < 0 || (uint32_t)fixrecs[k].imm >= head->nsyms ||
+            fixrecs[k].rt > REG_MASK || fixrecs[k].rs1 > REG_MASK ||
+            fixrecs[k].rs2 > REG_MASK || fixrecs[k].sa > REG_MASK)
+        {
+            return -1;
+        }
+    }
+
+    /* labels are inside their section, the label after the last
+       word included */
+    limit = head->section == SECT_TEXT ? head->ninsts : head->ndata;
+    for (k = 0; k < head->nsyms; k++)
+    {
+        if (syms[k].name >= head->nameslen ||
+            (syms[k].flags & ~(uint32_t)(SYM_GLOBAL | SYM_EXTERN | SYM_DATA)) != 0 ||
+            (syms[k].address != SYM_UNDEFINED &&
+             (syms[k].address < 0 || (uint32_t)syms[k].address > limit)) ||
+            syms[k].line < 0 || (uint32_t)syms[k].line > head->lines)
+        {
+            return -1;
+        }
+    }
+
+    /* pass one only finds bad opcodes and labels defined twice */
+    for (k = 0; k < head->nerrs; k++)
+    {
+        if ((errs[k].errtype != ERR_OPCODE && errs[k].errtype != ERR_MULTSYMBOL) ||
+            errs[k].text >= head->textlen || errs[k].lineno < 1 ||
+            (uint32_t)errs[k].lineno > head->lines)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* this function takes in a chunk whose key is set and looks for its
+   cache file. on a hit the file is mapped in and the lists of the
+   chunk point into it, the errors are rebuilt in the chunk's arena.
+   returns 0 on a hit, -1 if the chunk has to be read */
+static int cacheload(chunk *c)
+{
+    char path[CACHE_PATH_LEN];   /* cache file */
+    int fd;                      /* open cache file */
+    struct stat st;              /* its size */
+    const char *map;             /* the file mapped in */
+    const cachehead *head;       /* its header */
+    const cacheerr *errs;        /* its errors */
+    const char *text;            /* text of the errors */
+    errnode *temperr;            /* temporary error node pointer */
+    uint64_t len;                /* bytes the header calls for */
+    uint32_t k;                  /* error iterator */
+
+    if (cachepath(path, c) != 0 || (fd = open(path, O_RDONLY)) < 0)
+    {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(cachehead))
+    {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    /* the file has to be for this chunk, exactly as long as its
+       header says and hold nothing out of range */
+    head = (const cachehead *)map;
+    len = sizeof(cachehead) + (uint64_t)head->ninsts * sizeof(uint32_t) +
+          (uint64_t)head->nfix * (sizeof(uint32_t) + sizeof(instrec)) +
+          (uint64_t)head->ndata * sizeof(uint32_t) + (uint64_t)head->nsyms * sizeof(symbol) +
+          (uint64_t)head->nerrs * sizeof(cacheerr) + head->nameslen + head->textlen;
+    if (memcmp(head->magic, "TASMCHNK", 8) != 0 || head->version != CACHE_VERSION ||
+        head->section != (uint32_t)c->section || head->key[0] != c->key[0] ||
+        head->key[1] != c->key[1] || head->size != c->src.size ||
+        head->lines != (uint32_t)c->lines || len != (uint64_t)st.st_size ||
+        cachevalid(head) != 0)
+    {
+        munmap((void *)map, (size_t)st.st_size);
+        return -1;
+    }
+
+    /* point the lists into the file */
+    map += sizeof(cachehead);
+    c->words = (const uint32_t *)map;
+    c->insts.count = head->ninsts;
+    map += (size_t)head->ninsts * sizeof(uint32_t);
+    c->fixidx = (const uint32_t *)map;
+    map += (size_t)head->nfix * sizeof(uint32_t);
+    c->fixrecs = (const instrec *)map;
+    c->nfix = head->nfix;
+    map += (size_t)head->nfix * sizeof(instrec);
+    c->data.words = (uint32_t *)map;
+    c->data.count = head->ndata;
+    map += (size_t)head->ndata * sizeof(uint32_t);
+    c->symbols.syms = (symbol *)map;
+    c->symbols.count = head->nsyms;
+    map += (size_t)head->nsyms * sizeof(symbol);
+    errs = (const cacheerr *)map;
+    map += (size_t)head->nerrs * sizeof(cacheerr);
+    c->symbols.names = (char *)map;
+    c->symbols.nameslen = head->nameslen;
+    text = map + head->nameslen;
+
+    /* the chunk owns the mapping from here on, the result unmaps it
+       even if memory runs out below */
+    c->cachemap = (void *)head;
+    c->cachelen = (size_t)st.st_size;
+
+    /* the errors go back into a list */
+    for (k = 0; k < head->nerrs; k++)
+    {
+        temperr = arenaalloc(&c->mem, sizeof(errnode));
+        temperr->errtype = errs[k].errtype;
+        temperr->lineno = errs[k].lineno;
+        if (errs[k].errtype == ERR_OPCODE)
+        {
+            temperr->opcode = text + errs[k].text;
+        }
+        else
+        {
+            temperr->symbol = text + errs[k].text;
+        }
+        add_err(&c->errors, temperr);
+    }
+    return 0;
+}
+
+/* this function takes in a chunk that pass one has read. it encodes
+   the records as far as they go without the symbols, the same way
+   a chunk found in the cache comes in, and writes the lists to the
+   cache file. a chunk that cannot be stored is simply read again
+   next time */
+static void cachestore(chunk *c)
+{
+    char path[CACHE_PATH_LEN];   /* cache file */
+    char temp[CACHE_PATH_LEN];   /* name it is written under */
+    cachehead head;              /* header of the file */
+    uint32_t *words;             /* encoded instructions */
+    uint32_t *fixidx;            /* index of the ones that need a symbol */
+    instrec *fixrecs;            /* and their records */
+    uint32_t nfix = 0;           /* number of them */
+    cacheerr *errs;              /* errors of the chunk */
+    char *text;                  /* text of the errors */
+    const char *str;             /* opcode or symbol of an error */
+    const errnode *node;         /* error being stored */
+    size_t textlen = 0;          /* bytes of error text */
+    size_t len;                  /* length of one string */
+    size_t n;                    /* record iterator */
+    int fd;                      /* temporary file */
+    int rc;                      /* result of the writes */
+    uint32_t k = 0;              /* error iterator */
+
+    /* every record with a symbol is kept, a branch too, since a
+       relocatable object needs to know which word uses what */
+    words = arenaalloc(&c->mem, (c->insts.count + 1) * sizeof(uint32_t));
+    fixidx = arenaalloc(&c->mem, (c->insts.count + 1) * sizeof(uint32_t));
+    fixrecs = arenaalloc(&c->mem, (c->insts.count + 1) * sizeof(instrec));
+    for (n = 0; n < c->insts.count; n++)
+    {
+        words[n] = encoderec(&c->insts.recs[n], 0);
+        if (c->insts.recs[n].flags & REC_SYMBOL)
+        {
+            fixidx[nfix] = (uint32_t)n;
+            fixrecs[nfix++] = c->insts.recs[n];
+        }
+    }
+    c->words = words;
+    c->fixidx = fixidx;
+    c->fixrecs = fixrecs;
+    c->nfix = nfix;
+
+    if (cachepath(path, c) != 0 ||
+        snprintf(temp, CACHE_PATH_LEN, "%s.%ld.%lx", path, (long)getpid(),
+                 (unsigned long)(uintptr_t)c) >= CACHE_PATH_LEN)
+    {
+        return;
+    }
+
+    /* lay the errors out flat, their strings go one after another */
+    for (node = c->errors.head; node != NULL; node = node->next)
+    {
+        str = node->errtype == ERR_OPCODE ? node->opcode : node->symbol;
+        textlen += strlen(str) + 1;
+    }
+    errs = arenaalloc(&c->mem, ((size_t)c->errors.count + 1) * sizeof(cacheerr));
+    text = arenaalloc(&c->mem, textlen + 1);
+    textlen = 0;
+    for (node = c->errors.head; node != NULL; node = node->next)
+    {
+        str = node->errtype == ERR_OPCODE ? node->opcode : node->symbol;
+        len = strlen(str) + 1;
+        errs[k].errtype = node->errtype;
+        errs[k].lineno = node->lineno;
+        errs[k].text = (uint32_t)textlen;
+        memcpy(text + textlen, str, len);
+        textlen += len;
+        k++;
+    }
+
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, "TASMCHNK", 8);
+    head.version  = CACHE_VERSION;
+    head.section  = (uint32_t)c->section;
+    head.key[0]   = c->key[0];
+    head.key[1]   = c->key[1];
+    head.size     = c->src.size;
+    head.lines    = (uint32_t)c->lines;
+    head.ninsts   = (uint32_t)c->insts.count;
+    head.nfix     = nfix;
+    head.ndata    = (uint32_t)c->data.count;
+    head.nsyms    = c->symbols.count;
+    head.nerrs    = k;
+    head.nameslen = (uint32_t)c->symbols.nameslen;
+    head.textlen  = (uint32_t)textlen;
+    head.sum = sumbytes(0, words, c->insts.count * sizeof(uint32_t));
+    head.sum = sumbytes(head.sum, fixidx, nfix * sizeof(uint32_t));
+    head.sum = sumbytes(head.sum, fixrecs, nfix * sizeof(instrec));
+    head.sum = sumbytes(head.sum, c->data.words, c->data.count * sizeof(uint32_t));
+    head.sum = sumbytes(head.sum, c->symbols.syms, c->symbols.count * sizeof(symbol));
+    head.sum = sumbytes(head.sum, errs, k * sizeof(cacheerr));
+    head.sum = sumbytes(head.sum, c->symbols.names, c->symbols.nameslen);
+    head.sum = sumbytes(head.sum, text, textlen);
+
+    rc = -1;
+    if ((fd = open(temp, O_WRONLY | O_CREAT | O_EXCL, 0666)) >= 0)
+    {
+        rc = writeall(fd, (const char *)&head, sizeof(head));
+        rc |= writeall(fd, (const char *)words, c->insts.count * sizeof(uint32_t));
+        rc |= writeall(fd, (const char *)fixidx, nfix * sizeof(uint32_t));
+        rc |= writeall(fd, (const char *)fixrecs, nfix * sizeof(instrec));
+        rc |= writeall(fd, (const char *)c->data.words, c->data.count * sizeof(uint32_t));
+        rc |= writeall(fd, (const char *)c->symbols.syms, c->symbols.count * sizeof(symbol));
+        rc |= writeall(fd, (const char *)errs, k * sizeof(cacheerr));
+        rc |= writeall(fd, c->symbols.names, c->symbols.nameslen);
+        rc |= writeall(fd, text, textlen);
+        rc |= close(fd);
+    }
+    if (rc != 0 || rename(temp, path) != 0)
+    {
+        unlink(temp);
+    }
+}
+
+/* backpatch.c - this file keeps the words of a streamed run that were
+   written before their symbol was defined. every symbol has a list of
+   the fixups waiting for it, threaded through one array by index
+*/
+
+/***************** Functions  ***************/
+
+/* this function takes in a set of fixups and an arena and sets it up
+   with nothing waiting */
+static void initbackpatch(backpatch *bp, arena *mem)
+{
+    memset(bp, 0, sizeof(backpatch));
+    bp->mem = mem;
+}
+
+/* this function takes in a set of fixups, a record whose symbol is
+   not defined yet and the address its word went out at, and puts it
+   on the list of the symbol */
+static void addfixup(backpatch *bp, const instrec *rec, uint32_t addr)
+{
+    uint32_t id = (uint32_t)rec->imm;  /* program symbol id */
+    uint32_t n;                        /* fixup to fill in */
+    uint32_t cap;                      /* new size of pending */
+
+    /* make sure the symbol has a list */
+    if (id >= bp->npending)
+    {
+        cap = bp->npending ? bp->npending * 2 : SYM_SLOTS;
+        cap = cap > id ? cap : id + 1;
+        bp->pending = arenarealloc(bp->mem, bp->pending, cap * sizeof(uint32_t));
+        memset(bp->pending + bp->npending, 0, (cap - bp->npending) * sizeof(uint32_t));
+        bp->npending = cap;
+    }
+
+    /* take a resolved fixup if there is one */
+    if (bp->free != 0)
+    {
+        n = bp->free - 1;
+        bp->free = bp->fixups[n].next;
+    }
+    else
+    {
+        if (bp->count == bp->cap)
+        {
+            bp->cap = bp->cap ? bp->cap * 2 : SYM_SLOTS;
+            bp->fixups = arenarealloc(bp->mem, bp->fixups, bp->cap * sizeof(fixup));
+        }
+        n = bp->count++;
+    }
+
+    bp->fixups[n].rec = *rec;
+    bp->fixups[n].addr = addr;
+    bp->fixups[n].next = bp->pending[id];
+    bp->pending[id] = n + 1;
+}
+
+/* this function takes in a set of fixups, the program symbols, the id
+   of a symbol that was just defined, the obj writer and the error
+   list with its arena. it patches the word of every fixup waiting for
+   the symbol and frees them. a branch that cannot reach the symbol is
+   reported and its word left 0 */
+static void resolvefixups(backpatch *bp, const symtable *symbols, int id, objwriter *out,
+                          errlist *errors, arena *mem)
+{
+    const fixup *f;    /* fixup being patched */
+    uint32_t n;        /* its index + 1 */
+    uint32_t next;     /* the one after it */
+    int addr;          /* address of the symbol */
+
+    if ((uint32_t)id >= bp->npending)
+    {
+        return;
+    }
+    for (n = bp->pending[id]; n != 0; n = next)
+    {
+        f = &bp->fixups[n - 1];
+        next = f->next;
+
+        addr = symbols->syms[id].address;
+        if (f->rec.flags & REC_HI)
+        {
+            addr = (int)((uint32_t)addr >> 16);
+        }
+        if (isbranch(&f->rec) && branchoffset(addr, f->addr, &addr) != 0)
+        {
+            rangeerror(errors, mem, (int)f->rec.lineno, symbols->names + symbols->syms[id].name);
+        }
+        else
+        {
+            patchword(out, f->addr, encoderec(&f->rec, addr));
+        }
+
+        bp->fixups[n - 1].next = bp->free;
+        bp->free = n;
+    }
+    bp->pending[id] = 0;
+}
+
+/* compares two fixups by address for qsort */
+static int cmpfixups(const void *a, const void *b)
+{
+    uint32_t x = ((const fixup *)a)->addr;  /* first address */
+    uint32_t y = ((const fixup *)b)->addr;  /* second address */
+
+    return (x > y) - (x < y);
+}
+
+/* this function takes in a set of fixups, the program symbols, the
+   error list, an arena and the obj writer. every fixup still waiting
+   uses a symbol that was never defined, they are sorted back into
+   address order and handled like pass two would: a symbol declared
+   .globl or .extern is left to another object, its word is patched
+   with the field 0, and the rest are reported. la makes two records,
+   only the first one reports it */
+static void undefinedfixups(backpatch *bp, const symtable *symbols, errlist *errors, arena *mem,
+                            objwriter *out)
+{
+    fixup *open;       /* every waiting fixup */
+    size_t nopen = 0;  /* number of them */
+    errnode *temperr;  /* temporary error node pointer */
+    uint32_t id;       /* symbol iterator */
+    uint32_t n;        /* fixup index + 1 */
+    size_t k;          /* iterator */
+
+    if (bp->count == 0)
+    {
+        return;
+    }
+    open = arenarealloc(mem, NULL, bp->count * sizeof(fixup));
+    for (id = 0; id < bp->npending; id++)
+    {
+        for (n = bp->pending[id]; n != 0; n = bp->fixups[n - 1].next)
+        {
+            open[nopen++] = bp->fixups[n - 1];
+        }
+    }
+    qsort(open, nopen, sizeof(fixup), cmpfixups);
+
+    for (k = 0; k < nopen; k++)
+    {
+        if (symbols->syms[open[k].rec.imm].flags & (SYM_GLOBAL | SYM_EXTERN))
+        {
+            patchword(out, open[k].addr, encoderec(&open[k].rec, 0));
+            continue;
+        }
+        if (open[k].rec.flags & REC_LO)
+        {
+            continue;
+        }
+        /* allocate error node and fill details */
+        temperr = arenaalloc(mem, sizeof(errnode));
+        temperr->errtype = ERR_UNDEFSYMBOL;
+        temperr->lineno = open[k].rec.lineno;
+        temperr->symbol = symbols->names + symbols->syms[open[k].rec.imm].name;
+        add_err(errors, temperr);
+    }
+    arenarealloc(mem, open, 0);
+}
@@ -0,0 +1,202 @@
+/* libasm.h
+
+   This is the interface of the assembler library. A context owns
+   a thread pool and the memory used while assembling, and can be
+   kept around to assemble any number of sources one after another.
+   The library keeps no global state, so separate contexts can be
+   used from different threads at the same time.
+
+   A result belongs to its context and stays valid until the next
+   call that assembles on the same context, or until it is freed.
+
+       asm_ctx *ctx = asm_ctx_create(0);
+       asm_result *res;
+
+       if (asm_assemble_buffer(ctx, src, len, NULL, &res) == ASM_OK)
+       {
+           use asm_result_words(res) and asm_result_word_count(res)
+       }
+       asm_result_free(res);
+       asm_ctx_destroy(ctx);
+*/
+
+#ifndef LIBASM_H
+#define LIBASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/************** Constants *************/
+
+/* results of an assemble call */
+#define ASM_OK      0  /* assembled, the words are ready       */
+#define ASM_ERRORS  1  /* the source has errors, see the diags */
+#define ASM_ENOENT  2  /* the source file cannot be read        */
+#define ASM_EINVAL  3  /* bad arguments                         */
+#define ASM_EIO     4  /* the output could not be written       */
+#define ASM_ENOMEM  5  /* memory ran out, nothing was kept      */
+
+/* formats of the obj file */
+#define ASM_FORMAT_OBJ     0  /* hex text, one 0x0000AAAA:\t0xWWWWWWWW line per word */
+#define ASM_FORMAT_BIN_LE  1  /* packed 32 bit words, least significant byte first */
+#define ASM_FORMAT_BIN_BE  2  /* packed 32 bit words, most significant byte first  */
+#define ASM_FORMAT_ELF_LE  3  /* ELF32 MIPS executable, little endian             */
+#define ASM_FORMAT_ELF_BE  4  /* ELF32 MIPS executable, big endian                */
+#define ASM_FORMAT_IHEX_LE 5  /* Intel HEX records of the BIN_LE bytes            */
+#define ASM_FORMAT_IHEX_BE 6  /* Intel HEX records of the BIN_BE bytes            */
+#define ASM_FORMAT_SREC_LE 7  /* Motorola S-records of the BIN_LE bytes           */
+#define ASM_FORMAT_SREC_BE 8  /* Motorola S-records of the BIN_BE bytes           */
+#define ASM_FORMAT_REL_LE  9  /* ELF32 MIPS relocatable object, little endian     */
+#define ASM_FORMAT_REL_BE 10  /* ELF32 MIPS relocatable object, big endian        */
+
+/* kinds of diagnostics */
+#define ASM_DIAG_OPCODE    0  /* illegal opcode           */
+#define ASM_DIAG_UNDEFINED 1  /* undefined symbol used    */
+#define ASM_DIAG_MULTIPLE  2  /* multiply defined symbol  */
+#define ASM_DIAG_BADOBJECT 3  /* not a relocatable object */
+#define ASM_DIAG_RANGE     4  /* branch target too far    */
+
+/* bindings of symbols */
+#define ASM_SYM_LOCAL  0  /* only seen in its own source           */
+#define ASM_SYM_GLOBAL 1  /* defined here, seen by other objects   */
+#define ASM_SYM_EXTERN 2  /* used here, defined in another object  */
+
+/* address of a symbol that is used but never defined */
+#define ASM_UNDEFINED -1
+
+
+/************** Data structures *************/
+
+/* a context to assemble with */
+typedef struct asm_ctx asm_ctx;
+
+/* what came out of assembling one source */
+typedef struct asm_result asm_result;
+
+/* options for one assemble call, NULL gives the defaults */
+typedef struct asm_options
+{
+    int trace;             /* trace level, 0 is off. tracing runs single
+                              threaded and does not use the cache */
+    int tracefd;           /* where the trace goes */
+    const char *cachedir;  /* directory to keep pass one results in so
+                              unchanged parts of a source are not read
+                              again, NULL for none */
+} asm_options;
+
+
+/*************** Functions **************************************/
+
+/* sets options to the defaults, no trace, trace to stderr, no cache */
+void asm_options_init(asm_options *opts);
+
+/* creates a context with the given number of threads, 0 picks one
+   per cpu. returns NULL if it cannot be created */
+asm_ctx *asm_ctx_create(int threads);
+
+/* releases a context and everything it owns */
+void asm_ctx_destroy(asm_ctx *ctx);
+
+/* assembles len bytes of source. the source is not copied and must
+   stay valid as long as the result. sets *result and returns one of
+   the ASM_ constants, *result is NULL unless ASM_OK or ASM_ERRORS.
+   running out of memory gives ASM_ENOMEM, the context is still good
+   and what the call had allocated is released */
+int asm_assemble_buffer(asm_ctx *ctx, const char *src, size_t len,
+                        const asm_options *opts, asm_result **result);
+
+/* assembles the file at path, like asm_assemble_buffer */
+int asm_assemble_file(asm_ctx *ctx, const char *path,
+                      const asm_options *opts, asm_result **result);
+
+/* assembles the file at path in a single pass that writes the obj
+   file to fd as the source is read, in ASM_FORMAT_OBJ or one of the
+   BIN formats. words that use a symbol further down are patched in
+   place once it turns up, so fd has to be a regular file, and only
+   the symbols and the words still waiting are kept in memory. the
+   result has no words, everything else is as from asm_assemble_file.
+   on ASM_ERRORS what is in fd is not an obj file, nor is it when
+   the result has ASM_SYM_EXTERN symbols, only the rel formats can
+   keep those and they are not streamed. the cache is not used.
+   returns ASM_EIO if fd could not be written */
+int asm_stream_file(asm_ctx *ctx, const char *path, int fd, int format,
+                    const asm_options *opts, asm_result **result);
+
+/* releases a result, NULL is ignored */
+void asm_result_free(asm_result *result);
+
+/* ASM_OK or ASM_ERRORS */
+int asm_result_status(const asm_result *result);
+
+/* assembled words, the instructions followed by the data words.
+   the address of a word is its index. NULL for a streamed result.
+   a word that uses an ASM_SYM_EXTERN symbol has 0 in its place */
+const uint32_t *asm_result_words(const asm_result *result);
+
+/* number of words */
+size_t asm_result_word_count(const asm_result *result);
+
+/* number of words that are instructions */
+size_t asm_result_text_count(const asm_result *result);
+
+/* symbols, defined or only used, in the order they were first seen */
+size_t asm_result_symbol_count(const asm_result *result);
+const char *asm_result_symbol_name(const asm_result *result, size_t i);
+int asm_result_symbol_address(const asm_result *result, size_t i);
+int asm_result_symbol_binding(const asm_result *result, size_t i);
+
+/* the source is assembled in chunks, reused is how many of them
+   came out of the cache */
+void asm_result_cache_stats(const asm_result *result, size_t *chunks, size_t *reused);
+
+/* diagnostics in line order */
+size_t asm_result_diag_count(const asm_result *result);
+int asm_result_diag_kind(const asm_result *result, size_t i);
+int asm_result_diag_line(const asm_result *result, size_t i);
+const char *asm_result_diag_text(const asm_result *result, size_t i);
+
+/* writes the obj file of an ASM_OK result to fd, returns 0 on success.
+   a streamed result has no words and cannot be written again */
+int asm_result_write_obj(const asm_result *result, int fd);
+
+/* writes the err file of an ASM_ERRORS result to fd, a listing of
+   the source followed by the errors. returns 0 on success */
+int asm_result_write_err(const asm_result *result, int fd);
+
+/* formats the obj or err file into memory owned by the result and
+   sets len to its size, NULL if it cannot be made */
+const char *asm_result_obj_text(asm_result *result, size_t *len);
+const char *asm_result_err_text(asm_result *result, size_t *len);
+
+/* the same for the obj file in one of the ASM_FORMAT_ formats. packed
+   words go to the file in address order, the text at address 0 and
+   the data straight after it. an ELF file holds the same words in a
+   .text and a .data section loaded at those addresses, and the labels
+   as symbols at their byte address, which la loads there in place of
+   the word address. a relocatable object has
+   the sections at address 0 and a .rel.text section for the words
+   that use labels, which asm_link_files fills in. a result that uses
+   ASM_SYM_EXTERN symbols can only be written as a relocatable object,
+   the other formats fail */
+int asm_result_write_format(const asm_result *result, int fd, int format);
+const char *asm_result_format_data(asm_result *result, int format, size_t *len);
+
+/* links npaths relocatable objects into one program and sets *result
+   as the assemble calls do. the text of every object comes first, in
+   the order given, then the data of every object, and every word
+   that uses a label is filled in. the diagnostics are undefined and
+   multiply defined global symbols, branches out of reach and files
+   that are not objects, with the index of the object + 1 as their
+   line. returns ASM_ENOENT if a file cannot be read */
+int asm_link_files(asm_ctx *ctx, const char *const *paths, size_t npaths,
+                   asm_result **result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,413 @@
+/* mipsld.c
+
+   usage: mipsld [-j threads] [--format=name] [-o outfile] <objfile>...
+          mipsld [-j threads] --bench-relocs count
+
+   This program links relocatable objects written by the assembler
+   with --format=rel into one program, see asm_link_files in
+   libasm.h. The text of every object goes first, in the order the
+   objects are given, then the data of every object, and the words
+   that use labels of any object are filled in. The program is
+   written as a big endian MIPS ELF executable to a.elf unless -o
+   names another file, and --format picks another output format as
+   the assembler takes it. Problems are printed with the object
+   they were found in and nothing is written.
+
+   --bench-relocs assembles a made up program split into objects
+   that hold count relocations between them, links it a few times
+   and reports how long the link took and how many relocations it
+   applied per second.
+*/
+
+/************* Includes **************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "libasm.h"
+
+/*************** constants ******************/
+
+#define MAX_THREADS 256  /* most threads -j accepts */
+
+/* the made up program of --bench-relocs */
+#define BENCH_OBJECTS 8     /* objects it is split into */
+#define BENCH_LABELS 64     /* global labels each object defines */
+#define BENCH_RUNS 5        /* links timed */
+#define BENCH_LINE_LEN 64   /* longest line written */
+
+/* an output format --format takes */
+typedef struct formatname_s
+{
+    const char *name;  /* name given to --format */
+    int format;        /* one of the ASM_FORMAT_ constants */
+} formatname;
+
+/* every output format, the first is the default */
+static const formatname formats[] =
+{
+    { "elf",     ASM_FORMAT_ELF_BE  },
+    { "elf-le",  ASM_FORMAT_ELF_LE  },
+    { "elf-be",  ASM_FORMAT_ELF_BE  },
+    { "obj",     ASM_FORMAT_OBJ     },
+    { "bin-le",  ASM_FORMAT_BIN_LE  },
+    { "bin-be",  ASM_FORMAT_BIN_BE  },
+    { "ihex",    ASM_FORMAT_IHEX_BE },
+    { "ihex-le", ASM_FORMAT_IHEX_LE },
+    { "ihex-be", ASM_FORMAT_IHEX_BE },
+    { "srec",    ASM_FORMAT_SREC_BE },
+    { "srec-le", ASM_FORMAT_SREC_LE },
+    { "srec-be", ASM_FORMAT_SREC_BE },
+    { "rel",     ASM_FORMAT_REL_BE  },
+    { "rel-le",  ASM_FORMAT_REL_LE  },
+    { "rel-be",  ASM_FORMAT_REL_BE  },
+};
+
+#define FORMAT_COUNT (sizeof(formats) / sizeof(formats[0]))
+
+/* this function returns the output format called name, NULL if
+   there is none */
+static const formatname *findformat(const char *name)
+{
+    size_t k;  /* format iterator */
+
+    for (k = 0; k < FORMAT_COUNT; k++)
+    {
+        if (strcmp(formats[k].name, name) == 0)
+        {
+            return &formats[k];
+        }
+    }
+    return NULL;
+}
+
+/* this function prints the diagnostics of a link, each with the
+   object it was found in. the line of a diagnostic is the index of
+   its object + 1 */
+static void printdiags(const asm_result *res, char **paths)
+{
+    size_t k;  /* diagnostic iterator */
+    int obj;   /* object of the diagnostic */
+
+    for (k = 0; k < asm_result_diag_count(res); k++)
+    {
+        obj = asm_result_diag_line(res, k) - 1;
+        switch (asm_result_diag_kind(res, k))
+        {
+        case ASM_DIAG_BADOBJECT:
+            fprintf(stderr, "%s: not a relocatable object\n", paths[obj]);
+            break;
+
+        case ASM_DIAG_MULTIPLE:
+            fprintf(stderr, "%s: multiply defined symbol: %s\n", paths[obj],
+                    asm_result_diag_text(res, k));
+            break;
+
+        case ASM_DIAG_RANGE:
+            fprintf(stderr, "%s: branch target out of range: %s\n", paths[obj],
+                    asm_result_diag_text(res, k));
+            break;
+
+        default:
+            fprintf(stderr, "%s: undefined symbol: %s\n", paths[obj],
+                    asm_result_diag_text(res, k));
+            break;
+        }
+    }
+}
+
+/* this function writes the source of object m of the made up program
+   into a malloc'd buffer and sets len to its size. of its lines of
+   text every other one is a j to a label of the next object and the
+   rest are la of a word of the object after that, so there are three
+   relocations for every two lines. returns NULL if out of memory */
+static char *benchsource(int m, long lines, size_t *len)
+{
+    char *src;        /* the source */
+    size_t cap;       /* bytes allocated */
+    size_t n = 0;     /* bytes written */
+    long k;           /* line iterator */
+    int next = (m + 1) % BENCH_OBJECTS;  /* object the j lines go to */
+    int data = (m + 2) % BENCH_OBJECTS;  /* object the la lines load from */
+
+    cap = (size_t)(lines + 4 * BENCH_LABELS + 16) * BENCH_LINE_LEN;
+    if ((src = malloc(cap)) == NULL)
+    {
+        return NULL;
+    }
+
+    for (k = 0; k < BENCH_LABELS; k++)
+    {
+        n += (size_t)sprintf(src + n, "\t.globl T%d_%ld, D%d_%ld\n", m, k, m, k);
+        n += (size_t)sprintf(src + n, "\t.extern T%d_%ld, D%d_%ld\n", next, k, data, k);
+    }
+    n += (size_t)sprintf(src + n, "\t.text\n");
+    for (k = 0; k < lines; k++)
+    {
+        if (k % (lines / BENCH_LABELS + 1) == 0)
+        {
+            n += (size_t)sprintf(src + n, "T%d_%ld:", m, k / (lines / BENCH_LABELS + 1));
+        }
+        if (k % 2 == 0)
+        {
+            n += (size_t)sprintf(src + n, "\tj T%d_%ld\n", next, k % BENCH_LABELS);
+        }
+        else
+        {
+            n += (size_t)sprintf(src + n, "\tla $t0, D%d_%ld\n", data, k % BENCH_LABELS);
+        }
+    }
+    /* labels the text was too short to reach */
+    for (k = lines / (lines / BENCH_LABELS + 1) + 1; k < BENCH_LABELS; k++)
+    {
+        n += (size_t)sprintf(src + n, "T%d_%ld:\tlui $t1, 1\n", m, k);
+    }
+    n += (size_t)sprintf(src + n, "\t.data\n");
+    for (k = 0; k < BENCH_LABELS; k++)
+    {
+        n += (size_t)sprintf(src + n, "D%d_%ld:\t.word %ld\n", m, k, k);
+    }
+
+    *len = n;
+    return src;
+}
+
+/* compares two link times for qsort */
+static int cmptimes(const void *a, const void *b)
+{
+    double x = *(const double *)a;  /* first time */
+    double y = *(const double *)b;  /* second time */
+
+    return (x > y) - (x < y);
+}
+
+/* this function takes in a context and a number of relocations. it
+   writes the objects of a made up program with about that many
+   relocations to temporary files, links them BENCH_RUNS times and
+   prints the times. returns 0, or 1 if something failed */
+static int benchrelocs(asm_ctx *ctx, long count)
+{
+    char paths[BENCH_OBJECTS][32];      /* the objects */
+    const char *names[BENCH_OBJECTS];   /* the same for the link */
+    double times[BENCH_RUNS];           /* time of every link */
+    struct timespec t0, t1;  /* start and end of a link */
+    asm_result *res = NULL;  /* an object, then the program */
+    char *src;               /* source of an object */
+    size_t len;              /* its length */
+    const char *obj;         /* the object */
+    int made = 0;            /* objects written */
+    int status = 0;          /* what is returned */
+    int fd;                  /* object file */
+    int m;                   /* object and run iterator */
+
+    /* assemble the objects, two lines of text for every three of
+       their share of the relocations */
+    for (m = 0; m < BENCH_OBJECTS && status == 0; m++)
+    {
+        strcpy(paths[m], "/tmp/mipsld-bench-XXXXXX");
+        names[m] = paths[m];
+        if ((fd = mkstemp(paths[m])) < 0)
+        {
+            fprintf(stderr, "Error opening object file: %s\n", paths[m]);
+            status = 1;
+            break;
+        }
+        made++;
+        src = benchsource(m, (count / BENCH_OBJECTS) * 2 / 3 + 1, &len);
+        if (src == NULL || asm_assemble_buffer(ctx, src, len, NULL, &res) != ASM_OK ||
+            (obj = asm_result_format_data(res, ASM_FORMAT_REL_LE, &len)) == NULL ||
+            write(fd, obj, len) != (ssize_t)len)
+        {
+            fprintf(stderr, "Error writing object file: %s\n", paths[m]);
+            status = 1;
+        }
+        free(src);
+        close(fd);
+        asm_result_free(res);
+        res = NULL;
+    }
+
+    for (m = 0; m < BENCH_RUNS && status == 0; m++)
+    {
+        asm_result_free(res);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (asm_link_files(ctx, names, BENCH_OBJECTS, &res) != ASM_OK)
+        {
+            fprintf(stderr, "The made up program did not link.\n");
+            status = 1;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        times[m] = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    }
+
+    if (status == 0)
+    {
+        qsort(times, BENCH_RUNS, sizeof(double), cmptimes);
+        printf("%d objects, about %ld relocations, %lu words\n", BENCH_OBJECTS, count,
+               (unsigned long)asm_result_word_count(res));
+        printf("link ms: min %.1f  median %.1f  max %.1f\n",
+               times[0], times[BENCH_RUNS / 2], times[BENCH_RUNS - 1]);
+        printf("%.1f M relocations/s\n", count / (times[0] / 1e3) / 1e6);
+    }
+    asm_result_free(res);
+
+    for (m = 0; m < made; m++)
+    {
+        unlink(paths[m]);
+    }
+    return status;
+}
+
+/* main method */
+int main(int argc, char **argv)
+{
+    /************* Variables **********************/
+    char *temp;              /* argument of -j */
+    int threads = 0;         /* threads to use, 0 picks one per cpu */
+    const char *outpath = "a.elf";  /* program written */
+    const formatname *format = &formats[0];  /* its format */
+    asm_ctx *ctx;            /* context to link with */
+    asm_result *res;         /* the linked program */
+    int rc;                  /* result of the link */
+    int fd;                  /* output file */
+    long bench = 0;          /* relocations to benchmark, 0 links */
+    int bad = 0;             /* an option has a bad value */
+    int i;                   /* argument iterator */
+
+
+    /************* BEGIN main executables *********/
+
+    /* -j sets the number of threads, -o the output file and
+       --format its format */
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (argv[i][1] == 'j')
+        {
+            /* -jN or -j N */
+            temp = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            threads = atoi(temp);
+            if (threads < 1 || threads > MAX_THREADS)
+            {
+                bad = 1;
+                break;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-relocs") == 0 && i + 1 < argc)
+        {
+            bench = atol(argv[++i]);
+            if (bench <= 0)
+            {
+                bad = 1;
+                break;
+            }
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            outpath = argv[++i];
+        }
+        else if (strncmp(argv[i], "--format=", 9) == 0)
+        {
+            format = findformat(argv[i] + 9);
+            if (format == NULL)
+            {
+                break;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    /* check if we have correct arguments, a benchmark takes no files */
+    if (bad || (bench == 0 && i >= argc) || (bench > 0 && i < argc) ||
+        (i < argc && argv[i][0] == '-'))
+    {
+        fprintf(stderr, "Invalid arguments provided.\n");
+        fprintf(stderr, "usage: %s [-j threads] [--format=name] [-o outfile] <objfile>...\n",
+                argv[0]);
+        fprintf(stderr, "       %s [-j threads] --bench-relocs count\n", argv[0]);
+        exit(1);
+    }
+
+    if (bench > 0)
+    {
+        if ((ctx = asm_ctx_create(threads)) == NULL)
+        {
+            fprintf(stderr, "Out of memory.\n");
+            exit(1);
+        }
+        rc = benchrelocs(ctx, bench);
+        asm_ctx_destroy(ctx);
+        return rc;
+    }
+
+    /* a file that cannot be read is named before anything is linked */
+    for (rc = i; rc < argc; rc++)
+    {
+        if (access(argv[rc], R_OK) != 0)
+        {
+            fprintf(stderr, "Error opening object file: %s\n", argv[rc]);
+            exit(1);
+        }
+    }
+
+    if ((ctx = asm_ctx_create(threads)) == NULL)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        exit(1);
+    }
+
+    rc = asm_link_files(ctx, (const char *const *)(argv + i), (size_t)(argc - i), &res);
+    if (rc == ASM_ENOENT)
+    {
+        fprintf(stderr, "Error opening object file.\n");
+        asm_ctx_destroy(ctx);
+        exit(1);
+    }
+    if (rc == ASM_ENOMEM)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        asm_ctx_destroy(ctx);
+        exit(1);
+    }
+    if (rc == ASM_ERRORS)
+    {
+        printdiags(res, argv + i);
+        asm_ctx_destroy(ctx);
+        exit(1);
+    }
+
+    /* write the program */
+    if ((fd = open(outpath, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+        fprintf(stderr, "Error opening output file: %s\n", outpath);
+        asm_ctx_destroy(ctx);
+        exit(1);
+    }
+    if (asm_result_write_format(res, fd, format->format) != 0)
+    {
+        fprintf(stderr, "Error writing output file: %s\n", outpath);
+        close(fd);
+        unlink(outpath);
+        asm_ctx_destroy(ctx);
+        exit(1);
+    }
+    close(fd);
+
+    printf("%s: %lu words, %lu of text\n", outpath,
+           (unsigned long)asm_result_word_count(res),
+           (unsigned long)asm_result_text_count(res));
+
+    asm_result_free(res);
+    asm_ctx_destroy(ctx);
+
+    /**************** END main executables *********************/
+
+    /* exit program */
+    return 0;
+}
@@ -0,0 +1,14 @@
+# tests/elf.asm, the program tests/elf.sh writes as ELF
+	.text
+Main: la $t1,Table
+	lw $t2,0($t1)
+	addi $t0,$zero,4
+Loop: add $t3,$t3,$t2
+	addi $t0,$t0,-1
+	bne $t0,$zero,Loop
+	sw $t3,4($t1)
+	j Main
+
+	.data
+Table: .word 7:1
+Sum: .resw 1
@@ -0,0 +1,128 @@
+#!/bin/sh
+# tests/elf.sh
+#
+#   usage: tests/elf.sh [assembler] [mipsld]
+#
+#   Writes tests/elf.asm with --format=elf and --format=elf-le and
+#   checks what readelf -h -S -s and objdump -d make of the two files
+#   against tests/elf.expect and tests/elf-le.expect. The listings are
+#   cut down to the header fields, the section and symbol rows and
+#   the address, word and mnemonic of every instruction, so GNU and
+#   LLVM tools give the same text. objdump has to know MIPS, the
+#   first of $OBJDUMP, mips-linux-gnu-objdump, llvm-objdump and
+#   objdump that can disassemble the file is used, and $READELF or
+#   readelf or llvm-readelf for the rest.
+#
+#   The la at Main has to load the byte address readelf gives Table,
+#   and the instructions have to come out the same when pass one is
+#   read back from the cache and when the program is linked from a
+#   relocatable object.
+
+ASM=${1:-./assembler}
+LD=${2:-./mipsld}
+TESTS=$(cd "$(dirname "$0")" && pwd)
+
+for tool in "$ASM" "$LD"
+do
+    [ -x "$tool" ] || { echo "no $tool, build it first" >&2; exit 1; }
+done
+case $ASM in /*) ;; *) ASM=$(pwd)/$ASM ;; esac
+case $LD in /*) ;; *) LD=$(pwd)/$LD ;; esac
+
+for READELF in $READELF readelf llvm-readelf ""
+do
+    command -v "$READELF" > /dev/null 2>&1 && break
+done
+[ -n "$READELF" ] || { echo "no readelf found" >&2; exit 1; }
+
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+cd "$DIR" || exit 1
+
+# the header fields, section rows and symbol rows, blanks squeezed
+readelfrows()
+{
+    "$READELF" -h -S -s "$1" | awk '
+        /^ELF Header:/        { header = 1; next }
+        /^[A-Z]/              { header = 0 }
+        /^ *\[ *[0-9]+\]/ || /^ *[0-9]+: [0-9a-f]+ / || (header && /:/) {
+            gsub(/[ \t]+/, " ")
+            sub(/^ /, "")
+            sub(/ $/, "")
+            print
+        }'
+}
+
+# the labels and the address, word and mnemonic of every instruction.
+# LLVM prints the bytes in file order, GNU the word, $2 says which
+# order the bytes of the file are in
+objdumprows()
+{
+    "$OBJDUMP" -d "$1" | awk -v le="$2" '
+        /^[0-9a-f]+ <.*>:$/ { print; next }
+        /^ *[0-9a-f]+:/ {
+            word = ""
+            for (i = 2; i <= NF && $i ~ /^[0-9a-f]+$/ && (length($i) == 2 || length($i) == 8); i++)
+                word = (le && length($i) == 2) ? $i word : word $i
+            print $1, word, $i
+        }'
+}
+
+cp "$TESTS/elf.asm" elf.asm
+"$ASM" --format=elf elf.asm > /dev/null || { echo "assembling elf.asm failed" >&2; exit 1; }
+for OBJDUMP in $OBJDUMP mips-linux-gnu-objdump llvm-objdump objdump ""
+do
+    [ -n "$OBJDUMP" ] || { echo "no objdump that knows MIPS found" >&2; exit 1; }
+    command -v "$OBJDUMP" > /dev/null 2>&1 || continue
+    "$OBJDUMP" -d elf.elf 2> /dev/null | grep -q '<Main>:' && break
+done
+
+fail=0
+for format in elf elf-le
+do
+    le=0
+    [ "$format" = elf-le ] && le=1
+    "$ASM" --format=$format elf.asm > /dev/null || { echo "assembling elf.asm as $format failed" >&2; exit 1; }
+    {
+        echo "== $READELF -h -S -s"
+        readelfrows elf.elf
+        echo "== $OBJDUMP -d"
+        objdumprows elf.elf $le
+    } | sed 's/^== [^ ]*readelf /== readelf /; s/^== [^ ]*objdump /== objdump /' > $format.out
+    if ! diff -u "$TESTS/$format.expect" $format.out
+    then
+        echo "FAIL: $format output differs from tests/$format.expect" >&2
+        fail=1
+    fi
+
+    # the lui and ori at Main against the symbol
+    table=$(awk '$NF == "Table" { print $2 }' $format.out)
+    lui=$(awk '/^== objdump/ { d = 1 } d && $1 == "0:" { print $2 }' $format.out)
+    ori=$(awk '/^== objdump/ { d = 1 } d && $1 == "4:" { print $2 }' $format.out)
+    if [ $(( (0x$lui & 0xffff) << 16 | (0x$ori & 0xffff) )) != $((0x$table)) ]
+    then
+        echo "FAIL: $format la loads 0x$lui/0x$ori, Table is at 0x$table" >&2
+        fail=1
+    fi
+
+    # the same instructions from the cache, read twice so the second
+    # run uses it, and from a linked object
+    objdumprows elf.elf $le | grep -v '>:$' > $format.words
+    "$ASM" --cache-dir cache --format=$format elf.asm > /dev/null &&
+    "$ASM" --cache-dir cache --format=$format elf.asm > /dev/null &&
+    objdumprows elf.elf $le | grep -v '>:$' > $format.cached
+    "$ASM" --format=rel$(echo $format | cut -c4-) elf.asm > /dev/null &&
+    "$LD" --format=$format -o linked.elf elf.o > /dev/null &&
+    objdumprows linked.elf $le | grep -v '>:$' > $format.linked
+    for how in cached linked
+    do
+        if ! diff -u $format.words $format.$how
+        then
+            echo "FAIL: $format instructions differ when $how" >&2
+            fail=1
+        fi
+    done
+done
+
+[ $fail = 0 ] && echo "elf: ok"
+exit $fail
@@ -0,0 +1,81 @@
+#!/bin/sh
+# tests/globl.sh
+#
+#   usage: tests/globl.sh [assembler] [mipsld]
+#
+#   Checks that .globl and .extern take lists longer than the tokens
+#   the lexer keeps of a line. def.asm declares 40 globals above the
+#   text and 10 more after a label, use.asm names all 50 on .extern
+#   lines and jumps to each, and the two objects linked together
+#   must give the words of the same program assembled as one file.
+#   use.asm on its own has to be refused the same way with and
+#   without --stream, leaving no obj file behind.
+
+ASM=${1:-./assembler}
+LD=${2:-./mipsld}
+
+for tool in "$ASM" "$LD"
+do
+    [ -x "$tool" ] || { echo "no $tool, build it first" >&2; exit 1; }
+done
+case $ASM in /*) ;; *) ASM=$(pwd)/$ASM ;; esac
+case $LD in /*) ;; *) LD=$(pwd)/$LD ;; esac
+
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+cd "$DIR" || exit 1
+
+fail()
+{
+    echo "FAIL: $*" >&2
+    exit 1
+}
+
+awk 'BEGIN {
+    printf "\t.globl g0"
+    for (i = 1; i < 40; i++)
+        printf ", g%d", i
+    print "   # one line"
+    print "\t.text"
+    for (i = 0; i < 40; i++)
+        printf "g%d:\taddi $t0,$t0,%d\n", i, i
+    printf "Mid:\t.globl h0"
+    for (i = 1; i < 10; i++)
+        printf ",h%d", i
+    print ""
+    for (i = 0; i < 10; i++)
+        printf "h%d:\taddi $t1,$t1,%d\n", i, i
+}' > def.asm
+
+awk 'BEGIN {
+    printf "\t.extern g0"
+    for (i = 1; i < 40; i++)
+        printf ",g%d", i
+    print ""
+    print "\t.text"
+    printf "Main:\t.extern h0"
+    for (i = 1; i < 10; i++)
+        printf " h%d", i
+    print ""
+    for (i = 0; i < 40; i++)
+        printf "\tj g%d\n", i
+    for (i = 0; i < 10; i++)
+        printf "\tj h%d\n", i
+}' > use.asm
+
+grep -v extern use.asm > all.asm
+grep -v globl def.asm >> all.asm
+
+"$ASM" --format=rel use.asm def.asm > /dev/null || fail "assembling the objects"
+"$LD" --format=bin-le -o linked.bin use.o def.o > /dev/null || fail "linking the objects"
+"$ASM" --format=bin-le all.asm > /dev/null || fail "assembling all.asm"
+cmp -s linked.bin all.bin || fail "linked words differ from all.asm"
+
+for mode in "" --stream
+do
+    msg=$("$ASM" $mode use.asm 2>&1 > /dev/null) && fail "use.asm accepted as obj $mode"
+    [ "$msg" = "External symbols need --format=rel: use.asm" ] || fail "use.asm $mode: $msg"
+    [ -f use.obj ] && fail "use.obj left behind $mode"
+done
+
+echo "globl: ok"